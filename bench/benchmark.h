@@ -0,0 +1,92 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace puloon {
+
+	namespace bench {
+
+		// keeps the compiler from removing
+		// a computation whose result is not used
+		template <typename T>
+		inline void do_not_optimize(const T& value) {
+#if defined(__GNUC__)
+			asm volatile("" : : "g"(&value) : "memory");
+#else
+			static volatile const void* sink;
+			sink = &value;
+#endif
+		}
+
+		// runs a function repeatedly
+		// and returns the mean time of one call in nanoseconds
+		template <typename Function>
+		double measure_ns_per_call(std::uint64_t iterations, Function function) {
+			// warm up caches and branch predictors
+			for (std::uint64_t i = 0; i < std::min<std::uint64_t>(iterations / 10, 10000); ++i) {
+				function();
+			}
+
+			const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			for (std::uint64_t i = 0; i < iterations; ++i) {
+				function();
+			}
+			const std::chrono::steady_clock::time_point stop = std::chrono::steady_clock::now();
+
+			return (double)std::chrono::duration_cast<std::chrono::nanoseconds>(stop - start).count() / (double)iterations;
+		}
+
+		// latencies of completed transactions
+		class latency_recorder {
+			public:
+				latency_recorder() :
+					latencies() {
+				}
+
+				void record(std::chrono::nanoseconds latency) {
+					this->latencies.push_back(latency.count());
+				}
+
+				std::size_t get_count() const {
+					return this->latencies.size();
+				}
+
+				// returns the latency in microseconds
+				// below which the given fraction of transactions completed
+				double get_percentile(double fraction) {
+					if (this->latencies.empty()) {
+						return 0.0;
+					}
+
+					std::sort(this->latencies.begin(), this->latencies.end());
+					std::size_t index = (std::size_t)(fraction * (double)this->latencies.size());
+					index = std::min(index, this->latencies.size() - 1);
+					return (double)this->latencies[index] / 1000.0;
+				}
+
+			private:
+				std::vector<std::int64_t> latencies;
+		};
+
+		struct options {
+			// iterations of every micro-benchmark
+			std::uint64_t iterations;
+			// transactions of every end-to-end benchmark
+			std::uint64_t transactions;
+			// only benchmarks which names contain the filter are run
+			std::string filter;
+		};
+
+		void run_micro_benchmarks(const options& bench_options);
+		void run_end_to_end_benchmarks(const options& bench_options);
+
+	}
+
+}
+
+#endif // BENCHMARK_H
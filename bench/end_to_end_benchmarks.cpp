@@ -0,0 +1,290 @@
+#include "benchmark.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <exception>
+#include <functional>
+#include <future>
+#include "lcdm.h"
+#if defined(PULOON_BENCH_SIMULATOR)
+#include "lcdm_simulator.h"
+#endif
+
+using namespace puloon;
+
+#if defined(PULOON_BENCH_SIMULATOR)
+
+static void print_result(const char* name, const std::chrono::nanoseconds& duration, bench::latency_recorder& latencies) {
+	const double seconds = (double)duration.count() / 1e9;
+	std::printf("%-40s %10zu %12.1f %10.1f %10.1f %10.1f\n",
+		name,
+		latencies.get_count(),
+		(double)latencies.get_count() / seconds,
+		latencies.get_percentile(0.5),
+		latencies.get_percentile(0.99),
+		latencies.get_percentile(0.999));
+}
+
+// prints the latencies of the command exchange
+// measured by the driver
+static void print_metrics(const lcdm_metrics& metrics) {
+	std::printf("\n%-10s %10s %8s %8s %12s %12s %12s\n", "command", "commands", "retries", "naks", "queue p50 us", "ack p50 us", "resp p50 us");
+
+	for (const std::pair<const std::uint8_t, command_metrics>& command : metrics.commands) {
+		std::printf("0x%-8x %10llu %8llu %8llu %12lld %12lld %12lld\n",
+			command.first,
+			(unsigned long long)command.second.commands,
+			(unsigned long long)command.second.command_retries,
+			(unsigned long long)(command.second.received_naks + command.second.sent_naks),
+			(long long)command.second.queue_wait.get_percentile(0.5).count(),
+			(long long)command.second.acknowledge_latency.get_percentile(0.5).count(),
+			(long long)command.second.response_latency.get_percentile(0.5).count());
+	}
+}
+
+// runs transactions one after another,
+// every transaction is started when the previous one is completed
+template <typename Transaction>
+static void run_sequential(const char* name, std::uint64_t transactions, Transaction transaction) {
+	bench::latency_recorder latencies;
+
+	const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (std::uint64_t i = 0; i < transactions; ++i) {
+		const std::chrono::steady_clock::time_point transaction_start = std::chrono::steady_clock::now();
+		transaction();
+		latencies.record(std::chrono::steady_clock::now() - transaction_start);
+	}
+	const std::chrono::steady_clock::time_point stop = std::chrono::steady_clock::now();
+
+	print_result(name, stop - start, latencies);
+}
+
+// keeps a fixed number of transactions in flight,
+// a completed transaction submits the next one;
+// the latency of a transaction includes its queue wait time
+static void run_pipelined_purge(const char* name, lcdm& device, std::uint64_t transactions) {
+	// stays below the capacity of the submission queue
+	const std::uint64_t pipeline_depth = std::min<std::uint64_t>(transactions, 32);
+
+	std::vector<std::chrono::steady_clock::time_point> submit_times(transactions);
+	std::vector<std::chrono::steady_clock::time_point> completion_times(transactions);
+	std::atomic<std::uint64_t> completed_transactions(0);
+	std::atomic<std::uint64_t> failed_transactions(0);
+	std::promise<void> all_completed;
+	std::function<void(std::uint64_t)> submit;
+
+	submit = [&](std::uint64_t i) {
+		submit_times[i] = std::chrono::steady_clock::now();
+		device.purge([&, i](std::exception_ptr error, lcdm::operation_status status) {
+			completion_times[i] = std::chrono::steady_clock::now();
+			if (error || (status == lcdm::operation_status::cancelled) || (status == lcdm::operation_status::queue_full)) {
+				++failed_transactions;
+			}
+			if (i + pipeline_depth < transactions) {
+				submit(i + pipeline_depth);
+			}
+			if (++completed_transactions == transactions) {
+				all_completed.set_value();
+			}
+		});
+	};
+
+	const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (std::uint64_t i = 0; i < pipeline_depth; ++i) {
+		submit(i);
+	}
+	all_completed.get_future().wait();
+	const std::chrono::steady_clock::time_point stop = std::chrono::steady_clock::now();
+
+	bench::latency_recorder latencies;
+	for (std::uint64_t i = 0; i < transactions; ++i) {
+		latencies.record(completion_times[i] - submit_times[i]);
+	}
+	print_result(name, stop - start, latencies);
+
+	if (failed_transactions > 0) {
+		std::printf("%-40s %10llu\n", "  failed", (unsigned long long)failed_transactions.load());
+	}
+}
+
+#if defined(PULOON_HAS_COROUTINES)
+// coroutine that starts at once and is destroyed at its end,
+// it runs on the threads that resume it
+struct detached_coroutine {
+	struct promise_type {
+		detached_coroutine get_return_object() {
+			return detached_coroutine();
+		}
+
+		std::suspend_never initial_suspend() noexcept {
+			return std::suspend_never();
+		}
+
+		std::suspend_never final_suspend() noexcept {
+			return std::suspend_never();
+		}
+
+		void return_void() {
+		}
+
+		void unhandled_exception() {
+			std::terminate();
+		}
+	};
+};
+
+template <typename Transaction>
+static detached_coroutine await_transactions(std::uint64_t transactions, Transaction transaction, bench::latency_recorder& latencies, std::promise<void>& all_completed) {
+	for (std::uint64_t i = 0; i < transactions; ++i) {
+		const std::chrono::steady_clock::time_point transaction_start = std::chrono::steady_clock::now();
+		co_await transaction();
+		latencies.record(std::chrono::steady_clock::now() - transaction_start);
+	}
+
+	all_completed.set_value();
+}
+
+// awaits transactions one after another in a coroutine,
+// the coroutine is resumed by the handlers of the device
+template <typename Transaction>
+static void run_awaited(const char* name, std::uint64_t transactions, Transaction transaction) {
+	bench::latency_recorder latencies;
+	std::promise<void> all_completed;
+	std::future<void> all_completed_result = all_completed.get_future();
+
+	const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	await_transactions(transactions, transaction, latencies, all_completed);
+	all_completed_result.wait();
+	const std::chrono::steady_clock::time_point stop = std::chrono::steady_clock::now();
+
+	print_result(name, stop - start, latencies);
+}
+#endif
+
+// captures dispense transactions of the simulator
+// and replays them without the pseudo-terminal,
+// so only the driver is measured
+static void run_replayed_dispense(const char* name, lcdm& device, std::uint64_t transactions) {
+	const std::string capture_file_name = "puloon-cxx-bench.capture";
+	lcdm::bill_counts requested_bills;
+	requested_bills[0] = 1;
+	requested_bills[1] = 1;
+
+	device.start_capture(capture_file_name);
+	for (std::uint64_t i = 0; i < transactions; ++i) {
+		device.dispense(requested_bills).get();
+	}
+	// the capture is complete when the device has processed the stop
+	device.stop_capture();
+	device.purge().get();
+
+	{
+		lcdm replaying_device{ lcdm::replay_capture(capture_file_name) };
+
+		run_sequential(name, transactions, [&replaying_device, &requested_bills]() {
+			replaying_device.dispense(requested_bills).get();
+		});
+	}
+
+	std::remove(capture_file_name.c_str());
+}
+
+void puloon::bench::run_end_to_end_benchmarks(const options& bench_options) {
+	// the simulator answers without delays,
+	// so the benchmarks measure the driver and the pseudo-terminal
+	lcdm_simulator::settings simulator_settings;
+	simulator_settings.ack_latency = std::chrono::microseconds(0);
+	simulator_settings.response_latency = std::chrono::microseconds(0);
+	simulator_settings.upper_cassette_bills = 0xffffffff;
+	simulator_settings.lower_cassette_bills = 0xffffffff;
+
+	lcdm_simulator simulator(simulator_settings);
+	lcdm device(simulator.get_port_name());
+
+	std::printf("%-40s %10s %12s %10s %10s %10s\n", "end-to-end benchmark", "count", "tps", "p50 us", "p99 us", "p999 us");
+
+	if (std::string("purge").find(bench_options.filter) != std::string::npos) {
+		run_sequential("purge", bench_options.transactions, [&device]() {
+			device.purge().get();
+		});
+	}
+
+	if (std::string("dispense").find(bench_options.filter) != std::string::npos) {
+		run_sequential("dispense", bench_options.transactions, [&device]() {
+			lcdm::bill_counts requested_bills;
+			requested_bills[0] = 1;
+			requested_bills[1] = 1;
+			device.dispense(requested_bills).get();
+		});
+	}
+
+	if (std::string("dispense_in_rounds").find(bench_options.filter) != std::string::npos) {
+		// five rounds of both cassettes
+		run_sequential("dispense_in_rounds", bench_options.transactions, [&device]() {
+			lcdm::bill_counts requested_bills;
+			requested_bills[0] = 300;
+			requested_bills[1] = 300;
+			device.dispense_in_rounds(requested_bills, lcdm::dispense_progress_handler()).get();
+		});
+	}
+
+	if (std::string("pipelined_purge").find(bench_options.filter) != std::string::npos) {
+		run_pipelined_purge("pipelined_purge", device, bench_options.transactions);
+	}
+
+#if defined(PULOON_HAS_COROUTINES)
+	if (std::string("co_purge").find(bench_options.filter) != std::string::npos) {
+		run_awaited("co_purge", bench_options.transactions, [&device]() {
+			return device.co_purge();
+		});
+	}
+
+	if (std::string("co_dispense").find(bench_options.filter) != std::string::npos) {
+		run_awaited("co_dispense", bench_options.transactions, [&device]() {
+			lcdm::bill_counts requested_bills;
+			requested_bills[0] = 1;
+			requested_bills[1] = 1;
+			return device.co_dispense(requested_bills);
+		});
+	}
+#endif
+
+	if (std::string("replayed_dispense").find(bench_options.filter) != std::string::npos) {
+		run_replayed_dispense("replayed_dispense", device, bench_options.transactions);
+	}
+
+	if ((std::string("pipe_purge").find(bench_options.filter) != std::string::npos)
+		|| (std::string("pipe_dispense").find(bench_options.filter) != std::string::npos)) {
+		// the same simulator behind an in-process pipe,
+		// so the driver runs without the pseudo-terminal
+		lcdm_simulator pipe_simulator(lcdm_simulator::in_process_pipe(), simulator_settings);
+		lcdm pipe_device([&pipe_simulator](boost::asio::io_service& io_service) {
+			return pipe_simulator.create_transport(io_service);
+		});
+
+		if (std::string("pipe_purge").find(bench_options.filter) != std::string::npos) {
+			run_sequential("pipe_purge", bench_options.transactions, [&pipe_device]() {
+				pipe_device.purge().get();
+			});
+		}
+
+		if (std::string("pipe_dispense").find(bench_options.filter) != std::string::npos) {
+			run_sequential("pipe_dispense", bench_options.transactions, [&pipe_device]() {
+				lcdm::bill_counts requested_bills;
+				requested_bills[0] = 1;
+				requested_bills[1] = 1;
+				pipe_device.dispense(requested_bills).get();
+			});
+		}
+	}
+
+	print_metrics(device.get_metrics());
+}
+
+#else
+
+void puloon::bench::run_end_to_end_benchmarks(const options&) {
+	std::printf("end-to-end benchmarks require the LCDM simulator\n");
+}
+
+#endif
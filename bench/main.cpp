@@ -0,0 +1,55 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "benchmark.h"
+
+using namespace puloon;
+
+static void print_usage(const char* program_name) {
+	std::fprintf(stderr, "usage: %s [--iterations N] [--transactions N] [--filter NAME] [--micro] [--end-to-end]\n", program_name);
+}
+
+int main(int argc, char* argv[]) {
+	bench::options bench_options;
+	bench_options.iterations = 1000000;
+	bench_options.transactions = 10000;
+	bool run_micro = false;
+	bool run_end_to_end = false;
+
+	for (int i = 1; i < argc; ++i) {
+		if (std::strcmp(argv[i], "--micro") == 0) {
+			run_micro = true;
+		} else if (std::strcmp(argv[i], "--end-to-end") == 0) {
+			run_end_to_end = true;
+		} else if ((i + 1 < argc) && (std::strcmp(argv[i], "--iterations") == 0)) {
+			bench_options.iterations = std::strtoull(argv[++i], nullptr, 10);
+		} else if ((i + 1 < argc) && (std::strcmp(argv[i], "--transactions") == 0)) {
+			bench_options.transactions = std::strtoull(argv[++i], nullptr, 10);
+		} else if ((i + 1 < argc) && (std::strcmp(argv[i], "--filter") == 0)) {
+			bench_options.filter = argv[++i];
+		} else {
+			print_usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	// all benchmarks are run by default
+	if (!run_micro && !run_end_to_end) {
+		run_micro = true;
+		run_end_to_end = true;
+	}
+
+	try {
+		if (run_micro) {
+			bench::run_micro_benchmarks(bench_options);
+		}
+		if (run_end_to_end) {
+			bench::run_end_to_end_benchmarks(bench_options);
+		}
+	} catch (const std::exception& error) {
+		std::fprintf(stderr, "%s\n", error.what());
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,89 @@
+#include "benchmark.h"
+#include <cstdio>
+#include "lcdm_frame.h"
+#include "lcdm_metrics_recorder.h"
+#include "lcdm_operations.h"
+
+using namespace puloon;
+using namespace puloon::detail;
+
+static void print_result(const char* name, double ns_per_call) {
+	std::printf("%-40s %12.1f ns/op\n", name, ns_per_call);
+}
+
+void puloon::bench::run_micro_benchmarks(const options& bench_options) {
+	const std::uint64_t iterations = bench_options.iterations;
+
+	if (std::string("build_command_frame").find(bench_options.filter) != std::string::npos) {
+		command_frame_buffer command_frame;
+		command up_low_command(command_code::up_low_dispense, command_descriptor<command_code::up_low_dispense>::result_data_size);
+		dispense_operation::write_bills_count(up_low_command, 42);
+		dispense_operation::write_bills_count(up_low_command, 17);
+
+		print_result("build_command_frame", measure_ns_per_call(iterations, [&]() {
+			do_not_optimize(build_command_frame(up_low_command, command_frame));
+			do_not_optimize(command_frame);
+		}));
+	}
+
+	if (std::string("get_bcc").find(bench_options.filter) != std::string::npos) {
+		std::array<std::uint8_t, max_response_frame_size> response_frame;
+		for (std::size_t i = 0; i < response_frame.size(); ++i) {
+			response_frame[i] = (std::uint8_t)(i * 31);
+		}
+
+		print_result("get_bcc", measure_ns_per_call(iterations, [&]() {
+			do_not_optimize(response_frame);
+			do_not_optimize(get_bcc(response_frame.data(), response_frame.data() + response_frame.size() - 1));
+		}));
+	}
+
+	if (std::string("read_bills_count").find(bench_options.filter) != std::string::npos) {
+		const std::uint8_t result_data[] = { 0x45, '4', '2', '4', '2', '0', '0', '0', '3' };
+		const data_view result_view(result_data, sizeof(result_data));
+
+		print_result("read_bills_count", measure_ns_per_call(iterations, [&]() {
+			do_not_optimize(result_view);
+			do_not_optimize(dispense_operation::read_bills_count(result_view, 3));
+		}));
+	}
+
+	if (std::string("write_bills_count").find(bench_options.filter) != std::string::npos) {
+		std::uint32_t bills_count = 0;
+
+		print_result("write_bills_count", measure_ns_per_call(iterations, [&]() {
+			command upper_command(command_code::upper_dispense, command_descriptor<command_code::upper_dispense>::result_data_size);
+			dispense_operation::write_bills_count(upper_command, ++bills_count % 100);
+			do_not_optimize(upper_command);
+		}));
+	}
+
+	if (std::string("metrics_recorder::record").find(bench_options.filter) != std::string::npos) {
+		metrics_recorder metrics;
+		std::chrono::steady_clock::duration latency(0);
+
+		print_result("metrics_recorder::record", measure_ns_per_call(iterations, [&]() {
+			command_counters& counters = metrics.get_counters((std::uint8_t)command_code::up_low_dispense);
+			metrics_recorder::increment(counters.responses);
+			counters.response_latency.record(latency += std::chrono::microseconds(1));
+		}));
+	}
+
+	if (std::string("dispense_operation::handle_result").find(bench_options.filter) != std::string::npos) {
+		// the operation is large enough
+		// to stay incomplete during the benchmark
+		lcdm::bill_counts requested_bills;
+		requested_bills[(lcdm::cassette_number)cassette::upper] = 0xffffffff;
+		requested_bills[(lcdm::cassette_number)cassette::lower] = 0xffffffff;
+		dispense_operation operation(device_profiles[lcdm::device_model::lcdm_2000], requested_bills, [](std::exception_ptr, lcdm::dispense_result) { });
+
+		const std::uint8_t result_data[] = {
+			0x56, '6', '0', '6', '0', '6', '0', '6', '0', '0', '0', '0', '0', '0', '0', '0'
+		};
+		const data_view result_view(result_data, sizeof(result_data));
+
+		print_result("dispense_operation::handle_result", measure_ns_per_call(iterations, [&]() {
+			operation.handle_result(result_view);
+		}));
+	}
+}
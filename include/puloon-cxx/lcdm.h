@@ -1,21 +1,133 @@
 #ifndef LCDM_H
 #define LCDM_H
 
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <functional>
 #include <future>
+#include <initializer_list>
 #include <map>
-#include <queue>
+#include <memory>
 #include <string>
 #include <thread>
+#include <type_traits>
+#include <utility>
 #include <vector>
 #include <boost/asio.hpp>
+#include "lcdm_metrics.h"
+#include "lcdm_transport.h"
+
+// awaitable operations need C++20 coroutines
+#if defined(__cpp_impl_coroutine) && defined(__has_include)
+#if __has_include(<coroutine>)
+#include <coroutine>
+#define PULOON_HAS_COROUTINES 1
+#endif
+#endif
 
 namespace puloon {
 
+	namespace detail {
+		class engine;
+		class planner_slot;
+	}
+
 	class lcdm {
 		public:
 			typedef std::uint8_t cassette_number;
 			typedef std::map<cassette_number, std::uint32_t> bill_quantity_by_cassette;
 
+			// bill counts indexed by cassette number;
+			// a trivially copyable small array that takes the place
+			// of bill_quantity_by_cassette in requests and results
+			// without allocations, maps convert to and from it;
+			// this breaks code that uses a result as a map:
+			// iteration yields counts instead of pairs
+			// and there is no find() or count(),
+			// such code converts the result to bill_quantity_by_cassette
+			// or indexes it by cassette number
+			class bill_counts {
+				public:
+					typedef const std::uint32_t* const_iterator;
+
+					// largest number of cassettes of the device family
+					static constexpr std::size_t capacity = 4;
+
+				public:
+					bill_counts() :
+						counts(),
+						cassette_count(0) {
+					}
+
+					// zero counts of the first cassettes
+					explicit bill_counts(std::size_t cassette_count);
+					// counts of the listed cassettes, initialized as a map;
+					// throw std::out_of_range if a cassette number
+					// is not below the capacity
+					bill_counts(std::initializer_list<bill_quantity_by_cassette::value_type> quantities);
+					bill_counts(const bill_quantity_by_cassette& quantities);
+
+					// map of the counted cassettes
+					operator bill_quantity_by_cassette() const;
+
+					// the counts grow to include the cassette like the entries of a map,
+					// throws std::out_of_range if the cassette number
+					// is not below the capacity
+					std::uint32_t& operator[](cassette_number cassette) {
+						if (cassette >= this->cassette_count) {
+							this->grow(cassette);
+						}
+
+						return this->counts[cassette];
+					}
+
+					// zero for cassettes that are not counted
+					std::uint32_t operator[](cassette_number cassette) const {
+						return (cassette < this->cassette_count) ? this->counts[cassette] : 0;
+					}
+
+					// throws std::out_of_range for cassettes that are not counted
+					std::uint32_t at(cassette_number cassette) const;
+
+					// number of counted cassettes
+					std::size_t size() const {
+						return this->cassette_count;
+					}
+
+					bool empty() const {
+						return (this->cassette_count == 0);
+					}
+
+					const_iterator begin() const {
+						return this->counts.data();
+					}
+
+					const_iterator end() const {
+						return this->counts.data() + this->cassette_count;
+					}
+
+				private:
+					void grow(cassette_number cassette);
+
+				private:
+					std::array<std::uint32_t, capacity> counts;
+					std::uint8_t cassette_count;
+			};
+
+			// dispenser models of the family
+			enum class device_model : std::uint8_t {
+				// upper and lower cassettes
+				lcdm_2000,
+				// four cassettes dispensed in a single cycle;
+				// experimental: the code (0x52) and the layout
+				// of the multi dispense command are extrapolated
+				// from the up/low dispense of LCDM-2000
+				// and are not checked against the LCDM-4000 manual
+				lcdm_4000
+			};
+
 			enum class operation_status : std::uint8_t {
 				good,
 				normal_stop,
@@ -28,90 +140,718 @@ namespace puloon {
 				timeout,
 				over_reject,
 				device_error,
-				connection_error
+				connection_error,
+				// the operation was not started or was stopped between rounds:
+				// the device was closed
+				// or the operation was cancelled through its handle
+				cancelled,
+				// the deadline of the operation passed before it was started
+				expired,
+				// the operation was not queued, the submission queue was full
+				queue_full
 			};
 
 			struct dispense_result {
-				bill_quantity_by_cassette dispensed_bills;
-				bill_quantity_by_cassette rejected_bills;
+				bill_counts dispensed_bills;
+				bill_counts rejected_bills;
 				operation_status status;
 			};
 
-		public:
-			lcdm(const std::string& port_name);
-			~lcdm();
+			// progress of a dispense that takes several rounds,
+			// a round dispenses up to 60 bills from each cassette
+			struct dispense_progress {
+				std::uint32_t completed_rounds;
+				// grows if the device dispenses fewer bills
+				// than requested in a round
+				std::uint32_t planned_rounds;
+				// bills dispensed and rejected so far
+				bill_counts dispensed_bills;
+				bill_counts rejected_bills;
+			};
 
-			std::future<operation_status> purge();
-			std::future<dispense_result> dispense(bill_quantity_by_cassette requested_bills);
-			//std::future<dispense_result> test_dispense(bill_quantity_by_cassette requested_bills);
-			//void get_rom_version();
+			// state of the device reported by the last status request;
+			// the sensor bits follow the status response of LCDM-2000
+			struct device_state {
+				// a status response has been received
+				bool is_known;
+				// the last status request has been answered
+				bool is_responding;
+				// time of the last status response
+				std::chrono::steady_clock::time_point update_time;
+				// status of the last command processed by the device
+				operation_status last_error;
+				// a bill is left in the exit path (sensor 0, bit 4)
+				bool bill_in_exit_path;
+				// fewer than about 50 bills are left (sensor 1, bits 0-1)
+				bool upper_cassette_near_end;
+				bool lower_cassette_near_end;
+				// sensor 1, bits 2-3
+				bool upper_cassette_present;
+				bool lower_cassette_present;
+				// sensor bytes of the status response
+				std::uint8_t sensor_0;
+				std::uint8_t sensor_1;
+			};
 
-		private:
-			typedef std::vector<std::uint8_t> frame;
+			// what the probe of open() found out about the device
+			struct device_capabilities {
+				// the device has answered a probe
+				bool is_known;
+				// version characters of the ROM version response,
+				// zero-terminated
+				std::array<char, 4> rom_version;
+				// state reported by the status request of the probe
+				device_state state;
+			};
 
-			enum class cassette : std::uint32_t {
-				upper = 0,
-				lower = 1
+			// cassettes for dispenses of an amount,
+			// indexed by cassette number;
+			// cassettes without a denomination are not used
+			struct cassette_inventory {
+				bill_counts denominations;
+				bill_counts bills;
+				// set by get_cassette_inventory after a dispense of an amount
+				// failed without a result of the device,
+				// its bills are kept out of the inventory
+				// until the cassettes are counted and the inventory is set again;
+				// ignored by set_cassette_inventory
+				bool needs_reconciliation = false;
 			};
 
-			enum class command_code : std::uint8_t {
-				unknown = 0x00,
-				purge = 0x44,
-				upper_dispense = 0x45,
-				status = 0x46,
-				rom_version = 0x47,
-				lower_dispense = 0x55,
-				up_low_dispense = 0x56,
-				upper_test_dispense = 0x76,
-				lower_test_dispense = 0x77
+			// state of a dispense when its journal was last written
+			enum class journaled_outcome : std::uint8_t {
+				in_progress,
+				// the dispense ended without a result of the device
+				// (an expired deadline, a lost connection, an unexpected response)
+				failed,
+				// the dispense ended with the counts of the device,
+				// its handler may not have been called yet
+				completed
 			};
 
-			struct command {
-				command(command_code code, const std::vector<std::uint8_t>& data, std::size_t response_data_size) :
-					code(code),
-					data(data),
-					response_data_size(response_data_size) {
+			// dispense recovered from its journal
+			struct journaled_dispense {
+				// identifier of the operation in its journal
+				std::uint64_t operation_id;
+				journaled_outcome outcome;
+				bill_counts requested_bills;
+				// counts of the last decoded result
+				bill_counts dispensed_bills;
+				bill_counts rejected_bills;
+				// a command was written after the last result,
+				// the bills of its round may have left the cassettes
+				bool command_pending;
+				// time of the last record of the dispense
+				std::chrono::system_clock::time_point update_time;
+			};
+
+			// cancels every operation submitted with a copy of the handle
+			// while it is queued or between the rounds of a dispense
+			class cancellation_handle {
+				public:
+					// a handle that is never cancelled
+					cancellation_handle() :
+						cancelled() {
+					}
+
+					// makes a handle that can be cancelled
+					static cancellation_handle create() {
+						cancellation_handle handle;
+						handle.cancelled = std::make_shared<std::atomic<bool>>(false);
+						return handle;
+					}
+
+					bool is_cancelled() const {
+						return (this->cancelled && this->cancelled->load(std::memory_order_acquire));
+					}
+
+				private:
+					friend class lcdm;
+
+					std::shared_ptr<std::atomic<bool>> cancelled;
+			};
+
+			// scheduling of a submitted operation
+			struct submit_options {
+				submit_options() :
+					priority(0),
+					deadline(std::chrono::steady_clock::time_point::max()),
+					cancellation() {
+				}
+
+				// queued operations with a higher priority are started first,
+				// operations of the same priority in submission order
+				std::int32_t priority;
+				// the operation is completed with operation_status::expired
+				// if it has not been started by this time
+				std::chrono::steady_clock::time_point deadline;
+				cancellation_handle cancellation;
+			};
+
+			// deadlines and retries of the command exchange;
+			// waiting ends as soon as the expected data arrives
+			struct timeouts {
+				timeouts() :
+					ack_timeout(default_ack_timeout),
+					response_timeout(default_response_timeout),
+					adaptive(true),
+					min_ack_timeout(default_min_ack_timeout),
+					max_ack_timeout(default_max_ack_timeout),
+					min_response_timeout(default_min_response_timeout),
+					max_response_timeout(default_max_response_timeout),
+					try_count(default_try_count),
+					probe_timeout(default_probe_timeout) {
+				}
+
+				// fixed deadlines
+				timeouts(std::chrono::milliseconds ack_timeout, std::chrono::milliseconds response_timeout) :
+					ack_timeout(ack_timeout),
+					response_timeout(response_timeout),
+					adaptive(false),
+					min_ack_timeout(default_min_ack_timeout),
+					max_ack_timeout(default_max_ack_timeout),
+					min_response_timeout(default_min_response_timeout),
+					max_response_timeout(default_max_response_timeout),
+					try_count(default_try_count),
+					probe_timeout(default_probe_timeout) {
+				}
+
+				// time to wait for ACK after a command is written
+				std::chrono::milliseconds ack_timeout;
+				// time to wait for a complete response frame after ACK,
+				// it covers the mechanical part of the command
+				std::chrono::milliseconds response_timeout;
+				// the timeouts above are used until the latencies
+				// of a command have been observed, then deadlines follow
+				// the smoothed latency plus four mean deviations
+				// of the command (of its number of bills for a response)
+				// within the bounds below;
+				// an expired deadline doubles the next one
+				// until a latency is observed again;
+				// the timeouts above are always used if adaptation is off
+				bool adaptive;
+				std::chrono::milliseconds min_ack_timeout;
+				std::chrono::milliseconds max_ack_timeout;
+				std::chrono::milliseconds min_response_timeout;
+				std::chrono::milliseconds max_response_timeout;
+				// writes of a command without ACK
+				// and requests of its response
+				int try_count;
+				// fixed deadline of ACK and of the response
+				// of the probe commands sent by open(),
+				// a device that answers a status request
+				// within it is present
+				std::chrono::milliseconds probe_timeout;
+
+				static constexpr std::chrono::milliseconds default_ack_timeout = std::chrono::milliseconds(700);
+				static constexpr std::chrono::milliseconds default_response_timeout = std::chrono::milliseconds(60000);
+				static constexpr std::chrono::milliseconds default_min_ack_timeout = std::chrono::milliseconds(50);
+				static constexpr std::chrono::milliseconds default_max_ack_timeout = std::chrono::milliseconds(3000);
+				static constexpr std::chrono::milliseconds default_min_response_timeout = std::chrono::milliseconds(1000);
+				static constexpr std::chrono::milliseconds default_max_response_timeout = std::chrono::milliseconds(120000);
+				static constexpr int default_try_count = 3;
+				static constexpr std::chrono::milliseconds default_probe_timeout = std::chrono::milliseconds(100);
+			};
+
+			// capture file that is played back
+			// in place of a serial port
+			struct replay_capture {
+				explicit replay_capture(const std::string& file_name) :
+					file_name(file_name) {
 				}
 
-				command_code code;
-				std::vector<std::uint8_t> data;
-				std::size_t response_data_size;
+				std::string file_name;
 			};
 
-			class operation;
-			class purge_operation;
-			class dispense_operation;
+			// completion handlers of the operations,
+			// the exception is set if the device returns an unexpected result
+			typedef std::function<void(std::exception_ptr, operation_status)> open_handler;
+			typedef std::function<void(std::exception_ptr, operation_status)> purge_handler;
+			typedef std::function<void(std::exception_ptr, dispense_result)> dispense_handler;
+			// progress handler of a dispense,
+			// invoked after every successful round through the executor
+			// of the completion handler, ahead of the completion handler
+			// if the executor is a strand or runs on a single thread
+			typedef std::function<void(const dispense_progress&)> dispense_progress_handler;
+
+		public:
+			// opens the serial port and processes operations
+			// on a handler thread owned by the device
+			lcdm(const std::string& port_name, const timeouts& port_timeouts = timeouts(), device_model model = device_model::lcdm_2000);
+			// opens the serial port and processes operations
+			// on the io_service of the caller,
+			// no thread is created
+			lcdm(boost::asio::io_service& io_service, const std::string& port_name, const timeouts& port_timeouts = timeouts(), device_model model = device_model::lcdm_2000);
+			// replays a capture as fast as the driver reads it;
+			// silence of the device in the capture lasts
+			// until the ack or response timeout expires
+			lcdm(const replay_capture& replay, const timeouts& port_timeouts = timeouts(), device_model model = device_model::lcdm_2000);
+			lcdm(boost::asio::io_service& io_service, const replay_capture& replay, const timeouts& port_timeouts = timeouts(), device_model model = device_model::lcdm_2000);
+			// processes operations over the transport made by the factory
+			// (a TCP bridge, an in-process pipe);
+			// throws std::runtime_error if the factory fails
+			// with boost::system::system_error
+			lcdm(const lcdm_transport_factory& make_transport, const timeouts& port_timeouts = timeouts(), device_model model = device_model::lcdm_2000);
+			lcdm(boost::asio::io_service& io_service, const lcdm_transport_factory& make_transport, const timeouts& port_timeouts = timeouts(), device_model model = device_model::lcdm_2000);
+			// closes the device, see close(),
+			// and waits for the stopped capture and journal to be written
+			~lcdm();
+
+			// probes the device with the ROM version and status requests
+			// under the probe timeout, ahead of the queued operations,
+			// and caches the capabilities it finds;
+			// completes with operation_status::good if the device answered,
+			// with operation_status::connection_error
+			// if the port is wrong or the device is not powered
+			std::future<operation_status> open();
+			template <typename CompletionToken>
+			BOOST_ASIO_INITFN_RESULT_TYPE(CompletionToken, void(std::exception_ptr, operation_status))
+			open(CompletionToken&& token);
+			// cancels the port I/O without waiting for the device:
+			// the operation in progress is completed
+			// with operation_status::connection_error,
+			// queued and later operations with operation_status::cancelled;
+			// can be called from any thread
+			void close();
+
+			// operations are queued for the handler thread
+			// in a submission queue of 64 operations
+			// and kept in a pool of 64 preallocated slots,
+			// operations beyond the slots are allocated on the heap;
+			// an operation submitted while the queue is full
+			// is completed with operation_status::queue_full
+			// through the handler thread, never inside the call;
+			// the queue is emptied whenever the handler thread
+			// is between two events of the port
+			std::future<operation_status> purge();
+			std::future<dispense_result> dispense(const bill_counts& requested_bills);
+			// dispenses any number of bills in rounds planned up front,
+			// the next round is started in the same write
+			// that acknowledges the result of the previous one
+			std::future<dispense_result> dispense_in_rounds(const bill_counts& requested_bills, dispense_progress_handler progress_handler);
+			//std::future<dispense_result> test_dispense(bill_quantity_by_cassette requested_bills);
+
+			// asynchronous variants accept any completion token
+			// (a callback, boost::asio::use_future, boost::asio::use_awaitable)
+			// with the signature void(std::exception_ptr, result),
+			// the handler is invoked through its associated executor
+			template <typename CompletionToken>
+			BOOST_ASIO_INITFN_RESULT_TYPE(CompletionToken, void(std::exception_ptr, operation_status))
+			purge(CompletionToken&& token);
+			template <typename CompletionToken>
+			BOOST_ASIO_INITFN_RESULT_TYPE(CompletionToken, void(std::exception_ptr, dispense_result))
+			dispense(const bill_counts& requested_bills, CompletionToken&& token);
+			template <typename CompletionToken>
+			BOOST_ASIO_INITFN_RESULT_TYPE(CompletionToken, void(std::exception_ptr, dispense_result))
+			dispense_in_rounds(const bill_counts& requested_bills, dispense_progress_handler progress_handler, CompletionToken&& token);
+
+			// variants with submission options,
+			// use boost::asio::use_future to get a future
+			template <typename CompletionToken>
+			BOOST_ASIO_INITFN_RESULT_TYPE(CompletionToken, void(std::exception_ptr, operation_status))
+			purge(const submit_options& options, CompletionToken&& token);
+			template <typename CompletionToken>
+			BOOST_ASIO_INITFN_RESULT_TYPE(CompletionToken, void(std::exception_ptr, dispense_result))
+			dispense(const submit_options& options, const bill_counts& requested_bills, CompletionToken&& token);
+			template <typename CompletionToken>
+			BOOST_ASIO_INITFN_RESULT_TYPE(CompletionToken, void(std::exception_ptr, dispense_result))
+			dispense_in_rounds(const submit_options& options, const bill_counts& requested_bills, dispense_progress_handler progress_handler, CompletionToken&& token);
+
+#if defined(PULOON_HAS_COROUTINES)
+			class purge_awaitable;
+			class dispense_awaitable;
+
+			// co_await submits the operation and resumes the coroutine
+			// on the thread of the driver that completes it,
+			// without a shared state or a blocked thread;
+			// the coroutine runs ahead of the next command
+			// until it is suspended again;
+			// the awaitable must be awaited once
+			// and the device must outlive the operation
+			purge_awaitable co_purge(const submit_options& options = submit_options());
+			dispense_awaitable co_dispense(const bill_counts& requested_bills, const submit_options& options = submit_options());
+#endif
+
+			// sets the denominations and bills of the cassettes
+			// and plans the mixes of common amounts up front;
+			// the bills of the dispenses in progress are taken
+			// out of the new inventory and their unused bills
+			// are returned to it;
+			// throws std::runtime_error if the device model has no such cassette
+			void set_cassette_inventory(const cassette_inventory& inventory);
+			// returns the denominations and the bills left
+			// after the dispenses of amounts
+			cassette_inventory get_cassette_inventory() const;
+			// dispenses an amount in the fewest rounds
+			// and with the fewest bills among those,
+			// the bills are taken from the inventory until the result
+			// returns the ones that did not leave the cassettes;
+			// throws std::runtime_error if the inventory is not set
+			// or the amount cannot be made from the bills left
+			std::future<dispense_result> dispense_amount(std::uint32_t amount);
+			template <typename CompletionToken>
+			BOOST_ASIO_INITFN_RESULT_TYPE(CompletionToken, void(std::exception_ptr, dispense_result))
+			dispense_amount(std::uint32_t amount, CompletionToken&& token);
+			template <typename CompletionToken>
+			BOOST_ASIO_INITFN_RESULT_TYPE(CompletionToken, void(std::exception_ptr, dispense_result))
+			dispense_amount(const submit_options& options, std::uint32_t amount, CompletionToken&& token);
+
+			// merges a queued dispense from a single cassette
+			// with a queued dispense from the other cassette
+			// into one up/low dispense command per round;
+			// each request gets the bills and the status
+			// of its own cassette, an error stops both;
+			// LCDM-4000 dispenses every request in a single cycle
+			// and does not merge requests
+			void set_dispense_coalescing(bool enabled);
+
+			// completes the queued operations of the handle
+			// with operation_status::cancelled without device traffic,
+			// a dispense in progress stops after the current round;
+			// can be called from any thread
+			void cancel(const cancellation_handle& handle);
+
+			// executor used for handlers
+			// without an associated executor
+			boost::asio::io_service::executor_type get_executor();
+
+			// returns counters and latencies of the command exchange
+			// without locks, can be called from any thread
+			lcdm_metrics get_metrics() const;
+
+			// returns the cached state of the device
+			// without locks or device traffic,
+			// can be called from any thread
+			device_state state() const;
+			// returns the capabilities found by the last successful probe
+			// without locks or device traffic,
+			// can be called from any thread
+			device_capabilities capabilities() const;
+			// requests the status of the device whenever no operation
+			// has been processed for the interval,
+			// operations submitted during a status request wait for it
+			void start_status_polling(std::chrono::milliseconds interval);
+			void stop_status_polling();
+
+			// records every byte written to and read from the device
+			// and every expired deadline into a capture file
+			// on a separate thread, replaces a running capture;
+			// throws std::runtime_error if the file cannot be created
+			void start_capture(const std::string& file_name);
+			// stops the capture, the remaining records are written
+			// on a separate thread once the device has processed the request,
+			// the file is complete when the device is destroyed at the latest
+			void stop_capture();
+
+			// records every dispense command before it is written
+			// and every decoded result into a memory-mapped journal
+			// that survives a crash of the process,
+			// records are written to the disk in batches
+			// on a separate thread; replaces a running journal
+			// and the contents of the file;
+			// throws std::runtime_error if the file cannot be created
+			void start_journal(const std::string& file_name);
+			// stops the journal, the remaining records are written
+			// on a separate thread once the device has processed the request,
+			// the file is complete when the device is destroyed at the latest
+			void stop_journal();
+			// returns the dispenses that were in progress
+			// when a journal was last written, the ones that failed
+			// without a result and the last 16 completed ones
+			// in the order they were started, to be reconciled
+			// before the journal is started again;
+			// a journal that does not exist has none,
+			// throws std::runtime_error if the file is not a journal
+			static std::vector<journaled_dispense> recover_journal(const std::string& file_name);
+
+		private:
+			struct initiate_open;
+			struct initiate_purge;
+			struct initiate_dispense;
+			struct initiate_amount_dispense;
 
 		private:
-			// main cycle that checks the operation queue
-			// and processes operations
-			// if the operation queue is not empty
+			// runs the handlers of the owned io_service
+			// until the device is destroyed
 			void operate();
-			// constructs a command frame
-			// from a command, command data
-			// and control characters
-			frame build_command_frame(const command_code& command, const std::vector<std::uint8_t>& command_data) const;
-			// calculates a block check character for a frame
-			std::uint8_t get_bcc(const frame& frame) const;
-			// adds bcc to a command frame
-			// and writes this data to the serial port
-			void write_command_to_serial_port(const frame& command_frame);
-			// reads data from the serial port,
-			// checks bcc and returns the response frame
-			// if bcc is correct
-			frame read_response_from_serial_port(std::size_t response_size);
+			// creates the protocol engine over a transport
+			// and starts the handler thread if the io_service is owned
+			void start(std::unique_ptr<lcdm_transport> transport, const timeouts& port_timeouts, device_model model);
+			// queues operations with type-erased handlers,
+			// handlers are invoked by the protocol engine
+			void start_open(open_handler handler);
+			void start_purge(const submit_options& options, purge_handler handler);
+			void start_dispense(const submit_options& options, const bill_counts& requested_bills, dispense_progress_handler progress_handler, dispense_handler handler);
+			void start_amount_dispense(const submit_options& options, std::uint32_t amount, dispense_handler handler);
+			// converts a completion handler into a copyable function
+			// that invokes the handler through its associated executor
+			template <typename Result, typename Handler>
+			std::function<void(std::exception_ptr, Result)> wrap_handler(Handler&& handler);
+			// makes a progress handler invoked through an executor,
+			// so a slow progress handler does not delay the next round
+			template <typename Executor>
+			dispense_progress_handler wrap_progress_handler(dispense_progress_handler progress_handler, const Executor& executor);
 
 		private:
+			std::unique_ptr<boost::asio::io_service> owned_io_service;
+			std::unique_ptr<boost::asio::io_service::work> owned_io_service_work;
+			boost::asio::io_service& io_service;
+			std::shared_ptr<detail::engine> engine;
+			// planner of the inventory set last,
+			// replaced by set_cassette_inventory
+			std::shared_ptr<detail::planner_slot> planner;
 			std::thread cmd_handler_thread;
-			bool thread_is_working;
-			std::queue<operation*> operation_queue;
-			std::mutex operation_queue_mutex;
-			boost::asio::io_service io_service;
-			boost::asio::serial_port serial_port;
+	};
+
+	struct lcdm::initiate_open {
+		lcdm* device;
+
+		template <typename Handler>
+		void operator()(Handler&& handler) const {
+			this->device->start_open(this->device->wrap_handler<operation_status>(std::forward<Handler>(handler)));
+		}
+	};
+
+	struct lcdm::initiate_purge {
+		lcdm* device;
+
+		template <typename Handler>
+		void operator()(Handler&& handler, const submit_options& options) const {
+			this->device->start_purge(options, this->device->wrap_handler<operation_status>(std::forward<Handler>(handler)));
+		}
+	};
+
+	struct lcdm::initiate_dispense {
+		lcdm* device;
+
+		template <typename Handler>
+		void operator()(Handler&& handler, const submit_options& options, const bill_counts& requested_bills, const dispense_progress_handler& progress_handler) const {
+			// progress is reported through the executor of the completion handler
+			dispense_progress_handler wrapped_progress_handler = this->device->wrap_progress_handler(progress_handler,
+				boost::asio::get_associated_executor(handler, this->device->get_executor()));
+			this->device->start_dispense(options, requested_bills, wrapped_progress_handler, this->device->wrap_handler<dispense_result>(std::forward<Handler>(handler)));
+		}
+	};
+
+	struct lcdm::initiate_amount_dispense {
+		lcdm* device;
+
+		template <typename Handler>
+		void operator()(Handler&& handler, const submit_options& options, std::uint32_t amount) const {
+			this->device->start_amount_dispense(options, amount, this->device->wrap_handler<dispense_result>(std::forward<Handler>(handler)));
+		}
+	};
+
+#if defined(PULOON_HAS_COROUTINES)
+	// the completion handler only points to the awaitable
+	// in the coroutine frame, so it is stored without an allocation;
+	// completion before the coroutine is suspended
+	// (a quick device, a full submission queue)
+	// continues without a suspension
+	class lcdm::purge_awaitable {
+		public:
+			bool await_ready() const noexcept {
+				return false;
+			}
+
+			bool await_suspend(std::coroutine_handle<> awaiting_coroutine) {
+				this->awaiting_coroutine = awaiting_coroutine;
+				this->device->start_purge(this->options, [this](std::exception_ptr error, operation_status status) {
+					this->error = error;
+					this->status = status;
+					if (this->completed.exchange(true, std::memory_order_acq_rel)) {
+						this->awaiting_coroutine.resume();
+					}
+				});
+
+				return !this->completed.exchange(true, std::memory_order_acq_rel);
+			}
+
+			operation_status await_resume() const {
+				if (this->error) {
+					std::rethrow_exception(this->error);
+				}
+
+				return this->status;
+			}
+
+		private:
+			friend class lcdm;
+
+			purge_awaitable(lcdm* device, const submit_options& options) :
+				device(device),
+				options(options),
+				awaiting_coroutine(),
+				error(),
+				status(),
+				completed(false) {
+			}
 
-			static const std::uint8_t control_characters_count = 4;
+		private:
+			lcdm* device;
+			submit_options options;
+			std::coroutine_handle<> awaiting_coroutine;
+			std::exception_ptr error;
+			operation_status status;
+			// set by the first of the completion and the suspension
+			std::atomic<bool> completed;
 	};
 
+	class lcdm::dispense_awaitable {
+		public:
+			bool await_ready() const noexcept {
+				return false;
+			}
+
+			// throws std::runtime_error for an invalid request
+			// without suspending the coroutine
+			bool await_suspend(std::coroutine_handle<> awaiting_coroutine) {
+				this->awaiting_coroutine = awaiting_coroutine;
+				this->device->start_dispense(this->options, this->requested_bills, dispense_progress_handler(), [this](std::exception_ptr error, dispense_result result) {
+					this->error = error;
+					this->result = result;
+					if (this->completed.exchange(true, std::memory_order_acq_rel)) {
+						this->awaiting_coroutine.resume();
+					}
+				});
+
+				return !this->completed.exchange(true, std::memory_order_acq_rel);
+			}
+
+			dispense_result await_resume() const {
+				if (this->error) {
+					std::rethrow_exception(this->error);
+				}
+
+				return this->result;
+			}
+
+		private:
+			friend class lcdm;
+
+			dispense_awaitable(lcdm* device, const bill_counts& requested_bills, const submit_options& options) :
+				device(device),
+				requested_bills(requested_bills),
+				options(options),
+				awaiting_coroutine(),
+				error(),
+				result(),
+				completed(false) {
+			}
+
+		private:
+			lcdm* device;
+			bill_counts requested_bills;
+			submit_options options;
+			std::coroutine_handle<> awaiting_coroutine;
+			std::exception_ptr error;
+			dispense_result result;
+			// set by the first of the completion and the suspension
+			std::atomic<bool> completed;
+	};
+
+	inline lcdm::purge_awaitable lcdm::co_purge(const submit_options& options) {
+		return purge_awaitable(this, options);
+	}
+
+	inline lcdm::dispense_awaitable lcdm::co_dispense(const bill_counts& requested_bills, const submit_options& options) {
+		return dispense_awaitable(this, requested_bills, options);
+	}
+#endif
+
+	template <typename CompletionToken>
+	BOOST_ASIO_INITFN_RESULT_TYPE(CompletionToken, void(std::exception_ptr, lcdm::operation_status))
+	lcdm::open(CompletionToken&& token) {
+		return boost::asio::async_initiate<CompletionToken, void(std::exception_ptr, operation_status)>(
+			initiate_open{ this }, token);
+	}
+
+	template <typename CompletionToken>
+	BOOST_ASIO_INITFN_RESULT_TYPE(CompletionToken, void(std::exception_ptr, lcdm::operation_status))
+	lcdm::purge(CompletionToken&& token) {
+		return boost::asio::async_initiate<CompletionToken, void(std::exception_ptr, operation_status)>(
+			initiate_purge{ this }, token, submit_options());
+	}
+
+	template <typename CompletionToken>
+	BOOST_ASIO_INITFN_RESULT_TYPE(CompletionToken, void(std::exception_ptr, lcdm::dispense_result))
+	lcdm::dispense(const bill_counts& requested_bills, CompletionToken&& token) {
+		return boost::asio::async_initiate<CompletionToken, void(std::exception_ptr, dispense_result)>(
+			initiate_dispense{ this }, token, submit_options(), requested_bills, dispense_progress_handler());
+	}
+
+	template <typename CompletionToken>
+	BOOST_ASIO_INITFN_RESULT_TYPE(CompletionToken, void(std::exception_ptr, lcdm::dispense_result))
+	lcdm::dispense_in_rounds(const bill_counts& requested_bills, dispense_progress_handler progress_handler, CompletionToken&& token) {
+		return boost::asio::async_initiate<CompletionToken, void(std::exception_ptr, dispense_result)>(
+			initiate_dispense{ this }, token, submit_options(), requested_bills, progress_handler);
+	}
+
+	template <typename CompletionToken>
+	BOOST_ASIO_INITFN_RESULT_TYPE(CompletionToken, void(std::exception_ptr, lcdm::operation_status))
+	lcdm::purge(const submit_options& options, CompletionToken&& token) {
+		return boost::asio::async_initiate<CompletionToken, void(std::exception_ptr, operation_status)>(
+			initiate_purge{ this }, token, options);
+	}
+
+	template <typename CompletionToken>
+	BOOST_ASIO_INITFN_RESULT_TYPE(CompletionToken, void(std::exception_ptr, lcdm::dispense_result))
+	lcdm::dispense(const submit_options& options, const bill_counts& requested_bills, CompletionToken&& token) {
+		return boost::asio::async_initiate<CompletionToken, void(std::exception_ptr, dispense_result)>(
+			initiate_dispense{ this }, token, options, requested_bills, dispense_progress_handler());
+	}
+
+	template <typename CompletionToken>
+	BOOST_ASIO_INITFN_RESULT_TYPE(CompletionToken, void(std::exception_ptr, lcdm::dispense_result))
+	lcdm::dispense_in_rounds(const submit_options& options, const bill_counts& requested_bills, dispense_progress_handler progress_handler, CompletionToken&& token) {
+		return boost::asio::async_initiate<CompletionToken, void(std::exception_ptr, dispense_result)>(
+			initiate_dispense{ this }, token, options, requested_bills, progress_handler);
+	}
+
+	template <typename CompletionToken>
+	BOOST_ASIO_INITFN_RESULT_TYPE(CompletionToken, void(std::exception_ptr, lcdm::dispense_result))
+	lcdm::dispense_amount(std::uint32_t amount, CompletionToken&& token) {
+		return boost::asio::async_initiate<CompletionToken, void(std::exception_ptr, dispense_result)>(
+			initiate_amount_dispense{ this }, token, submit_options(), amount);
+	}
+
+	template <typename CompletionToken>
+	BOOST_ASIO_INITFN_RESULT_TYPE(CompletionToken, void(std::exception_ptr, lcdm::dispense_result))
+	lcdm::dispense_amount(const submit_options& options, std::uint32_t amount, CompletionToken&& token) {
+		return boost::asio::async_initiate<CompletionToken, void(std::exception_ptr, dispense_result)>(
+			initiate_amount_dispense{ this }, token, options, amount);
+	}
+
+	template <typename Result, typename Handler>
+	std::function<void(std::exception_ptr, Result)> lcdm::wrap_handler(Handler&& handler) {
+		typedef typename std::decay<Handler>::type handler_type;
+
+		// std::function requires a copyable target,
+		// so move-only handlers are shared between copies
+		std::shared_ptr<handler_type> shared_handler = std::make_shared<handler_type>(std::forward<Handler>(handler));
+		auto handler_work = boost::asio::make_work_guard(
+			boost::asio::get_associated_executor(*shared_handler, this->get_executor()));
+
+		return [shared_handler, handler_work](std::exception_ptr error, Result result) {
+			boost::asio::post(handler_work.get_executor(), [shared_handler, error, result]() {
+				std::move(*shared_handler)(error, result);
+			});
+		};
+	}
+
+	template <typename Executor>
+	lcdm::dispense_progress_handler lcdm::wrap_progress_handler(dispense_progress_handler progress_handler, const Executor& executor) {
+		if (!progress_handler) {
+			return progress_handler;
+		}
+
+		return [progress_handler, executor](const dispense_progress& progress) {
+			boost::asio::post(executor, [progress_handler, progress]() {
+				progress_handler(progress);
+			});
+		};
+	}
+
 }
 
 #endif // LCDM_H
@@ -0,0 +1,74 @@
+#ifndef LCDM_CONTROLLER_H
+#define LCDM_CONTROLLER_H
+
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <boost/asio.hpp>
+#include "lcdm.h"
+
+namespace puloon {
+
+	// serves many dispensers with one io_service
+	// and a small pool of handler threads;
+	// serial ports are multiplexed by the reactor of the io_service
+	// (epoll on linux, I/O completion ports on windows),
+	// every device processes its operations in order on its own strand,
+	// and an error of one device does not stop the others
+	class lcdm_controller {
+		public:
+			// receives an exception thrown by a completion handler
+			typedef std::function<void(std::exception_ptr)> error_handler;
+
+		public:
+			lcdm_controller(std::size_t thread_count = 1);
+			~lcdm_controller();
+
+			lcdm_controller(const lcdm_controller&) = delete;
+			lcdm_controller& operator=(const lcdm_controller&) = delete;
+
+			// opens a device on the shared io_service,
+			// the device is valid until it is removed
+			// or the controller is destroyed
+			lcdm& add_device(const std::string& port_name, const lcdm::timeouts& port_timeouts = lcdm::timeouts(), lcdm::device_model model = lcdm::device_model::lcdm_2000);
+			// opens a device over the transport made by the factory
+			lcdm& add_device(const lcdm_transport_factory& make_transport, const lcdm::timeouts& port_timeouts = lcdm::timeouts(), lcdm::device_model model = lcdm::device_model::lcdm_2000);
+			// closes a device and completes
+			// its pending operations with an error
+			void remove_device(const lcdm& device);
+			std::size_t get_device_count() const;
+
+			boost::asio::io_service& get_io_service();
+
+			// the handler threads keep running the handlers of all devices
+			// after an exception thrown by a completion handler,
+			// which is passed to the error handler;
+			// without an error handler the exception leaves the handler thread
+			// like an exception thrown out of io_service::run(),
+			// which terminates the process
+			void set_error_handler(error_handler handler);
+
+		private:
+			// runs the handlers of all devices
+			// until the controller is destroyed
+			void operate();
+			// keeps a new device until it is removed
+			lcdm& insert_device(std::unique_ptr<lcdm> new_device);
+
+		private:
+			boost::asio::io_service io_service;
+			std::unique_ptr<boost::asio::io_service::work> io_service_work;
+			std::vector<std::unique_ptr<lcdm>> devices;
+			mutable std::mutex devices_mutex;
+			error_handler handler_error_handler;
+			std::mutex error_handler_mutex;
+			std::vector<std::thread> handler_threads;
+	};
+
+}
+
+#endif // LCDM_CONTROLLER_H
@@ -0,0 +1,80 @@
+#ifndef LCDM_METRICS_H
+#define LCDM_METRICS_H
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <map>
+
+namespace puloon {
+
+	// latency histogram with power-of-two buckets:
+	// bucket 0 counts latencies below 1 us,
+	// bucket i counts latencies from 2^(i - 1) us to 2^i us,
+	// the last bucket counts everything longer
+	struct latency_histogram {
+		static const std::size_t bucket_count = 32;
+
+		latency_histogram();
+
+		// returns the upper bound of the bucket
+		// below which the given fraction of samples lies
+		std::chrono::microseconds get_percentile(double fraction) const;
+		std::chrono::microseconds get_mean() const;
+
+		std::array<std::uint64_t, bucket_count> buckets;
+		std::uint64_t sample_count;
+		// sum of all samples
+		std::chrono::microseconds total_time;
+	};
+
+	// counters and latencies of one command code
+	struct command_metrics {
+		command_metrics();
+
+		// command frames built and written
+		std::uint64_t commands;
+		// responses with correct frames
+		std::uint64_t responses;
+		// commands that failed after all retries
+		// or because the port was closed
+		std::uint64_t failed_commands;
+		// commands written again after NAK or a missing ACK
+		std::uint64_t command_retries;
+		// NAK received for a command
+		std::uint64_t received_naks;
+		// no ACK for a command within the ack timeout
+		std::uint64_t acknowledge_timeouts;
+		// NAK sent to request a response again
+		std::uint64_t sent_naks;
+		// no complete response within the response timeout
+		std::uint64_t response_timeouts;
+		// response frames with incorrect ETX or bcc
+		std::uint64_t corrupted_responses;
+		// response data that the operation could not interpret
+		std::uint64_t format_errors;
+
+		// time from the submission of an operation
+		// to the start of its first command
+		latency_histogram queue_wait;
+		// time from the start of a command write to ACK
+		latency_histogram acknowledge_latency;
+		// time from ACK to a correct response frame
+		latency_histogram response_latency;
+
+		// number of responses by the error code of the device
+		std::array<std::uint64_t, 256> status_codes;
+	};
+
+	// snapshot of the metrics of a device;
+	// counters are read one by one without locks,
+	// so a snapshot taken during a command
+	// may be ahead of itself by that command
+	struct lcdm_metrics {
+		// metrics of the command codes that have been used
+		std::map<std::uint8_t, command_metrics> commands;
+	};
+
+}
+
+#endif // LCDM_METRICS_H
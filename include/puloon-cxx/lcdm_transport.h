@@ -0,0 +1,135 @@
+#ifndef LCDM_TRANSPORT_H
+#define LCDM_TRANSPORT_H
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+#include <boost/asio.hpp>
+
+namespace puloon {
+
+	// byte stream between the protocol engine and a device;
+	// the engine keeps at most one read and one write in progress
+	// on its own frame buffers, which stay valid until the handler
+	// is invoked, so a transport moves the bytes between them
+	// and the device without buffers of its own;
+	// handlers are invoked through the io_service of the transport,
+	// never from inside the call that starts the operation
+	class lcdm_transport {
+		public:
+			typedef std::function<void(const boost::system::error_code&, std::size_t)> io_handler;
+			// data of a write, unused buffers are empty
+			typedef std::array<boost::asio::const_buffer, 2> write_buffers;
+
+		public:
+			virtual ~lcdm_transport() = default;
+
+			lcdm_transport(const lcdm_transport&) = delete;
+			lcdm_transport& operator=(const lcdm_transport&) = delete;
+
+			// writes all bytes of the buffers
+			virtual void async_write(const write_buffers& buffers, io_handler handler) = 0;
+			// reads at least one byte
+			virtual void async_read_some(const boost::asio::mutable_buffer& buffer, io_handler handler) = 0;
+			// completes the pending read
+			// with boost::asio::error::operation_aborted
+			virtual void cancel() = 0;
+			// cancels pending operations and releases the device
+			virtual void close() = 0;
+
+		protected:
+			lcdm_transport() = default;
+	};
+
+	// creates the transport of a device on the io_service
+	// that runs the protocol engine of the device
+	typedef std::function<std::unique_ptr<lcdm_transport>(boost::asio::io_service&)> lcdm_transport_factory;
+
+	// serial port (9600 8N1, no flow control)
+	class serial_transport : public lcdm_transport {
+		public:
+			// throws boost::system::system_error
+			// if the port cannot be opened or configured
+			serial_transport(boost::asio::io_service& io_service, const std::string& port_name);
+			virtual ~serial_transport() override = default;
+
+			virtual void async_write(const write_buffers& buffers, io_handler handler) override;
+			virtual void async_read_some(const boost::asio::mutable_buffer& buffer, io_handler handler) override;
+			virtual void cancel() override;
+			virtual void close() override;
+
+		private:
+			boost::asio::serial_port serial_port;
+	};
+
+	// raw TCP connection to a serial-to-Ethernet bridge
+	// whose serial side is set to 9600 8N1,
+	// the bytes pass the bridge unchanged in both directions
+	class tcp_transport : public lcdm_transport {
+		public:
+			// connects to the first address of the host that accepts
+			// within the timeout, which also covers the resolution
+			// of the host (a lookup in progress ends only
+			// with the timeouts of the system resolver);
+			// throws boost::system::system_error
+			// if the host is not resolved or no address accepts,
+			// with boost::asio::error::timed_out if the timeout expires
+			tcp_transport(boost::asio::io_service& io_service, const std::string& host, const std::string& service,
+				std::chrono::milliseconds connect_timeout = default_connect_timeout);
+			virtual ~tcp_transport() override = default;
+
+			virtual void async_write(const write_buffers& buffers, io_handler handler) override;
+			virtual void async_read_some(const boost::asio::mutable_buffer& buffer, io_handler handler) override;
+			virtual void cancel() override;
+			virtual void close() override;
+
+			static constexpr std::chrono::milliseconds default_connect_timeout = std::chrono::milliseconds(5000);
+
+		private:
+			boost::asio::ip::tcp::socket socket;
+	};
+
+	// end of an in-process pipe;
+	// a write is copied straight into the buffer of the pending read
+	// of the other end, and is held in a small buffer of the pipe
+	// only while the other end is not reading;
+	// the ends can be used from different threads
+	class pipe_transport : public lcdm_transport {
+		public:
+			// creates both ends of a pipe,
+			// each end invokes its handlers through its own io_service
+			static std::pair<std::unique_ptr<pipe_transport>, std::unique_ptr<pipe_transport>> create_pair(
+				boost::asio::io_service& first_io_service, boost::asio::io_service& second_io_service);
+			// closes the end
+			virtual ~pipe_transport() override;
+
+			// a write to a closed end completes
+			// with boost::asio::error::broken_pipe
+			virtual void async_write(const write_buffers& buffers, io_handler handler) override;
+			// a read completes with boost::asio::error::eof
+			// once the other end is closed and its data is read
+			virtual void async_read_some(const boost::asio::mutable_buffer& buffer, io_handler handler) override;
+			// the pending write stays in progress
+			virtual void cancel() override;
+			virtual void close() override;
+
+		private:
+			struct channel;
+
+		private:
+			pipe_transport(std::shared_ptr<channel> shared_channel, std::size_t side);
+
+		private:
+			// shared by both ends
+			std::shared_ptr<channel> shared_channel;
+			// index of the end in the channel
+			std::size_t side;
+	};
+
+}
+
+#endif // LCDM_TRANSPORT_H
@@ -1,177 +1,353 @@
 #include "lcdm.h"
-#include <exception>
+#include <stdexcept>
+#include "lcdm_capture.h"
+#include "lcdm_engine.h"
+#include "lcdm_journal.h"
 #include "lcdm_operations.h"
+#include "lcdm_planner.h"
+#include "lcdm_replay_transport.h"
 
-using namespace boost::asio;
 using namespace puloon;
+using namespace puloon::detail;
+
+constexpr std::chrono::milliseconds lcdm::timeouts::default_ack_timeout;
+constexpr std::chrono::milliseconds lcdm::timeouts::default_response_timeout;
+constexpr std::chrono::milliseconds lcdm::timeouts::default_min_ack_timeout;
+constexpr std::chrono::milliseconds lcdm::timeouts::default_max_ack_timeout;
+constexpr std::chrono::milliseconds lcdm::timeouts::default_min_response_timeout;
+constexpr std::chrono::milliseconds lcdm::timeouts::default_max_response_timeout;
+constexpr int lcdm::timeouts::default_try_count;
+constexpr std::chrono::milliseconds lcdm::timeouts::default_probe_timeout;
+constexpr std::size_t lcdm::bill_counts::capacity;
+
+static_assert(std::is_trivially_copyable<lcdm::bill_counts>::value, "bill counts are copied without allocations");
+static_assert(std::is_trivially_copyable<lcdm::dispense_result>::value, "dispense results are copied without allocations");
+
+// creates a handler that passes
+// the result of an operation to a promise
+template <typename Result>
+static std::function<void(std::exception_ptr, Result)> make_promise_handler(const std::shared_ptr<std::promise<Result>>& result) {
+	return [result](std::exception_ptr error, Result value) {
+		if (error) {
+			result->set_exception(error);
+		} else {
+			result->set_value(value);
+		}
+	};
+}
+
+// creates the transport of a device,
+// errors of the transport are reported as std::runtime_error
+static std::unique_ptr<lcdm_transport> create_transport(boost::asio::io_service& io_service, const lcdm_transport_factory& make_transport) {
+	std::unique_ptr<lcdm_transport> transport;
 
-// serial port parameters
-const serial_port::baud_rate baud_rate(9600);
-const serial_port::character_size char_size(8);
-const serial_port::parity parity(serial_port::parity::none);
-const serial_port::stop_bits stop_bits(serial_port::stop_bits::one);
-const serial_port::flow_control flow_ctrl(serial_port::flow_control::none);
-
-// start of heading
-const unsigned char soh = 0x01;
-// end of transmission
-const unsigned char eot = 0x04;
-// id
-const unsigned char id = 0x50;
-// start of text
-const unsigned char stx = 0x02;
-// end of text
-const unsigned char etx = 0x03;
-// acknowledge
-const unsigned char ack = 0x06;
-// negative acknowledge
-const unsigned char nak = 0x15;
-
-lcdm::lcdm(const std::string& port_name) :
-	cmd_handler_thread(),
-	thread_is_working(false),
-	operation_queue(),
-	operation_queue_mutex(),
-	io_service(),
-	serial_port(io_service, port_name) {
 	try {
-		this->serial_port.set_option(baud_rate);
-		this->serial_port.set_option(char_size);
-		this->serial_port.set_option(parity);
-		this->serial_port.set_option(stop_bits);
-		this->serial_port.set_option(flow_ctrl);
-
-		this->thread_is_working = true;
-		this->cmd_handler_thread = std::thread(&lcdm::operate, this);
+		transport = make_transport(io_service);
 	} catch (boost::system::system_error) {
-		throw std::exception("serial port error");
-	} catch (std::system_error) {
-		throw std::exception("unable to create handler thread");
+		throw std::runtime_error("transport error");
 	}
-}
 
-lcdm::~lcdm() {
-	this->thread_is_working = false;
-	this->cmd_handler_thread.join();
+	if (!transport) {
+		throw std::runtime_error("transport error");
+	}
+
+	return transport;
 }
 
-std::future<lcdm::operation_status> lcdm::purge() {
-	purge_operation* new_operation = new purge_operation();
+lcdm::bill_counts::bill_counts(std::size_t cassette_count) :
+	counts(),
+	cassette_count(0) {
+	if (cassette_count > capacity) {
+		throw std::out_of_range("invalid cassette number");
+	}
 
-	this->operation_queue_mutex.lock();
-	this->operation_queue.push(new_operation);
-	this->operation_queue_mutex.unlock();
+	this->cassette_count = (std::uint8_t)cassette_count;
+}
 
-	return new_operation->get_future_result();
+lcdm::bill_counts::bill_counts(std::initializer_list<bill_quantity_by_cassette::value_type> quantities) :
+	counts(),
+	cassette_count(0) {
+	for (const bill_quantity_by_cassette::value_type& quantity : quantities) {
+		(*this)[quantity.first] = quantity.second;
+	}
 }
 
-std::future<lcdm::dispense_result> lcdm::dispense(bill_quantity_by_cassette requested_bills) {
-	dispense_operation* new_operation = new dispense_operation(requested_bills);
+lcdm::bill_counts::bill_counts(const bill_quantity_by_cassette& quantities) :
+	counts(),
+	cassette_count(0) {
+	for (const bill_quantity_by_cassette::value_type& quantity : quantities) {
+		(*this)[quantity.first] = quantity.second;
+	}
+}
 
-	this->operation_queue_mutex.lock();
-	this->operation_queue.push(new_operation);
-	this->operation_queue_mutex.unlock();
+lcdm::bill_counts::operator bill_quantity_by_cassette() const {
+	bill_quantity_by_cassette quantities;
 
-	return new_operation->get_future_result();
+	for (std::size_t i = 0; i < this->cassette_count; ++i) {
+		quantities[(cassette_number)i] = this->counts[i];
+	}
+
+	return quantities;
 }
 
-void lcdm::operate() {
-	while (this->thread_is_working) {
-		this->operation_queue_mutex.lock();
-
-		if (!this->operation_queue.empty()) {
-			operation* current_operation = this->operation_queue.front();
-			this->operation_queue.pop();
-			this->operation_queue_mutex.unlock();
-
-			while (!current_operation->is_completed()) {
-				command current_command = current_operation->get_command();
-				frame current_frame = this->build_command_frame(current_command.code, current_command.data);
-				std::size_t current_response_size = current_command.response_data_size + control_characters_count;
-
-				try {
-					this->write_command_to_serial_port(current_frame);
-					frame current_response = this->read_response_from_serial_port(current_response_size);
-
-					if ((current_response[0] != soh)
-						|| (current_response[1] != id)
-						|| (current_response[2] != stx)
-						|| (current_response[current_response_size - 1] != etx)) {
-						throw std::exception("incorrect frame format");
-					}
-				
-					current_operation->handle_result(std::vector<std::uint8_t>(current_response.begin() + 3, current_response.end() - 1));
-				} catch (std::exception) {
-					current_operation->set_error();
-				}
-			}
-
-			delete current_operation;
-		} else {
-			this->operation_queue_mutex.unlock();
-			std::this_thread::sleep_for(std::chrono::milliseconds(200));
-		}
+std::uint32_t lcdm::bill_counts::at(cassette_number cassette) const {
+	if (cassette >= this->cassette_count) {
+		throw std::out_of_range("cassette is not counted");
 	}
+
+	return this->counts[cassette];
 }
 
-lcdm::frame lcdm::build_command_frame(const command_code& command, const std::vector<std::uint8_t>& command_data) const {
-	frame command_frame(command_data);
-	command_frame.insert(command_frame.begin(), (std::uint8_t)command);
-	command_frame.insert(command_frame.begin(), { eot, id, stx });
-	command_frame.push_back(etx);
-	return command_frame;
+void lcdm::bill_counts::grow(cassette_number cassette) {
+	if (cassette >= capacity) {
+		throw std::out_of_range("invalid cassette number");
+	}
+
+	this->cassette_count = (std::uint8_t)(cassette + 1);
 }
 
-std::uint8_t lcdm::get_bcc(const frame& frame) const {
-	std::uint8_t bcc = 0;
-	for (std::size_t i = 0; i < frame.size(); ++i) {
-		bcc ^= frame[i];
+lcdm::lcdm(const std::string& port_name, const timeouts& port_timeouts, device_model model) :
+	owned_io_service(new boost::asio::io_service()),
+	owned_io_service_work(new boost::asio::io_service::work(*owned_io_service)),
+	io_service(*owned_io_service),
+	engine(),
+	planner(std::make_shared<detail::planner_slot>()),
+	cmd_handler_thread() {
+	std::unique_ptr<lcdm_transport> transport;
+
+	try {
+		transport.reset(new serial_transport(this->io_service, port_name));
+	} catch (boost::system::system_error) {
+		throw std::runtime_error("serial port error");
 	}
-	return bcc;
+
+	this->start(std::move(transport), port_timeouts, model);
 }
 
-void lcdm::write_command_to_serial_port(const frame& command_frame) {
-	std::uint8_t acknowledge_status(0);
-	
-	std::vector<std::uint8_t> frame_with_trailer(command_frame);
-	frame_with_trailer.push_back(this->get_bcc(command_frame));
+lcdm::lcdm(boost::asio::io_service& io_service, const std::string& port_name, const timeouts& port_timeouts, device_model model) :
+	owned_io_service(),
+	owned_io_service_work(),
+	io_service(io_service),
+	engine(),
+	planner(std::make_shared<detail::planner_slot>()),
+	cmd_handler_thread() {
+	std::unique_ptr<lcdm_transport> transport;
 
 	try {
-		for (int try_count = 3; (acknowledge_status != ack) && (try_count > 0); --try_count) {
-			write(this->serial_port, buffer(frame_with_trailer));
-			std::this_thread::sleep_for(std::chrono::milliseconds(700));
-			read(this->serial_port, buffer(&acknowledge_status, 1));
-		}
+		transport.reset(new serial_transport(this->io_service, port_name));
 	} catch (boost::system::system_error) {
-		throw std::exception("failed to write command to serial port");
+		throw std::runtime_error("serial port error");
 	}
 
-	if (acknowledge_status != ack) {
-		throw std::exception("failed to write command to serial port");
+	this->start(std::move(transport), port_timeouts, model);
+}
+
+lcdm::lcdm(const replay_capture& replay, const timeouts& port_timeouts, device_model model) :
+	owned_io_service(new boost::asio::io_service()),
+	owned_io_service_work(new boost::asio::io_service::work(*owned_io_service)),
+	io_service(*owned_io_service),
+	engine(),
+	planner(std::make_shared<detail::planner_slot>()),
+	cmd_handler_thread() {
+	this->start(std::unique_ptr<lcdm_transport>(new replay_transport(this->io_service, read_capture_file(replay.file_name))), port_timeouts, model);
+}
+
+lcdm::lcdm(boost::asio::io_service& io_service, const replay_capture& replay, const timeouts& port_timeouts, device_model model) :
+	owned_io_service(),
+	owned_io_service_work(),
+	io_service(io_service),
+	engine(),
+	planner(std::make_shared<detail::planner_slot>()),
+	cmd_handler_thread() {
+	this->start(std::unique_ptr<lcdm_transport>(new replay_transport(this->io_service, read_capture_file(replay.file_name))), port_timeouts, model);
+}
+
+lcdm::lcdm(const lcdm_transport_factory& make_transport, const timeouts& port_timeouts, device_model model) :
+	owned_io_service(new boost::asio::io_service()),
+	owned_io_service_work(new boost::asio::io_service::work(*owned_io_service)),
+	io_service(*owned_io_service),
+	engine(),
+	planner(std::make_shared<detail::planner_slot>()),
+	cmd_handler_thread() {
+	this->start(create_transport(this->io_service, make_transport), port_timeouts, model);
+}
+
+lcdm::lcdm(boost::asio::io_service& io_service, const lcdm_transport_factory& make_transport, const timeouts& port_timeouts, device_model model) :
+	owned_io_service(),
+	owned_io_service_work(),
+	io_service(io_service),
+	engine(),
+	planner(std::make_shared<detail::planner_slot>()),
+	cmd_handler_thread() {
+	this->start(create_transport(this->io_service, make_transport), port_timeouts, model);
+}
+
+lcdm::~lcdm() {
+	this->close();
+
+	if (this->cmd_handler_thread.joinable()) {
+		// the handler thread exits as soon as
+		// the handlers of the closed port are completed
+		this->owned_io_service_work.reset();
+		this->cmd_handler_thread.join();
 	}
+
+	// the capture file is complete when the device is gone
+	this->engine->wait_for_detached_destructions();
 }
 
-lcdm::frame lcdm::read_response_from_serial_port(std::size_t response_size) {
-	std::vector<std::uint8_t> response_frame_with_trailer(response_size + 1);
+std::future<lcdm::operation_status> lcdm::open() {
+	std::shared_ptr<std::promise<operation_status>> result = std::make_shared<std::promise<operation_status>>();
+	std::future<operation_status> future_result = result->get_future();
+	this->start_open(make_promise_handler(result));
+	return future_result;
+}
 
-	try {
-		for (int try_count = 3; (try_count > 0); --try_count) {
-			if ((read(this->serial_port, buffer(response_frame_with_trailer, response_size + 1)) != (response_size + 1))
-				|| (response_frame_with_trailer.size() != (response_size + 1))) {
-				write(this->serial_port, buffer(&nak, 1));
-			} else {
-				frame response_frame(response_frame_with_trailer.begin(), response_frame_with_trailer.end() - 1);
-				// check bcc
-				if (response_frame_with_trailer.back() == this->get_bcc(response_frame)) {
-					write(this->serial_port, buffer(&ack, 1));
-					return response_frame;
-				} else {
-					write(this->serial_port, buffer(&nak, 1));
-				}
-			}
+void lcdm::close() {
+	this->engine->close();
+}
+
+std::future<lcdm::operation_status> lcdm::purge() {
+	std::shared_ptr<std::promise<operation_status>> result = std::make_shared<std::promise<operation_status>>();
+	std::future<operation_status> future_result = result->get_future();
+	this->start_purge(submit_options(), make_promise_handler(result));
+	return future_result;
+}
+
+std::future<lcdm::dispense_result> lcdm::dispense(const bill_counts& requested_bills) {
+	std::shared_ptr<std::promise<dispense_result>> result = std::make_shared<std::promise<dispense_result>>();
+	std::future<dispense_result> future_result = result->get_future();
+	this->start_dispense(submit_options(), requested_bills, dispense_progress_handler(), make_promise_handler(result));
+	return future_result;
+}
+
+std::future<lcdm::dispense_result> lcdm::dispense_in_rounds(const bill_counts& requested_bills, dispense_progress_handler progress_handler) {
+	std::shared_ptr<std::promise<dispense_result>> result = std::make_shared<std::promise<dispense_result>>();
+	std::future<dispense_result> future_result = result->get_future();
+	// the last progress is reported before the result is set
+	boost::asio::strand<boost::asio::io_service::executor_type> handler_strand(this->get_executor());
+	this->start_dispense(submit_options(), requested_bills,
+		this->wrap_progress_handler(progress_handler, handler_strand),
+		this->wrap_handler<dispense_result>(boost::asio::bind_executor(handler_strand, make_promise_handler(result))));
+	return future_result;
+}
+
+void lcdm::set_cassette_inventory(const cassette_inventory& inventory) {
+	this->planner->replace(std::make_shared<dispense_planner>(inventory, this->engine->get_profile().cassette_count));
+}
+
+lcdm::cassette_inventory lcdm::get_cassette_inventory() const {
+	return this->planner->get_inventory();
+}
+
+std::future<lcdm::dispense_result> lcdm::dispense_amount(std::uint32_t amount) {
+	std::shared_ptr<std::promise<dispense_result>> result = std::make_shared<std::promise<dispense_result>>();
+	std::future<dispense_result> future_result = result->get_future();
+	this->start_amount_dispense(submit_options(), amount, make_promise_handler(result));
+	return future_result;
+}
+
+boost::asio::io_service::executor_type lcdm::get_executor() {
+	return this->io_service.get_executor();
+}
+
+lcdm_metrics lcdm::get_metrics() const {
+	return this->engine->get_metrics();
+}
+
+void lcdm::set_dispense_coalescing(bool enabled) {
+	this->engine->set_dispense_coalescing(enabled);
+}
+
+void lcdm::cancel(const cancellation_handle& handle) {
+	if (!handle.cancelled) {
+		return;
+	}
+
+	handle.cancelled->store(true, std::memory_order_release);
+	this->engine->discard_cancelled_operations();
+}
+
+lcdm::device_state lcdm::state() const {
+	return this->engine->get_state();
+}
+
+lcdm::device_capabilities lcdm::capabilities() const {
+	return this->engine->get_capabilities();
+}
+
+void lcdm::start_status_polling(std::chrono::milliseconds interval) {
+	this->engine->set_status_poll_interval(interval);
+}
+
+void lcdm::stop_status_polling() {
+	this->engine->set_status_poll_interval(std::chrono::milliseconds(0));
+}
+
+void lcdm::start_capture(const std::string& file_name) {
+	this->engine->start_capture(std::make_shared<traffic_capture>(file_name));
+}
+
+void lcdm::stop_capture() {
+	this->engine->stop_capture();
+}
+
+void lcdm::start_journal(const std::string& file_name) {
+	this->engine->start_journal(std::make_shared<dispense_journal>(file_name));
+}
+
+void lcdm::stop_journal() {
+	this->engine->stop_journal();
+}
+
+std::vector<lcdm::journaled_dispense> lcdm::recover_journal(const std::string& file_name) {
+	return find_recoverable_dispenses(read_journal_file(file_name));
+}
+
+void lcdm::operate() {
+	this->io_service.run();
+}
+
+void lcdm::start(std::unique_ptr<lcdm_transport> transport, const timeouts& port_timeouts, device_model model) {
+	this->engine = std::make_shared<detail::engine>(this->io_service, std::move(transport), port_timeouts, device_profiles[model]);
+
+	if (this->owned_io_service) {
+		try {
+			this->cmd_handler_thread = std::thread(&lcdm::operate, this);
+		} catch (std::system_error) {
+			throw std::runtime_error("unable to create handler thread");
 		}
-		throw std::exception("failed to read response from serial port");
-	} catch (boost::system::system_error) {
-		throw std::exception("failed to read response from serial port");
+	}
+}
+
+void lcdm::start_open(open_handler handler) {
+	this->engine->probe(handler);
+}
+
+void lcdm::start_purge(const submit_options& options, purge_handler handler) {
+	this->engine->submit(this->engine->create_operation<purge_operation>(handler), options);
+}
+
+void lcdm::start_dispense(const submit_options& options, const bill_counts& requested_bills, dispense_progress_handler progress_handler, dispense_handler handler) {
+	this->engine->submit(this->engine->create_operation<dispense_operation>(this->engine->get_profile(), requested_bills, progress_handler, handler), options);
+}
+
+void lcdm::start_amount_dispense(const submit_options& options, std::uint32_t amount, dispense_handler handler) {
+	const std::shared_ptr<planner_slot> current_planner = this->planner;
+	const bill_counts reserved_bills = current_planner->reserve(amount);
+
+	try {
+		this->start_dispense(options, reserved_bills, dispense_progress_handler(),
+			[current_planner, reserved_bills, handler](std::exception_ptr error, dispense_result result) {
+				// bills of a lost connection or an unexpected response
+				// may have left the cassettes uncounted
+				const bool result_is_known = (!error) && (result.status != operation_status::connection_error);
+				current_planner->settle(reserved_bills, result_is_known, result);
+				handler(error, result);
+			});
+	} catch (std::exception) {
+		// the dispense was not submitted
+		current_planner->settle(reserved_bills, true, dispense_result());
+		throw;
 	}
 }
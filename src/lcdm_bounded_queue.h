@@ -0,0 +1,128 @@
+#ifndef BOUNDED_QUEUE_H
+#define BOUNDED_QUEUE_H
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+namespace puloon {
+
+	namespace detail {
+
+		// size of a cache line, counters of producers and consumers
+		// are kept on separate lines to avoid false sharing
+		const std::size_t cache_line_size = 64;
+
+		// lock-free bounded queue of fixed capacity
+		// (a power of two) on a ring of cells with sequence numbers;
+		// any number of threads can push and pop,
+		// neither operation allocates or blocks
+		template <typename T>
+		class bounded_queue {
+			public:
+				explicit bounded_queue(std::size_t capacity) :
+					cells(new cell[capacity]),
+					position_mask(capacity - 1),
+					enqueue_padding(),
+					enqueue_position(0),
+					dequeue_padding(),
+					dequeue_position(0) {
+					assert((capacity >= 2) && ((capacity & (capacity - 1)) == 0));
+
+					for (std::size_t i = 0; i < capacity; ++i) {
+						this->cells[i].sequence.store(i, std::memory_order_relaxed);
+					}
+				}
+
+				bounded_queue(const bounded_queue&) = delete;
+				bounded_queue& operator=(const bounded_queue&) = delete;
+
+				// moves a value into the queue,
+				// the value is left untouched if the queue is full
+				bool try_push(T&& value) {
+					cell* target_cell = nullptr;
+					std::size_t position = this->enqueue_position.load(std::memory_order_relaxed);
+
+					for (;;) {
+						target_cell = &this->cells[position & this->position_mask];
+						const std::size_t sequence = target_cell->sequence.load(std::memory_order_acquire);
+						const std::intptr_t difference = (std::intptr_t)sequence - (std::intptr_t)position;
+
+						if (difference == 0) {
+							// the cell is free, it is claimed
+							// by moving the enqueue position
+							if (this->enqueue_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+								break;
+							}
+						} else if (difference < 0) {
+							// the cell is still occupied by the previous round
+							return false;
+						} else {
+							// another producer has claimed the cell
+							position = this->enqueue_position.load(std::memory_order_relaxed);
+						}
+					}
+
+					target_cell->value = std::move(value);
+					target_cell->sequence.store(position + 1, std::memory_order_release);
+					return true;
+				}
+
+				// moves the oldest value out of the queue,
+				// returns false if the queue is empty
+				// or the oldest value is not published yet
+				bool try_pop(T& value) {
+					cell* source_cell = nullptr;
+					std::size_t position = this->dequeue_position.load(std::memory_order_relaxed);
+
+					for (;;) {
+						source_cell = &this->cells[position & this->position_mask];
+						const std::size_t sequence = source_cell->sequence.load(std::memory_order_acquire);
+						const std::intptr_t difference = (std::intptr_t)sequence - (std::intptr_t)(position + 1);
+
+						if (difference == 0) {
+							if (this->dequeue_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+								break;
+							}
+						} else if (difference < 0) {
+							return false;
+						} else {
+							position = this->dequeue_position.load(std::memory_order_relaxed);
+						}
+					}
+
+					value = std::move(source_cell->value);
+					source_cell->value = T();
+					source_cell->sequence.store(position + this->position_mask + 1, std::memory_order_release);
+					return true;
+				}
+
+				std::size_t capacity() const {
+					return this->position_mask + 1;
+				}
+
+			private:
+				struct cell {
+					std::atomic<std::size_t> sequence;
+					T value;
+				};
+
+			private:
+				std::unique_ptr<cell[]> cells;
+				const std::size_t position_mask;
+				// padding instead of alignas keeps the queue
+				// free of over-aligned allocations before C++17
+				std::uint8_t enqueue_padding[cache_line_size];
+				std::atomic<std::size_t> enqueue_position;
+				std::uint8_t dequeue_padding[cache_line_size];
+				std::atomic<std::size_t> dequeue_position;
+		};
+
+	}
+
+}
+
+#endif // BOUNDED_QUEUE_H
@@ -0,0 +1,128 @@
+#include "lcdm_capture.h"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+using namespace puloon;
+using namespace puloon::detail;
+
+// header of a capture file
+const char capture_file_magic[7] = { 'L', 'C', 'D', 'M', 'C', 'A', 'P' };
+const std::uint8_t capture_file_version = 1;
+
+const std::size_t traffic_capture::ring_capacity;
+const std::chrono::milliseconds traffic_capture::flush_interval(20);
+
+traffic_capture::traffic_capture(const std::string& file_name) :
+	capture_file(file_name, std::ios::binary | std::ios::trunc),
+	start_time(std::chrono::steady_clock::now()),
+	records(ring_capacity),
+	dropped_record_count(0),
+	flush_mutex(),
+	flush_condition(),
+	stopped(false),
+	flush_thread() {
+	if (!this->capture_file) {
+		throw std::runtime_error("unable to create capture file");
+	}
+
+	this->capture_file.write(capture_file_magic, sizeof(capture_file_magic));
+	this->capture_file.put((char)capture_file_version);
+
+	this->flush_thread = std::thread(&traffic_capture::operate, this);
+}
+
+traffic_capture::~traffic_capture() {
+	{
+		std::lock_guard<std::mutex> lock(this->flush_mutex);
+		this->stopped = true;
+	}
+
+	this->flush_condition.notify_one();
+	this->flush_thread.join();
+}
+
+void traffic_capture::record(capture_record_type type, const std::uint8_t* data, std::size_t data_size) {
+	capture_record new_record;
+	new_record.timestamp_ns = (std::uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now() - this->start_time).count();
+	new_record.type = type;
+	new_record.data_size = (std::uint8_t)std::min(data_size, new_record.data.size());
+	if (new_record.data_size > 0) {
+		std::memcpy(new_record.data.data(), data, new_record.data_size);
+	}
+
+	if (!this->records.try_push(std::move(new_record))) {
+		this->dropped_record_count.fetch_add(1, std::memory_order_relaxed);
+	}
+}
+
+std::uint64_t traffic_capture::get_dropped_record_count() const {
+	return this->dropped_record_count.load(std::memory_order_relaxed);
+}
+
+void traffic_capture::operate() {
+	std::unique_lock<std::mutex> lock(this->flush_mutex);
+
+	while (!this->stopped) {
+		this->flush_condition.wait_for(lock, flush_interval);
+		this->flush();
+	}
+
+	// records written before the capture is destroyed
+	this->flush();
+	this->capture_file.flush();
+}
+
+void traffic_capture::flush() {
+	capture_record current_record;
+
+	while (this->records.try_pop(current_record)) {
+		char encoded_timestamp[8];
+		for (std::size_t i = 0; i < sizeof(encoded_timestamp); ++i) {
+			encoded_timestamp[i] = (char)((current_record.timestamp_ns >> (i * 8)) & 0xff);
+		}
+
+		this->capture_file.write(encoded_timestamp, sizeof(encoded_timestamp));
+		this->capture_file.put((char)current_record.type);
+		this->capture_file.put((char)current_record.data_size);
+		this->capture_file.write((const char*)current_record.data.data(), current_record.data_size);
+	}
+}
+
+std::vector<capture_record> puloon::detail::read_capture_file(const std::string& file_name) {
+	std::ifstream capture_file(file_name, std::ios::binary);
+	char magic[sizeof(capture_file_magic)];
+
+	if ((!capture_file.read(magic, sizeof(magic)))
+		|| (std::memcmp(magic, capture_file_magic, sizeof(magic)) != 0)
+		|| (capture_file.get() != capture_file_version)) {
+		throw std::runtime_error("unable to read capture file");
+	}
+
+	std::vector<capture_record> records;
+	unsigned char encoded_timestamp[8];
+
+	while (capture_file.read((char*)encoded_timestamp, sizeof(encoded_timestamp))) {
+		capture_record current_record;
+		current_record.timestamp_ns = 0;
+		for (std::size_t i = 0; i < sizeof(encoded_timestamp); ++i) {
+			current_record.timestamp_ns |= (std::uint64_t)encoded_timestamp[i] << (i * 8);
+		}
+
+		const int type = capture_file.get();
+		const int data_size = capture_file.get();
+
+		if ((type < 0) || (type > (int)capture_record_type::timeout)
+			|| (data_size < 0) || ((std::size_t)data_size > current_record.data.size())
+			|| (!capture_file.read((char*)current_record.data.data(), data_size))) {
+			throw std::runtime_error("unable to read capture file");
+		}
+
+		current_record.type = (capture_record_type)type;
+		current_record.data_size = (std::uint8_t)data_size;
+		records.push_back(current_record);
+	}
+
+	return records;
+}
@@ -0,0 +1,91 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "lcdm_bounded_queue.h"
+#include "lcdm_frame.h"
+
+namespace puloon {
+
+	namespace detail {
+
+		enum class capture_record_type : std::uint8_t {
+			// bytes written to the device
+			transmitted = 0,
+			// bytes read from the device
+			received = 1,
+			// a deadline of the command exchange has expired
+			timeout = 2
+		};
+
+		// one entry of the serial traffic,
+		// trivially copyable to be kept in a preallocated ring
+		struct capture_record {
+			// time since the start of the capture
+			std::uint64_t timestamp_ns;
+			capture_record_type type;
+			std::uint8_t data_size;
+			std::array<std::uint8_t, max_response_frame_size> data;
+		};
+
+		// records the serial traffic of a device into a ring
+		// and writes it to a file on a separate thread;
+		// the file consists of a header ("LCDMCAP" and a version byte)
+		// and records of a little-endian 64-bit timestamp in nanoseconds,
+		// a type byte, a size byte and the data
+		class traffic_capture {
+			public:
+				// creates the capture file and starts the flush thread
+				explicit traffic_capture(const std::string& file_name);
+				// writes the remaining records and closes the file
+				~traffic_capture();
+
+				traffic_capture(const traffic_capture&) = delete;
+				traffic_capture& operator=(const traffic_capture&) = delete;
+
+				// copies data into the ring without locks or allocations,
+				// the record is dropped if the ring is full
+				void record(capture_record_type type, const std::uint8_t* data, std::size_t data_size);
+
+				// number of records lost because the ring was full
+				std::uint64_t get_dropped_record_count() const;
+
+			private:
+				// writes records from the ring to the file
+				// until the capture is destroyed
+				void operate();
+				void flush();
+
+			private:
+				std::ofstream capture_file;
+				std::chrono::steady_clock::time_point start_time;
+				bounded_queue<capture_record> records;
+				std::atomic<std::uint64_t> dropped_record_count;
+				std::mutex flush_mutex;
+				std::condition_variable flush_condition;
+				bool stopped;
+				std::thread flush_thread;
+
+				// number of records kept in memory
+				static const std::size_t ring_capacity = 16384;
+				static const std::chrono::milliseconds flush_interval;
+		};
+
+		// reads all records of a capture file,
+		// throws std::runtime_error if the file cannot be read
+		std::vector<capture_record> read_capture_file(const std::string& file_name);
+
+	}
+
+}
+
+#endif // CAPTURE_H
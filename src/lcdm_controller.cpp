@@ -0,0 +1,113 @@
+#include "lcdm_controller.h"
+#include <algorithm>
+#include <stdexcept>
+
+using namespace puloon;
+
+lcdm_controller::lcdm_controller(std::size_t thread_count) :
+	io_service(),
+	io_service_work(new boost::asio::io_service::work(io_service)),
+	devices(),
+	devices_mutex(),
+	handler_error_handler(),
+	error_handler_mutex(),
+	handler_threads() {
+	try {
+		for (std::size_t i = 0; i < std::max<std::size_t>(thread_count, 1); ++i) {
+			this->handler_threads.push_back(std::thread(&lcdm_controller::operate, this));
+		}
+	} catch (std::system_error) {
+		this->io_service_work.reset();
+		for (std::size_t i = 0; i < this->handler_threads.size(); ++i) {
+			this->handler_threads[i].join();
+		}
+		throw std::runtime_error("unable to create handler thread");
+	}
+}
+
+lcdm_controller::~lcdm_controller() {
+	this->devices_mutex.lock();
+	this->devices.clear();
+	this->devices_mutex.unlock();
+
+	// handler threads exit as soon as
+	// the handlers of the closed ports are completed
+	this->io_service_work.reset();
+	for (std::size_t i = 0; i < this->handler_threads.size(); ++i) {
+		this->handler_threads[i].join();
+	}
+}
+
+lcdm& lcdm_controller::add_device(const std::string& port_name, const lcdm::timeouts& port_timeouts, lcdm::device_model model) {
+	return this->insert_device(std::unique_ptr<lcdm>(new lcdm(this->io_service, port_name, port_timeouts, model)));
+}
+
+lcdm& lcdm_controller::add_device(const lcdm_transport_factory& make_transport, const lcdm::timeouts& port_timeouts, lcdm::device_model model) {
+	return this->insert_device(std::unique_ptr<lcdm>(new lcdm(this->io_service, make_transport, port_timeouts, model)));
+}
+
+void lcdm_controller::remove_device(const lcdm& device) {
+	std::unique_ptr<lcdm> removed_device;
+
+	this->devices_mutex.lock();
+	for (std::vector<std::unique_ptr<lcdm>>::iterator device_iterator = this->devices.begin(); device_iterator != this->devices.end(); ++device_iterator) {
+		if (device_iterator->get() == &device) {
+			removed_device = std::move(*device_iterator);
+			this->devices.erase(device_iterator);
+			break;
+		}
+	}
+	this->devices_mutex.unlock();
+
+	// the device is closed outside of the lock
+	removed_device.reset();
+}
+
+std::size_t lcdm_controller::get_device_count() const {
+	std::lock_guard<std::mutex> devices_lock(this->devices_mutex);
+	return this->devices.size();
+}
+
+boost::asio::io_service& lcdm_controller::get_io_service() {
+	return this->io_service;
+}
+
+void lcdm_controller::set_error_handler(error_handler handler) {
+	std::lock_guard<std::mutex> error_handler_lock(this->error_handler_mutex);
+	this->handler_error_handler = std::move(handler);
+}
+
+lcdm& lcdm_controller::insert_device(std::unique_ptr<lcdm> new_device) {
+	lcdm& device = *new_device;
+
+	this->devices_mutex.lock();
+	this->devices.push_back(std::move(new_device));
+	this->devices_mutex.unlock();
+
+	return device;
+}
+
+void lcdm_controller::operate() {
+	for (;;) {
+		try {
+			this->io_service.run();
+			break;
+		} catch (...) {
+			// an exception thrown by a handler of one device
+			// must not stop the handlers of other devices,
+			// unless no one is told about it
+			error_handler current_error_handler;
+
+			{
+				std::lock_guard<std::mutex> error_handler_lock(this->error_handler_mutex);
+				current_error_handler = this->handler_error_handler;
+			}
+
+			if (!current_error_handler) {
+				throw;
+			}
+
+			current_error_handler(std::current_exception());
+		}
+	}
+}
@@ -0,0 +1,842 @@
+#include "lcdm_engine.h"
+#include <algorithm>
+#include <cassert>
+#include <exception>
+#include <limits>
+#include <future>
+#include <system_error>
+#include <utility>
+
+using namespace boost::asio;
+using namespace puloon;
+using namespace puloon::detail;
+
+
+template <typename T>
+void engine::destroy_detached(std::shared_ptr<T> released_object) {
+	if (!released_object) {
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(this->destruction_mutex);
+
+	this->detached_destructions.erase(std::remove_if(this->detached_destructions.begin(), this->detached_destructions.end(),
+		[](const std::future<void>& destruction) {
+			return (destruction.wait_for(std::chrono::seconds(0)) == std::future_status::ready);
+		}), this->detached_destructions.end());
+
+	try {
+		this->detached_destructions.push_back(std::async(std::launch::async, [object = std::move(released_object)]() mutable {
+			object.reset();
+		}));
+	} catch (std::system_error) {
+		// no thread is available,
+		// the object is destroyed with the failed task
+	}
+}
+
+engine::engine(boost::asio::io_service& io_service, std::unique_ptr<lcdm_transport> transport, const lcdm::timeouts& port_timeouts, const device_profile& profile) :
+	strand(io_service.get_executor()),
+	transport(std::move(transport)),
+	deadline_timer(io_service),
+	status_poll_timer(io_service),
+	expiry_timer(io_service),
+	deadlines(port_timeouts),
+	profile(profile),
+	status_poll_interval(0),
+	operations(submission_queue_capacity),
+	submission_queue(submission_queue_capacity),
+	drain_is_scheduled(false),
+	pending_operations(),
+	next_sequence_number(0),
+	dispense_coalescing_enabled(false),
+	current_operation(),
+	command_frame(),
+	command_frame_size(0),
+	received_data(),
+	parser(),
+	acknowledge_status(0),
+	current_command_code(0),
+	current_command_bills(0),
+	current_command_is_probe(false),
+	command_write_time(),
+	acknowledge_time(),
+	response_acknowledge_pending(false),
+	acknowledge_in_progress(false),
+	write_try_count(0),
+	read_try_count(0),
+	deadline_expired(false),
+	closed(false),
+	metrics(),
+	capture(),
+	journal(),
+	detached_destructions(),
+	destruction_mutex(),
+	current_journal_id(0),
+	device_state() {
+	this->pending_operations.reserve(submission_queue_capacity);
+	this->expiry_timer.expires_at(steady_timer::time_point::max());
+}
+
+void engine::submit(operation_ptr new_operation, const lcdm::submit_options& options) {
+	new_operation->set_submit_time(steady_timer::clock_type::now());
+	new_operation->set_options(options);
+
+	if (!this->submission_queue.try_push(std::move(new_operation))) {
+		// the operation is left with the caller
+		// and is rejected outside the call like any other completion
+		std::shared_ptr<engine> self = this->shared_from_this();
+		std::shared_ptr<operation_ptr> rejected_operation = std::make_shared<operation_ptr>(std::move(new_operation));
+
+		post(this->strand, [self, rejected_operation]() {
+			(*rejected_operation)->cancel(lcdm::operation_status::queue_full);
+		});
+		return;
+	}
+
+	// a single drain is posted for any number of submissions
+	if (!this->drain_is_scheduled.exchange(true)) {
+		std::shared_ptr<engine> self = this->shared_from_this();
+
+		post(this->strand, [self]() {
+			self->drain_submission_queue();
+		});
+	}
+}
+
+void engine::probe(const lcdm::open_handler& handler) {
+	lcdm::submit_options options;
+	options.priority = std::numeric_limits<std::int32_t>::max();
+
+	this->submit(this->create_operation<probe_operation>(this->device_state, handler), options);
+}
+
+void engine::close() {
+	std::shared_ptr<engine> self = this->shared_from_this();
+
+	post(this->strand, [self]() {
+		if (self->closed) {
+			return;
+		}
+
+		self->closed = true;
+
+		// pending handlers of the current operation
+		// are completed with an error and fail the operation
+		boost::system::error_code ignored_error;
+		self->deadline_timer.cancel(ignored_error);
+		self->status_poll_timer.cancel(ignored_error);
+		self->expiry_timer.cancel(ignored_error);
+		self->transport->close();
+		self->destroy_detached(std::move(self->capture));
+		self->destroy_detached(std::move(self->journal));
+
+		self->start_next_operation();
+	});
+}
+
+void engine::start_capture(std::shared_ptr<traffic_capture> new_capture) {
+	std::shared_ptr<engine> self = this->shared_from_this();
+
+	post(this->strand, [self, new_capture]() {
+		self->destroy_detached(std::exchange(self->capture, new_capture));
+	});
+}
+
+void engine::stop_capture() {
+	std::shared_ptr<engine> self = this->shared_from_this();
+
+	post(this->strand, [self]() {
+		// the remaining records are written
+		// when the capture is destroyed
+		self->destroy_detached(std::move(self->capture));
+	});
+}
+
+void engine::wait_for_detached_destructions() {
+	std::vector<std::future<void>> current_destructions;
+
+	{
+		std::lock_guard<std::mutex> lock(this->destruction_mutex);
+		current_destructions.swap(this->detached_destructions);
+	}
+
+	for (std::future<void>& destruction : current_destructions) {
+		destruction.wait();
+	}
+}
+
+void engine::start_journal(std::shared_ptr<dispense_journal> new_journal) {
+	std::shared_ptr<engine> self = this->shared_from_this();
+
+	post(this->strand, [self, new_journal]() {
+		self->destroy_detached(std::exchange(self->journal, new_journal));
+		// the current operation starts over in the new journal
+		self->current_journal_id = 0;
+	});
+}
+
+void engine::stop_journal() {
+	std::shared_ptr<engine> self = this->shared_from_this();
+
+	post(this->strand, [self]() {
+		// the remaining records are written to the disk
+		// when the journal is destroyed
+		self->destroy_detached(std::move(self->journal));
+		self->current_journal_id = 0;
+	});
+}
+
+void engine::discard_cancelled_operations() {
+	std::shared_ptr<engine> self = this->shared_from_this();
+
+	post(this->strand, [self]() {
+		self->collect_submitted_operations();
+		self->discard_pending_operations();
+	});
+}
+
+void engine::set_dispense_coalescing(bool enabled) {
+	std::shared_ptr<engine> self = this->shared_from_this();
+
+	post(this->strand, [self, enabled]() {
+		self->dispense_coalescing_enabled = enabled;
+	});
+}
+
+lcdm::device_state engine::get_state() const {
+	return this->device_state.load();
+}
+
+lcdm::device_capabilities engine::get_capabilities() const {
+	return this->device_state.load_capabilities();
+}
+
+const device_profile& engine::get_profile() const {
+	return this->profile;
+}
+
+void engine::set_status_poll_interval(std::chrono::milliseconds interval) {
+	std::shared_ptr<engine> self = this->shared_from_this();
+
+	post(this->strand, [self, interval]() {
+		self->status_poll_interval = interval;
+
+		if (interval.count() > 0) {
+			if (!self->current_operation && !self->acknowledge_in_progress) {
+				self->schedule_status_poll();
+			}
+		} else {
+			boost::system::error_code ignored_error;
+			self->status_poll_timer.cancel(ignored_error);
+		}
+	});
+}
+
+void engine::drain_submission_queue() {
+	// the flag is cleared before the queue is read,
+	// so an operation submitted after this point posts a new drain
+	this->drain_is_scheduled.store(false);
+	this->collect_submitted_operations();
+	this->start_next_operation();
+}
+
+void engine::start_next_operation() {
+	if (this->current_operation || this->acknowledge_in_progress) {
+		// the queued operations wait for the current one to complete
+		// and for the port to be free
+		return;
+	}
+
+	if (this->take_next_operation()) {
+		this->start_command();
+	} else {
+		this->schedule_status_poll();
+	}
+}
+
+bool engine::take_next_operation() {
+	const steady_timer::time_point now = steady_timer::clock_type::now();
+
+	while (!this->current_operation) {
+		this->collect_submitted_operations();
+
+		if (this->pending_operations.empty()) {
+			break;
+		}
+
+		std::pop_heap(this->pending_operations.begin(), this->pending_operations.end(), &engine::is_started_after);
+		this->current_operation = std::move(this->pending_operations.back());
+		this->pending_operations.pop_back();
+
+		if (this->discard_operation(this->current_operation, now)) {
+			this->current_operation.reset();
+		} else if (this->dispense_coalescing_enabled) {
+			this->coalesce_current_operation(now);
+		}
+	}
+
+	if (this->current_operation) {
+		// results are journaled before the handlers learn them,
+		// the observer is called on the strand inside complete_command
+		this->current_operation->set_result_observer([this]() {
+			this->record_journal(journal_record_type::result_decoded);
+		});
+	}
+
+	return (bool)this->current_operation;
+}
+
+void engine::coalesce_current_operation(steady_timer::time_point now) {
+	cassette source = cassette::upper;
+
+	if (!this->current_operation->get_coalescible_cassette(source)) {
+		return;
+	}
+
+	// the partner that would be started first
+	// among the ones that can still be started
+	std::size_t partner_index = this->pending_operations.size();
+
+	for (std::size_t i = 0; i < this->pending_operations.size(); ++i) {
+		const operation_ptr& pending_operation = this->pending_operations[i];
+		cassette pending_source = cassette::upper;
+
+		if (pending_operation->get_coalescible_cassette(pending_source)
+			&& (pending_source != source)
+			&& (!pending_operation->get_options().cancellation.is_cancelled())
+			&& (pending_operation->get_options().deadline > now)
+			&& ((partner_index == this->pending_operations.size())
+				|| is_started_after(this->pending_operations[partner_index], pending_operation))) {
+			partner_index = i;
+		}
+	}
+
+	if (partner_index == this->pending_operations.size()) {
+		return;
+	}
+
+	operation_ptr partner = std::move(this->pending_operations[partner_index]);
+	this->pending_operations[partner_index] = std::move(this->pending_operations.back());
+	this->pending_operations.pop_back();
+	std::make_heap(this->pending_operations.begin(), this->pending_operations.end(), &engine::is_started_after);
+
+	const steady_timer::time_point submit_time = std::min(this->current_operation->get_submit_time(), partner->get_submit_time());
+	operation_ptr coalesced_operation = (source == cassette::upper)
+		? this->create_operation<coalesced_dispense_operation>(std::move(this->current_operation), std::move(partner))
+		: this->create_operation<coalesced_dispense_operation>(std::move(partner), std::move(this->current_operation));
+
+	coalesced_operation->set_submit_time(submit_time);
+	this->current_operation = std::move(coalesced_operation);
+}
+
+void engine::collect_submitted_operations() {
+	operation_ptr submitted_operation;
+	bool operations_are_collected = false;
+
+	while ((this->pending_operations.size() < submission_queue_capacity)
+		&& this->submission_queue.try_pop(submitted_operation)) {
+		submitted_operation->set_sequence_number(this->next_sequence_number++);
+		this->pending_operations.push_back(std::move(submitted_operation));
+		std::push_heap(this->pending_operations.begin(), this->pending_operations.end(), &engine::is_started_after);
+		operations_are_collected = true;
+	}
+
+	if (operations_are_collected) {
+		this->schedule_expiry();
+	}
+}
+
+void engine::discard_pending_operations() {
+	const steady_timer::time_point now = steady_timer::clock_type::now();
+	bool operations_are_discarded = false;
+
+	for (operation_ptr& pending_operation : this->pending_operations) {
+		if (this->discard_operation(pending_operation, now)) {
+			pending_operation.reset();
+			operations_are_discarded = true;
+		}
+	}
+
+	if (operations_are_discarded) {
+		this->pending_operations.erase(
+			std::remove(this->pending_operations.begin(), this->pending_operations.end(), nullptr),
+			this->pending_operations.end());
+		std::make_heap(this->pending_operations.begin(), this->pending_operations.end(), &engine::is_started_after);
+	}
+
+	this->schedule_expiry();
+}
+
+void engine::schedule_expiry() {
+	steady_timer::time_point earliest_deadline = steady_timer::time_point::max();
+
+	for (const operation_ptr& pending_operation : this->pending_operations) {
+		earliest_deadline = std::min(earliest_deadline, pending_operation->get_options().deadline);
+	}
+
+	// the timer is only moved to an earlier deadline,
+	// a later one is found when the timer expires
+	if (this->closed || (earliest_deadline >= this->expiry_timer.expiry())) {
+		return;
+	}
+
+	std::shared_ptr<engine> self = this->shared_from_this();
+
+	this->expiry_timer.expires_at(earliest_deadline);
+	this->expiry_timer.async_wait(bind_executor(this->strand, [self](const boost::system::error_code& error) {
+		self->handle_expiry(error);
+	}));
+}
+
+void engine::handle_expiry(const boost::system::error_code& error) {
+	if ((error == error::operation_aborted)
+		|| (this->expiry_timer.expiry() > steady_timer::clock_type::now())) {
+		// the timer was moved to an earlier deadline
+		return;
+	}
+
+	this->expiry_timer.expires_at(steady_timer::time_point::max());
+	this->discard_pending_operations();
+}
+
+bool engine::discard_operation(operation_ptr& pending_operation, steady_timer::time_point now) const {
+	if (this->closed || pending_operation->get_options().cancellation.is_cancelled()) {
+		pending_operation->cancel(lcdm::operation_status::cancelled);
+		return true;
+	}
+
+	if (pending_operation->get_options().deadline <= now) {
+		pending_operation->cancel(lcdm::operation_status::expired);
+		return true;
+	}
+
+	return pending_operation->is_completed();
+}
+
+bool engine::is_started_after(const operation_ptr& left, const operation_ptr& right) {
+	const std::int32_t left_priority = left->get_options().priority;
+	const std::int32_t right_priority = right->get_options().priority;
+
+	if (left_priority != right_priority) {
+		return (left_priority < right_priority);
+	}
+
+	return (left->get_sequence_number() > right->get_sequence_number());
+}
+
+void engine::schedule_status_poll() {
+	if (this->closed || (this->status_poll_interval.count() <= 0)) {
+		return;
+	}
+
+	std::shared_ptr<engine> self = this->shared_from_this();
+
+	// restarting the timer cancels the previous wait,
+	// so the interval counts from the end of the last exchange
+	this->status_poll_timer.expires_after(this->status_poll_interval);
+	this->status_poll_timer.async_wait(bind_executor(this->strand, [self](const boost::system::error_code& error) {
+		self->handle_status_poll(error);
+	}));
+}
+
+void engine::handle_status_poll(const boost::system::error_code& error) {
+	if ((error == error::operation_aborted)
+		|| (this->status_poll_timer.expiry() > steady_timer::clock_type::now())
+		|| this->closed
+		|| (this->status_poll_interval.count() <= 0)
+		|| this->current_operation
+		|| this->acknowledge_in_progress) {
+		// the engine is busy, the poll is scheduled again
+		// when the exchange is completed
+		return;
+	}
+
+	// operations submitted while the drain is still posted
+	// go ahead of the poll
+	if (!this->take_next_operation()) {
+		this->current_operation = this->create_operation<status_operation>(this->device_state);
+		this->current_operation->set_submit_time(steady_timer::clock_type::now());
+	}
+
+	this->start_command();
+}
+
+lcdm_metrics engine::get_metrics() const {
+	return this->metrics.get_snapshot();
+}
+
+void engine::start_command() {
+	if (!this->prepare_command()) {
+		this->fail_command();
+		return;
+	}
+
+	this->get_command_counters().queue_wait.record(
+		steady_timer::clock_type::now() - this->current_operation->get_submit_time());
+
+	this->write_try_count = this->deadlines.get_try_count();
+	this->write_command();
+}
+
+bool engine::prepare_command() {
+	try {
+		command current_command = this->current_operation->get_command();
+		this->command_frame_size = build_command_frame(current_command, this->command_frame);
+		assert(current_command.response_data_size <= max_result_data_size);
+		this->current_command_code = (std::uint8_t)current_command.code;
+		this->current_command_bills = current_command.bills;
+		this->current_command_is_probe = current_command.is_probe;
+		metrics_recorder::increment(this->get_command_counters().commands);
+		this->record_journal(journal_record_type::command_sent);
+		return true;
+	} catch (std::exception) {
+		return false;
+	}
+}
+
+void engine::write_command() {
+	std::shared_ptr<engine> self = this->shared_from_this();
+	lcdm_transport::write_buffers buffers = { {
+		buffer(this->command_frame.data(), this->command_frame_size),
+		const_buffer()
+	} };
+
+	if (this->response_acknowledge_pending) {
+		// ACK of the previous response and the command
+		// are written together, the command is repeated without ACK
+		this->response_acknowledge_pending = false;
+		buffers[1] = buffers[0];
+		buffers[0] = buffer(&ack, 1);
+	}
+
+	if (this->capture) {
+		for (const const_buffer& written_buffer : buffers) {
+			if (written_buffer.size() > 0) {
+				this->capture->record(capture_record_type::transmitted, (const std::uint8_t*)written_buffer.data(), written_buffer.size());
+			}
+		}
+	}
+
+	this->command_write_time = steady_timer::clock_type::now();
+	this->transport->async_write(buffers, this->make_io_handler([self](const boost::system::error_code& error, std::size_t) {
+		self->handle_command_written(error);
+	}));
+}
+
+void engine::handle_command_written(const boost::system::error_code& error) {
+	if (this->closed || error) {
+		this->fail_command();
+	} else {
+		this->read_acknowledge();
+	}
+}
+
+void engine::read_acknowledge() {
+	this->start_deadline(this->current_command_is_probe
+		? this->deadlines.get_probe_timeout()
+		: this->deadlines.get_ack_timeout(this->current_command_code));
+	this->receive_acknowledge();
+}
+
+void engine::receive_acknowledge() {
+	std::shared_ptr<engine> self = this->shared_from_this();
+
+	this->acknowledge_status = 0;
+	this->transport->async_read_some(buffer(&this->acknowledge_status, 1),
+		this->make_io_handler([self](const boost::system::error_code& error, std::size_t) {
+			self->handle_acknowledge(error);
+		}));
+}
+
+void engine::handle_acknowledge(const boost::system::error_code& error) {
+	if (this->capture && (!error)) {
+		this->capture->record(capture_record_type::received, &this->acknowledge_status, 1);
+	}
+
+	const bool acknowledge_is_received = (!error) && ((this->acknowledge_status == ack) || (this->acknowledge_status == nak));
+
+	if ((!this->closed) && (!error) && (!acknowledge_is_received) && (!this->deadline_expired)) {
+		// noise on the line, the deadline of ACK keeps running
+		this->receive_acknowledge();
+		return;
+	}
+
+	this->stop_deadline();
+
+	if (this->closed || (error && !this->deadline_expired)) {
+		this->fail_command();
+	} else if ((!error) && (this->acknowledge_status == ack)) {
+		this->acknowledge_time = steady_timer::clock_type::now();
+		this->get_command_counters().acknowledge_latency.record(this->acknowledge_time - this->command_write_time);
+		if (this->write_try_count == this->deadlines.get_try_count()) {
+			this->deadlines.record_ack_latency(this->current_command_code, this->acknowledge_time - this->command_write_time);
+		}
+		this->read_try_count = this->deadlines.get_try_count();
+		this->read_response();
+	} else {
+		// noise read after the deadline has expired
+		// is a timeout like a silent device
+		command_counters& counters = this->get_command_counters();
+		metrics_recorder::increment(acknowledge_is_received ? counters.received_naks : counters.acknowledge_timeouts);
+
+		if ((!acknowledge_is_received) && (!this->current_command_is_probe)) {
+			// the next write waits longer
+			this->deadlines.back_off_ack(this->current_command_code);
+		}
+
+		if (--this->write_try_count > 0) {
+			// the device is silent or has not accepted the command,
+			// the command is written again
+			metrics_recorder::increment(counters.command_retries);
+			this->write_command();
+		} else {
+			this->fail_command();
+		}
+	}
+}
+
+void engine::read_response() {
+	this->parser.reset();
+	this->start_deadline(this->current_command_is_probe
+		? this->deadlines.get_probe_timeout()
+		: this->deadlines.get_response_timeout(this->current_command_code, this->current_command_bills));
+	this->receive_response();
+}
+
+void engine::receive_response() {
+	std::shared_ptr<engine> self = this->shared_from_this();
+
+	this->transport->async_read_some(buffer(this->received_data),
+		this->make_io_handler([self](const boost::system::error_code& error, std::size_t bytes_transferred) {
+			self->handle_response(error, bytes_transferred);
+		}));
+}
+
+void engine::handle_response(const boost::system::error_code& error, std::size_t bytes_transferred) {
+	if (this->capture && (!error)) {
+		this->capture->record(capture_record_type::received, this->received_data.data(), bytes_transferred);
+	}
+
+	if (this->closed || (error && !this->deadline_expired)) {
+		this->stop_deadline();
+		this->fail_command();
+		return;
+	} else if (error) {
+		this->handle_response_timeout();
+		return;
+	}
+
+	const std::uint8_t* data_begin = this->received_data.data();
+	const std::uint8_t* data_end = data_begin + bytes_transferred;
+
+	response_parser::parse_result current_result = this->parser.parse(data_begin, data_end);
+	bool frame_is_corrupted = false;
+
+	// a valid frame may follow a corrupted one in the same data,
+	// the parser is resynchronized on the rest of it
+	while ((current_result == response_parser::parse_result::corrupted) && (data_begin != data_end)) {
+		metrics_recorder::increment(this->get_command_counters().corrupted_responses);
+		frame_is_corrupted = true;
+		current_result = this->parser.parse(data_begin, data_end);
+	}
+
+	switch (current_result) {
+		case response_parser::parse_result::incomplete:
+			if (frame_is_corrupted && (!this->parser.is_receiving_frame())) {
+				// no other frame has started after the corrupted one
+				this->stop_deadline();
+				this->write_acknowledge(nak);
+			} else if (this->deadline_expired) {
+				// the deadline expired while the data was queued,
+				// no read is left to be aborted by it
+				this->handle_response_timeout();
+			} else {
+				// the deadline of the frame keeps running
+				this->receive_response();
+			}
+			break;
+		case response_parser::parse_result::completed:
+			this->stop_deadline();
+			this->get_command_counters().response_latency.record(steady_timer::clock_type::now() - this->acknowledge_time);
+			if (this->read_try_count == this->deadlines.get_try_count()) {
+				this->deadlines.record_response_latency(this->current_command_code, this->current_command_bills,
+					steady_timer::clock_type::now() - this->acknowledge_time);
+			}
+			metrics_recorder::increment(this->get_command_counters().responses);
+			this->complete_command();
+			break;
+		case response_parser::parse_result::corrupted:
+			this->stop_deadline();
+			metrics_recorder::increment(this->get_command_counters().corrupted_responses);
+			this->write_acknowledge(nak);
+			break;
+	}
+}
+
+void engine::handle_response_timeout() {
+	// the device is silent, the response is requested again
+	// with a longer deadline
+	metrics_recorder::increment(this->get_command_counters().response_timeouts);
+	if (!this->current_command_is_probe) {
+		this->deadlines.back_off_response(this->current_command_code, this->current_command_bills);
+	}
+	this->write_acknowledge(nak);
+}
+
+void engine::write_acknowledge(const std::uint8_t& acknowledge_status) {
+	std::shared_ptr<engine> self = this->shared_from_this();
+	const bool response_is_valid = (acknowledge_status == ack);
+
+	if (!response_is_valid) {
+		metrics_recorder::increment(this->get_command_counters().sent_naks);
+	}
+
+	if (this->capture) {
+		this->capture->record(capture_record_type::transmitted, &acknowledge_status, 1);
+	}
+
+	const lcdm_transport::write_buffers buffers = { { buffer(&acknowledge_status, 1), const_buffer() } };
+	this->transport->async_write(buffers,
+		this->make_io_handler([self, response_is_valid](const boost::system::error_code& error, std::size_t) {
+			self->handle_acknowledge_written(error, response_is_valid);
+		}));
+}
+
+void engine::handle_acknowledge_written(const boost::system::error_code& error, bool response_is_valid) {
+	if (response_is_valid) {
+		// the result is already handled,
+		// a failure of the port is found by the next command
+		this->acknowledge_in_progress = false;
+		this->start_next_operation();
+	} else if (this->closed || error) {
+		this->fail_command();
+	} else if (--this->read_try_count > 0) {
+		// the device repeats the response after NAK
+		this->read_response();
+	} else {
+		this->fail_command();
+	}
+}
+
+void engine::complete_command() {
+	const data_view result_data = this->parser.get_result_data();
+	const std::size_t status_code_offset = get_status_code_offset(result_data[0]);
+
+	if ((status_code_offset != 0) && (status_code_offset < result_data.size())) {
+		metrics_recorder::increment(this->get_command_counters().status_codes[result_data[status_code_offset]]);
+	}
+
+	bool result_is_valid = true;
+
+	try {
+		this->current_operation->handle_result(result_data);
+	} catch (std::exception) {
+		metrics_recorder::increment(this->get_command_counters().format_errors);
+		result_is_valid = false;
+	}
+
+	if (!result_is_valid) {
+		// the bills of the round are not known
+		this->record_journal(journal_record_type::operation_failed);
+		this->current_operation->set_error();
+	} else if (!this->current_operation->is_completed()) {
+		if (this->current_operation->get_options().cancellation.is_cancelled()) {
+			// the remaining rounds are not started
+			this->record_journal(journal_record_type::operation_completed);
+			this->current_operation->cancel(lcdm::operation_status::cancelled);
+		} else if (this->prepare_command()) {
+			// the next round follows ACK without a gap
+			this->response_acknowledge_pending = true;
+			this->write_try_count = this->deadlines.get_try_count();
+			this->write_command();
+			return;
+		} else {
+			this->record_journal(journal_record_type::operation_failed);
+			this->current_operation->set_error();
+		}
+	} else {
+		this->record_journal(journal_record_type::operation_completed);
+	}
+
+	this->current_operation.reset();
+
+	// ACK is written together with the first command
+	// of the next operation if there is one
+	this->response_acknowledge_pending = true;
+	this->start_next_operation();
+
+	if (this->response_acknowledge_pending) {
+		this->response_acknowledge_pending = false;
+		this->acknowledge_in_progress = true;
+		this->write_acknowledge(ack);
+	}
+}
+
+void engine::fail_command() {
+	metrics_recorder::increment(this->get_command_counters().failed_commands);
+	// the bills of a command without a result may have left the cassettes
+	this->record_journal(journal_record_type::operation_failed);
+	this->current_operation->set_error();
+	this->current_operation.reset();
+	this->start_next_operation();
+}
+
+void engine::record_journal(journal_record_type type) {
+	dispense_counts counts;
+
+	if ((!this->journal) || (!this->current_operation->get_dispense_counts(counts))) {
+		return;
+	}
+
+	const bool operation_is_ended = ((type == journal_record_type::operation_completed)
+		|| (type == journal_record_type::operation_failed));
+
+	if (this->current_journal_id == 0) {
+		if (operation_is_ended) {
+			// no command of the operation has been recorded
+			return;
+		}
+
+		this->current_journal_id = this->journal->start_operation();
+	}
+
+	this->journal->record(type, this->current_journal_id, this->current_command_code, counts);
+
+	if (operation_is_ended) {
+		this->current_journal_id = 0;
+	}
+}
+
+void engine::start_deadline(std::chrono::milliseconds timeout) {
+	std::shared_ptr<engine> self = this->shared_from_this();
+
+	this->deadline_expired = false;
+	this->deadline_timer.expires_after(timeout);
+	this->deadline_timer.async_wait(bind_executor(this->strand, [self](const boost::system::error_code& error) {
+		self->handle_deadline(error);
+	}));
+}
+
+void engine::stop_deadline() {
+	// a deadline handler that is already queued
+	// sees an expiry time in the future and is ignored
+	this->deadline_timer.expires_at(steady_timer::time_point::max());
+}
+
+void engine::handle_deadline(const boost::system::error_code& error) {
+	if ((error != error::operation_aborted)
+		&& (this->deadline_timer.expiry() <= steady_timer::clock_type::now())) {
+		// abort the pending read
+		this->deadline_expired = true;
+		this->transport->cancel();
+
+		if (this->capture) {
+			this->capture->record(capture_record_type::timeout, nullptr, 0);
+		}
+	}
+}
+
+command_counters& engine::get_command_counters() {
+	return this->metrics.get_counters(this->current_command_code);
+}
@@ -0,0 +1,276 @@
+#ifndef ENGINE_H
+#define ENGINE_H
+
+#include "lcdm.h"
+#include <array>
+#include <atomic>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "lcdm_bounded_queue.h"
+#include "lcdm_capture.h"
+#include "lcdm_frame.h"
+#include "lcdm_journal.h"
+#include "lcdm_metrics_recorder.h"
+#include "lcdm_operation_pool.h"
+#include "lcdm_operations.h"
+#include "lcdm_response_parser.h"
+#include "lcdm_state_cache.h"
+#include "lcdm_timeout_estimator.h"
+#include "lcdm_transport.h"
+
+namespace puloon {
+
+	namespace detail {
+
+		// protocol engine that performs the command exchange
+		// (command -> ACK -> response -> ACK/NAK)
+		// as an asynchronous state machine;
+		// all handlers run on the strand of the engine
+		// and keep the engine alive until they are completed
+		class engine : public std::enable_shared_from_this<engine> {
+			public:
+				engine(boost::asio::io_service& io_service, std::unique_ptr<lcdm_transport> transport, const lcdm::timeouts& port_timeouts, const device_profile& profile);
+				~engine() = default;
+
+				// constructs an operation in the operation pool,
+				// can be called from any thread
+				template <typename Operation, typename... Args>
+				operation_ptr create_operation(Args&&... args);
+				// queues an operation without locks,
+				// the operation is completed with operation_status::queue_full
+				// through the strand if the submission queue is full;
+				// can be called from any thread
+				void submit(operation_ptr new_operation, const lcdm::submit_options& options);
+				// queues a probe of the device
+				// ahead of the queued operations,
+				// can be called from any thread
+				void probe(const lcdm::open_handler& handler);
+				// completes the queued operations whose handle is cancelled,
+				// can be called from any thread
+				void discard_cancelled_operations();
+				// closes the transport, completes the current operation
+				// with an error and cancels the queued operations
+				// and the ones submitted later;
+				// can be called from any thread more than once
+				void close();
+				// returns a snapshot of the metrics,
+				// can be called from any thread
+				lcdm_metrics get_metrics() const;
+				// starts recording the traffic into a capture,
+				// replaces the previous capture;
+				// can be called from any thread
+				void start_capture(std::shared_ptr<traffic_capture> new_capture);
+				// stops recording the traffic,
+				// the capture is closed on a separate thread
+				void stop_capture();
+				// starts recording the dispenses into a journal,
+				// replaces the previous journal;
+				// can be called from any thread
+				void start_journal(std::shared_ptr<dispense_journal> new_journal);
+				// stops recording the dispenses,
+				// the journal is closed on a separate thread
+				void stop_journal();
+				// returns the cached device state,
+				// can be called from any thread
+				lcdm::device_state get_state() const;
+				// returns the cached capabilities of the last probe,
+				// can be called from any thread
+				lcdm::device_capabilities get_capabilities() const;
+				// cassettes and dispense commands of the device model,
+				// can be called from any thread
+				const device_profile& get_profile() const;
+				// enables merging of queued single cassette dispenses
+				// into up/low dispense commands,
+				// can be called from any thread
+				void set_dispense_coalescing(bool enabled);
+				// sets the idle time after which the status is requested,
+				// zero stops polling; can be called from any thread
+				void set_status_poll_interval(std::chrono::milliseconds interval);
+				// waits until the captures and journals released so far
+				// have written their remaining records,
+				// must not be called on the strand
+				void wait_for_detached_destructions();
+
+			private:
+				typedef std::array<std::uint8_t, max_response_frame_size> receive_buffer;
+
+			private:
+				// takes the submitted operations on the strand
+				void drain_submission_queue();
+				// takes the next operation from the submission queue
+				// if no operation is in progress,
+				// schedules a status poll if there is none
+				void start_next_operation();
+				// makes the queued operation with the highest priority current,
+				// completes the cancelled and expired ones on the way;
+				// returns false if no operation is queued
+				bool take_next_operation();
+				// replaces a current dispense from a single cassette
+				// with a coalesced dispense if a pending operation
+				// dispenses from the other cassette
+				void coalesce_current_operation(std::chrono::steady_clock::time_point now);
+				// moves submitted operations into the pending heap
+				// while it has room
+				void collect_submitted_operations();
+				// completes the pending operations that are cancelled
+				// or whose deadline has passed
+				void discard_pending_operations();
+				// starts the expiry timer for the earliest deadline
+				// of the pending operations
+				void schedule_expiry();
+				void handle_expiry(const boost::system::error_code& error);
+				// completes an operation that will not be started,
+				// returns false if it can still be started
+				bool discard_operation(operation_ptr& pending_operation, std::chrono::steady_clock::time_point now) const;
+				// ordering of the pending heap,
+				// the operation started first is at the top
+				static bool is_started_after(const operation_ptr& left, const operation_ptr& right);
+				// starts the poll timer if polling is enabled
+				void schedule_status_poll();
+				// requests the status if the engine is still idle
+				void handle_status_poll(const boost::system::error_code& error);
+				// builds the next command of the current operation
+				// and starts writing it
+				void start_command();
+				// builds the command frame of the current operation,
+				// returns false if the operation has no command
+				bool prepare_command();
+				// writes the command frame,
+				// preceded by ACK of the previous response if it is pending
+				void write_command();
+				void handle_command_written(const boost::system::error_code& error);
+				// starts waiting for ACK
+				// until the ack deadline of the command expires
+				void read_acknowledge();
+				void receive_acknowledge();
+				void handle_acknowledge(const boost::system::error_code& error);
+				// starts waiting for a response frame
+				// until the response deadline of the command expires
+				void read_response();
+				// reads the next chunk of the response frame
+				void receive_response();
+				void handle_response(const boost::system::error_code& error, std::size_t bytes_transferred);
+				// the deadline of the response has expired,
+				// NAK requests the response again
+				void handle_response_timeout();
+				// answers the response with ACK or NAK
+				void write_acknowledge(const std::uint8_t& acknowledge_status);
+				void handle_acknowledge_written(const boost::system::error_code& error, bool response_is_valid);
+				// passes the response data to the current operation
+				// and writes ACK together with the next command if there is one
+				void complete_command();
+				// completes the current operation with an error
+				void fail_command();
+				// appends the counts of the current operation to the journal
+				// if it is started and the operation dispenses bills
+				void record_journal(journal_record_type type);
+				// cancels the pending read of the transport
+				// when the timeout expires
+				void start_deadline(std::chrono::milliseconds timeout);
+				void stop_deadline();
+				void handle_deadline(const boost::system::error_code& error);
+				// returns the metrics of the current command code
+				command_counters& get_command_counters();
+				// makes a transport handler
+				// that invokes a function on the strand
+				template <typename Function>
+				lcdm_transport::io_handler make_io_handler(Function function);
+				// destroys a released capture or journal on a thread of its own,
+				// its destructor joins a flush thread and writes to the disk
+				template <typename T>
+				void destroy_detached(std::shared_ptr<T> released_object);
+
+			private:
+				boost::asio::strand<boost::asio::io_service::executor_type> strand;
+				std::unique_ptr<lcdm_transport> transport;
+				boost::asio::steady_timer deadline_timer;
+				boost::asio::steady_timer status_poll_timer;
+				// expires at the earliest deadline of the pending operations
+				boost::asio::steady_timer expiry_timer;
+				timeout_estimator deadlines;
+				const device_profile& profile;
+				// zero if polling is stopped
+				std::chrono::milliseconds status_poll_interval;
+				// the pool outlives the operations
+				// that are left in the submission queue
+				operation_pool operations;
+				bounded_queue<operation_ptr> submission_queue;
+				// set while a drain of the submission queue
+				// is posted to the strand
+				std::atomic<bool> drain_is_scheduled;
+				// binary heap of the submitted operations
+				// ordered by priority and submission
+				std::vector<operation_ptr> pending_operations;
+				std::uint64_t next_sequence_number;
+				bool dispense_coalescing_enabled;
+				operation_ptr current_operation;
+				// command frame with bcc
+				command_frame_buffer command_frame;
+				std::size_t command_frame_size;
+				// data received from the transport
+				receive_buffer received_data;
+				response_parser parser;
+				std::uint8_t acknowledge_status;
+				// code and bills of the last prepared command
+				std::uint8_t current_command_code;
+				std::uint32_t current_command_bills;
+				// the last prepared command is a probe
+				bool current_command_is_probe;
+				// start of the last command write
+				std::chrono::steady_clock::time_point command_write_time;
+				// time of the last ACK
+				std::chrono::steady_clock::time_point acknowledge_time;
+				// ACK of the last response is written with the next command
+				bool response_acknowledge_pending;
+				// set while ACK of the last response
+				// is written without a command
+				bool acknowledge_in_progress;
+				// tries left for the exchange,
+				// latencies are recorded only for the first one
+				int write_try_count;
+				int read_try_count;
+				bool deadline_expired;
+				bool closed;
+				metrics_recorder metrics;
+				// traffic capture, if it is started
+				std::shared_ptr<traffic_capture> capture;
+				// dispense journal, if it is started
+				std::shared_ptr<dispense_journal> journal;
+				// destructions of released captures and journals,
+				// the completed ones are dropped at the next release
+				std::vector<std::future<void>> detached_destructions;
+				std::mutex destruction_mutex;
+				// identifier of the current operation in the journal,
+				// zero until its first command is recorded
+				std::uint64_t current_journal_id;
+				// device state from the last status poll
+				state_cache device_state;
+
+				// maximum number of queued operations
+				// (a power of two)
+				static const std::size_t submission_queue_capacity = 64;
+		};
+
+		template <typename Operation, typename... Args>
+		operation_ptr engine::create_operation(Args&&... args) {
+			return this->operations.create<Operation>(std::forward<Args>(args)...);
+		}
+
+		template <typename Function>
+		lcdm_transport::io_handler engine::make_io_handler(Function function) {
+			boost::asio::strand<boost::asio::io_service::executor_type> handler_strand = this->strand;
+
+			return [handler_strand, function](const boost::system::error_code& error, std::size_t bytes_transferred) {
+				boost::asio::dispatch(handler_strand, [function, error, bytes_transferred]() {
+					function(error, bytes_transferred);
+				});
+			};
+		}
+
+	}
+
+}
+
+#endif // ENGINE_H
@@ -0,0 +1,26 @@
+#include "lcdm_frame.h"
+
+using namespace puloon;
+using namespace puloon::detail;
+
+std::size_t puloon::detail::build_command_frame(const command& command, command_frame_buffer& command_frame) {
+	std::size_t frame_size = 0;
+	command_frame[frame_size++] = eot;
+	command_frame[frame_size++] = id;
+	command_frame[frame_size++] = stx;
+	command_frame[frame_size++] = (std::uint8_t)command.code;
+	for (std::size_t i = 0; i < command.data_size; ++i) {
+		command_frame[frame_size++] = command.data[i];
+	}
+	command_frame[frame_size++] = etx;
+	command_frame[frame_size] = get_bcc(command_frame.data(), command_frame.data() + frame_size);
+	return frame_size + 1;
+}
+
+std::uint8_t puloon::detail::get_bcc(const std::uint8_t* begin, const std::uint8_t* end) {
+	std::uint8_t bcc = 0;
+	for (const std::uint8_t* i = begin; i != end; ++i) {
+		bcc ^= *i;
+	}
+	return bcc;
+}
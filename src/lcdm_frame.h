@@ -0,0 +1,45 @@
+#ifndef FRAME_H
+#define FRAME_H
+
+#include <array>
+#include "lcdm_operations.h"
+
+namespace puloon {
+
+	namespace detail {
+
+		// start of heading
+		const std::uint8_t soh = 0x01;
+		// end of transmission
+		const std::uint8_t eot = 0x04;
+		// id
+		const std::uint8_t id = 0x50;
+		// start of text
+		const std::uint8_t stx = 0x02;
+		// end of text
+		const std::uint8_t etx = 0x03;
+		// acknowledge
+		const std::uint8_t ack = 0x06;
+		// negative acknowledge
+		const std::uint8_t nak = 0x15;
+
+		// command frame: EOT, ID, STX, command code, command data, ETX, BCC
+		const std::size_t max_command_frame_size = max_command_data_size + 6;
+		// response frame: SOH, ID, STX, result data, ETX, BCC
+		const std::size_t max_response_frame_size = max_result_data_size + 5;
+
+		typedef std::array<std::uint8_t, max_command_frame_size> command_frame_buffer;
+
+		// constructs a command frame with bcc
+		// from a command, command data
+		// and control characters in place
+		// and returns the frame size
+		std::size_t build_command_frame(const command& command, command_frame_buffer& command_frame);
+		// calculates a block check character for a part of a frame
+		std::uint8_t get_bcc(const std::uint8_t* begin, const std::uint8_t* end);
+
+	}
+
+}
+
+#endif // FRAME_H
@@ -0,0 +1,306 @@
+#include "lcdm_journal.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <stdexcept>
+#include <type_traits>
+#include <boost/interprocess/exceptions.hpp>
+
+using namespace puloon;
+using namespace puloon::detail;
+
+// header of a journal file
+const char journal_file_magic[7] = { 'L', 'C', 'D', 'M', 'J', 'R', 'N' };
+const std::uint8_t journal_file_version = 1;
+// the records start at the first cache line after the header
+const std::size_t journal_header_size = 64;
+// completed dispenses reported by the recovery,
+// the ones whose results may not have reached the application
+const std::size_t recovered_completed_dispense_count = 16;
+
+const std::size_t dispense_journal::record_capacity;
+const std::chrono::milliseconds dispense_journal::flush_interval(20);
+
+static_assert(std::is_trivially_copyable<journal_record>::value, "records are copied into the mapping");
+static_assert(sizeof(journal_record) == 80, "records have no padding bytes outside the checksum");
+
+// checksum of a record with a zero checksum field
+static std::uint32_t get_record_checksum(const journal_record& current_record) {
+	journal_record unchecked_record = current_record;
+	unchecked_record.checksum = 0;
+
+	const unsigned char* data = (const unsigned char*)&unchecked_record;
+	std::uint32_t checksum = 2166136261u;
+	for (std::size_t i = 0; i < sizeof(unchecked_record); ++i) {
+		checksum = (checksum ^ data[i]) * 16777619u;
+	}
+
+	return checksum;
+}
+
+static void copy_bill_counts(const lcdm::bill_counts& counts, std::array<std::uint32_t, lcdm::bill_counts::capacity>& recorded_counts) {
+	for (std::size_t i = 0; i < recorded_counts.size(); ++i) {
+		recorded_counts[i] = counts[(lcdm::cassette_number)i];
+	}
+}
+
+static lcdm::bill_counts make_bill_counts(const std::array<std::uint32_t, lcdm::bill_counts::capacity>& recorded_counts, std::size_t cassette_count) {
+	lcdm::bill_counts counts(std::min(cassette_count, recorded_counts.size()));
+
+	for (std::size_t i = 0; i < counts.size(); ++i) {
+		counts[(lcdm::cassette_number)i] = recorded_counts[i];
+	}
+
+	return counts;
+}
+
+// writes the header and gives the file the size of the ring,
+// the records are zero
+static void create_journal_file(const std::string& file_name, std::uint32_t record_capacity) {
+	std::ofstream journal_file(file_name, std::ios::binary | std::ios::trunc);
+	char header[journal_header_size] = {};
+
+	std::memcpy(header, journal_file_magic, sizeof(journal_file_magic));
+	header[sizeof(journal_file_magic)] = (char)journal_file_version;
+	const std::uint32_t record_size = sizeof(journal_record);
+	std::memcpy(header + 8, &record_size, sizeof(record_size));
+	std::memcpy(header + 12, &record_capacity, sizeof(record_capacity));
+
+	journal_file.write(header, sizeof(header));
+	journal_file.seekp(journal_header_size + (record_capacity * sizeof(journal_record)) - 1);
+	journal_file.put(0);
+	journal_file.close();
+
+	if (!journal_file) {
+		throw std::runtime_error("unable to create journal file");
+	}
+}
+
+// maps the whole journal file
+static boost::interprocess::file_mapping map_journal_file(const std::string& file_name, std::uint32_t record_capacity) {
+	create_journal_file(file_name, record_capacity);
+
+	try {
+		return boost::interprocess::file_mapping(file_name.c_str(), boost::interprocess::read_write);
+	} catch (boost::interprocess::interprocess_exception) {
+		throw std::runtime_error("unable to create journal file");
+	}
+}
+
+static boost::interprocess::mapped_region map_journal_region(const boost::interprocess::file_mapping& journal_file) {
+	try {
+		return boost::interprocess::mapped_region(journal_file, boost::interprocess::read_write);
+	} catch (boost::interprocess::interprocess_exception) {
+		throw std::runtime_error("unable to create journal file");
+	}
+}
+
+dispense_journal::dispense_journal(const std::string& file_name) :
+	journal_file(map_journal_file(file_name, record_capacity)),
+	journal_region(map_journal_region(this->journal_file)),
+	records((journal_record*)((char*)this->journal_region.get_address() + journal_header_size)),
+	next_operation_id(1),
+	appended_record_count(0),
+	flushed_record_count(0),
+	flush_mutex(),
+	flush_condition(),
+	stopped(false),
+	flush_thread() {
+	this->flush_region(0, this->journal_region.get_size());
+	this->flush_thread = std::thread(&dispense_journal::operate, this);
+}
+
+dispense_journal::~dispense_journal() {
+	{
+		std::lock_guard<std::mutex> lock(this->flush_mutex);
+		this->stopped = true;
+	}
+
+	this->flush_condition.notify_one();
+	this->flush_thread.join();
+}
+
+std::uint64_t dispense_journal::start_operation() {
+	return this->next_operation_id++;
+}
+
+void dispense_journal::record(journal_record_type type, std::uint64_t operation_id, std::uint8_t command_code, const dispense_counts& counts) {
+	const std::uint64_t record_count = this->appended_record_count.load(std::memory_order_relaxed);
+	journal_record new_record;
+
+	new_record.sequence_number = record_count + 1;
+	new_record.operation_id = operation_id;
+	new_record.timestamp_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+		std::chrono::system_clock::now().time_since_epoch()).count();
+	new_record.type = type;
+	new_record.command_code = command_code;
+	new_record.cassette_count = (std::uint8_t)std::max(counts.bills_to_dispense.size(),
+		std::max(counts.dispensed_bills.size(), counts.rejected_bills.size()));
+	new_record.reserved = 0;
+	new_record.checksum = 0;
+	copy_bill_counts(counts.bills_to_dispense, new_record.bills_to_dispense);
+	copy_bill_counts(counts.dispensed_bills, new_record.dispensed_bills);
+	copy_bill_counts(counts.rejected_bills, new_record.rejected_bills);
+	new_record.checksum = get_record_checksum(new_record);
+
+	// the page cache keeps the record if the process dies,
+	// the flush thread protects it from a power loss
+	std::memcpy(&this->records[record_count % record_capacity], &new_record, sizeof(new_record));
+	this->appended_record_count.store(record_count + 1, std::memory_order_release);
+}
+
+void dispense_journal::operate() {
+	std::unique_lock<std::mutex> lock(this->flush_mutex);
+
+	while (!this->stopped) {
+		this->flush_condition.wait_for(lock, flush_interval);
+		this->flush();
+	}
+
+	// records appended before the journal is destroyed
+	this->flush();
+}
+
+void dispense_journal::flush() {
+	const std::uint64_t record_count = this->appended_record_count.load(std::memory_order_acquire);
+
+	if (record_count == this->flushed_record_count) {
+		return;
+	}
+
+	// every range of records appended since the last flush
+	// is written by a single system call
+	const std::size_t first_slot = (std::size_t)(this->flushed_record_count % record_capacity);
+	const std::size_t end_slot = (std::size_t)(record_count % record_capacity);
+
+	if ((record_count - this->flushed_record_count >= record_capacity) || (first_slot == end_slot)) {
+		this->flush_region(journal_header_size, record_capacity * sizeof(journal_record));
+	} else if (first_slot < end_slot) {
+		this->flush_region(journal_header_size + (first_slot * sizeof(journal_record)), (end_slot - first_slot) * sizeof(journal_record));
+	} else {
+		// the records wrap around the end of the ring
+		this->flush_region(journal_header_size + (first_slot * sizeof(journal_record)), (record_capacity - first_slot) * sizeof(journal_record));
+		this->flush_region(journal_header_size, end_slot * sizeof(journal_record));
+	}
+
+	this->flushed_record_count = record_count;
+}
+
+void dispense_journal::flush_region(std::size_t offset, std::size_t size) {
+	if (size == 0) {
+		return;
+	}
+
+	// the range starts at a page boundary
+	const std::size_t page_offset = offset % boost::interprocess::mapped_region::get_page_size();
+	this->journal_region.flush(offset - page_offset, size + page_offset, false);
+}
+
+std::vector<journal_record> puloon::detail::read_journal_file(const std::string& file_name) {
+	std::ifstream journal_file(file_name, std::ios::binary);
+	std::vector<journal_record> records;
+
+	if (!journal_file.is_open()) {
+		return records;
+	}
+
+	char header[journal_header_size];
+	std::uint32_t record_size = 0;
+	std::uint32_t record_capacity = 0;
+
+	if (journal_file.read(header, sizeof(header))) {
+		std::memcpy(&record_size, header + 8, sizeof(record_size));
+		std::memcpy(&record_capacity, header + 12, sizeof(record_capacity));
+	}
+
+	if ((!journal_file)
+		|| (std::memcmp(header, journal_file_magic, sizeof(journal_file_magic)) != 0)
+		|| (header[sizeof(journal_file_magic)] != (char)journal_file_version)
+		|| (record_size != sizeof(journal_record))) {
+		throw std::runtime_error("unable to read journal file");
+	}
+
+	journal_record current_record;
+	for (std::uint32_t i = 0; i < record_capacity; ++i) {
+		if (!journal_file.read((char*)&current_record, sizeof(current_record))) {
+			throw std::runtime_error("unable to read journal file");
+		}
+
+		if ((current_record.sequence_number != 0)
+			&& (current_record.checksum == get_record_checksum(current_record))) {
+			records.push_back(current_record);
+		}
+	}
+
+	std::sort(records.begin(), records.end(), [](const journal_record& first, const journal_record& second) {
+		return first.sequence_number < second.sequence_number;
+	});
+
+	return records;
+}
+
+std::vector<lcdm::journaled_dispense> puloon::detail::find_recoverable_dispenses(const std::vector<journal_record>& records) {
+	std::map<std::uint64_t, lcdm::journaled_dispense> dispenses;
+
+	for (const journal_record& current_record : records) {
+		std::map<std::uint64_t, lcdm::journaled_dispense>::iterator found_dispense = dispenses.find(current_record.operation_id);
+
+		if (found_dispense == dispenses.end()) {
+			// the bills left to dispense before the first record
+			// of the operation is the request
+			lcdm::journaled_dispense new_dispense;
+			new_dispense.operation_id = current_record.operation_id;
+			new_dispense.outcome = lcdm::journaled_outcome::in_progress;
+			new_dispense.command_pending = false;
+			new_dispense.requested_bills = make_bill_counts(current_record.bills_to_dispense, current_record.cassette_count);
+			for (std::size_t i = 0; i < new_dispense.requested_bills.size(); ++i) {
+				new_dispense.requested_bills[(lcdm::cassette_number)i] += current_record.dispensed_bills[i];
+			}
+			found_dispense = dispenses.insert(std::make_pair(current_record.operation_id, new_dispense)).first;
+		}
+
+		lcdm::journaled_dispense& current_dispense = found_dispense->second;
+		current_dispense.dispensed_bills = make_bill_counts(current_record.dispensed_bills, current_record.cassette_count);
+		current_dispense.rejected_bills = make_bill_counts(current_record.rejected_bills, current_record.cassette_count);
+		current_dispense.update_time = std::chrono::system_clock::time_point(std::chrono::milliseconds(current_record.timestamp_ms));
+
+		switch (current_record.type) {
+			case journal_record_type::command_sent:
+			case journal_record_type::result_decoded:
+				current_dispense.command_pending = (current_record.type == journal_record_type::command_sent);
+				break;
+			case journal_record_type::operation_completed:
+				current_dispense.outcome = lcdm::journaled_outcome::completed;
+				current_dispense.command_pending = false;
+				break;
+			case journal_record_type::operation_failed:
+				// the last command stays pending,
+				// its bills may have left the cassettes
+				current_dispense.outcome = lcdm::journaled_outcome::failed;
+				break;
+		}
+	}
+
+	// the identifiers of a journal follow the order the dispenses were started
+	std::size_t completed_dispense_count = 0;
+	for (const std::pair<const std::uint64_t, lcdm::journaled_dispense>& current_dispense : dispenses) {
+		if (current_dispense.second.outcome == lcdm::journaled_outcome::completed) {
+			++completed_dispense_count;
+		}
+	}
+
+	std::vector<lcdm::journaled_dispense> recoverable_dispenses;
+	recoverable_dispenses.reserve(dispenses.size());
+	for (const std::pair<const std::uint64_t, lcdm::journaled_dispense>& current_dispense : dispenses) {
+		if (current_dispense.second.outcome == lcdm::journaled_outcome::completed) {
+			if (completed_dispense_count-- > recovered_completed_dispense_count) {
+				continue;
+			}
+		}
+
+		recoverable_dispenses.push_back(current_dispense.second);
+	}
+
+	return recoverable_dispenses;
+}
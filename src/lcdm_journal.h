@@ -0,0 +1,122 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include "lcdm.h"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include "lcdm_operations.h"
+
+namespace puloon {
+
+	namespace detail {
+
+		enum class journal_record_type : std::uint8_t {
+			// a dispense command is about to be written
+			command_sent = 1,
+			// the result of a dispense command has been decoded,
+			// written before the handlers of the operation are called
+			result_decoded = 2,
+			// the operation is completed with the counts of the device
+			operation_completed = 3,
+			// the operation failed without a result of the device
+			// (an expired deadline, a lost connection, an unexpected response),
+			// the bills of its last command are not known
+			operation_failed = 4
+		};
+
+		// one entry of the journal in the byte order of the host;
+		// every record carries the counts of its operation
+		// so the last record of an operation is enough to recover it
+		struct journal_record {
+			// position of the record in the journal from 1,
+			// zero for a slot that has never been written
+			std::uint64_t sequence_number;
+			std::uint64_t operation_id;
+			// milliseconds since the epoch of the system clock
+			std::int64_t timestamp_ms;
+			journal_record_type type;
+			std::uint8_t command_code;
+			std::uint8_t cassette_count;
+			std::uint8_t reserved;
+			// FNV-1a of the record with a zero checksum,
+			// a record torn by a crash does not match it
+			std::uint32_t checksum;
+			std::array<std::uint32_t, lcdm::bill_counts::capacity> bills_to_dispense;
+			std::array<std::uint32_t, lcdm::bill_counts::capacity> dispensed_bills;
+			std::array<std::uint32_t, lcdm::bill_counts::capacity> rejected_bills;
+		};
+
+		// append-only journal of the dispense commands and results
+		// in a memory-mapped file; records are copied into the mapping
+		// without system calls and written to the disk in batches
+		// on a separate thread, the process may die at any time;
+		// the file consists of a header ("LCDMJRN", a version byte,
+		// the record size and the record capacity) and a ring of records
+		// that overwrites the oldest ones when it is full
+		class dispense_journal {
+			public:
+				// creates the journal file, replacing an existing one,
+				// and starts the flush thread;
+				// throws std::runtime_error if the file cannot be created
+				explicit dispense_journal(const std::string& file_name);
+				// writes the remaining records to the disk
+				~dispense_journal();
+
+				dispense_journal(const dispense_journal&) = delete;
+				dispense_journal& operator=(const dispense_journal&) = delete;
+
+				// returns an identifier for a new operation;
+				// records are appended by a single thread at a time
+				std::uint64_t start_operation();
+				void record(journal_record_type type, std::uint64_t operation_id, std::uint8_t command_code, const dispense_counts& counts);
+
+			private:
+				// writes the appended records to the disk
+				// until the journal is destroyed
+				void operate();
+				void flush();
+				// writes a range of the mapping to the disk
+				void flush_region(std::size_t offset, std::size_t size);
+
+			private:
+				boost::interprocess::file_mapping journal_file;
+				boost::interprocess::mapped_region journal_region;
+				journal_record* records;
+				std::uint64_t next_operation_id;
+				// records appended so far
+				std::atomic<std::uint64_t> appended_record_count;
+				// records on the disk, used by the flush thread
+				std::uint64_t flushed_record_count;
+				std::mutex flush_mutex;
+				std::condition_variable flush_condition;
+				bool stopped;
+				std::thread flush_thread;
+
+				// number of records in the ring,
+				// far more than the commands of an operation
+				static const std::size_t record_capacity = 8192;
+				static const std::chrono::milliseconds flush_interval;
+		};
+
+		// reads the valid records of a journal file in the order they were appended;
+		// a file that does not exist has no records,
+		// throws std::runtime_error if the file is not a journal
+		std::vector<journal_record> read_journal_file(const std::string& file_name);
+		// folds the records into the dispenses in progress, the failed ones
+		// and the last completed ones, in the order they were started
+		std::vector<lcdm::journaled_dispense> find_recoverable_dispenses(const std::vector<journal_record>& records);
+
+	}
+
+}
+
+#endif // JOURNAL_H
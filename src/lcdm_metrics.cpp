@@ -0,0 +1,164 @@
+#include "lcdm_metrics_recorder.h"
+#include <algorithm>
+#include "lcdm_operations.h"
+
+using namespace puloon;
+using namespace puloon::detail;
+
+const std::size_t latency_histogram::bucket_count;
+const std::size_t metrics_recorder::tracked_code_count;
+
+const std::array<std::uint8_t, metrics_recorder::tracked_code_count> metrics_recorder::tracked_codes = { {
+	(std::uint8_t)command_code::purge,
+	(std::uint8_t)command_code::upper_dispense,
+	(std::uint8_t)command_code::status,
+	(std::uint8_t)command_code::rom_version,
+	(std::uint8_t)command_code::lower_dispense,
+	(std::uint8_t)command_code::up_low_dispense,
+	(std::uint8_t)command_code::upper_test_dispense,
+	(std::uint8_t)command_code::lower_test_dispense,
+	(std::uint8_t)command_code::multi_dispense
+} };
+
+latency_histogram::latency_histogram() :
+	buckets(),
+	sample_count(0),
+	total_time(0) { }
+
+std::chrono::microseconds latency_histogram::get_percentile(double fraction) const {
+	if (this->sample_count == 0) {
+		return std::chrono::microseconds(0);
+	}
+
+	const std::uint64_t rank = (std::uint64_t)(fraction * (double)this->sample_count);
+	std::uint64_t samples_below = 0;
+
+	for (std::size_t i = 0; i < bucket_count; ++i) {
+		samples_below += this->buckets[i];
+
+		if (samples_below > rank) {
+			return std::chrono::microseconds((std::uint64_t)1 << i);
+		}
+	}
+
+	return std::chrono::microseconds((std::uint64_t)1 << (bucket_count - 1));
+}
+
+std::chrono::microseconds latency_histogram::get_mean() const {
+	if (this->sample_count == 0) {
+		return std::chrono::microseconds(0);
+	}
+
+	return this->total_time / this->sample_count;
+}
+
+command_metrics::command_metrics() :
+	commands(0),
+	responses(0),
+	failed_commands(0),
+	command_retries(0),
+	received_naks(0),
+	acknowledge_timeouts(0),
+	sent_naks(0),
+	response_timeouts(0),
+	corrupted_responses(0),
+	format_errors(0),
+	queue_wait(),
+	acknowledge_latency(),
+	response_latency(),
+	status_codes() { }
+
+atomic_latency_histogram::atomic_latency_histogram() :
+	buckets(),
+	sample_count(0),
+	total_microseconds(0) { }
+
+void atomic_latency_histogram::record(std::chrono::steady_clock::duration latency) {
+	std::uint64_t microseconds = (std::uint64_t)std::max<std::int64_t>(
+		std::chrono::duration_cast<std::chrono::microseconds>(latency).count(), 0);
+
+	// index of the highest bit set
+	std::size_t bucket = 0;
+	for (std::uint64_t value = microseconds; (value != 0) && (bucket < latency_histogram::bucket_count - 1); value >>= 1) {
+		++bucket;
+	}
+
+	metrics_recorder::increment(this->buckets[bucket]);
+	metrics_recorder::increment(this->sample_count);
+	this->total_microseconds.store(this->total_microseconds.load(std::memory_order_relaxed) + microseconds, std::memory_order_relaxed);
+}
+
+void atomic_latency_histogram::load(latency_histogram& histogram) const {
+	for (std::size_t i = 0; i < latency_histogram::bucket_count; ++i) {
+		histogram.buckets[i] = this->buckets[i].load(std::memory_order_relaxed);
+	}
+
+	histogram.sample_count = this->sample_count.load(std::memory_order_relaxed);
+	histogram.total_time = std::chrono::microseconds(this->total_microseconds.load(std::memory_order_relaxed));
+}
+
+command_counters::command_counters() :
+	commands(0),
+	responses(0),
+	failed_commands(0),
+	command_retries(0),
+	received_naks(0),
+	acknowledge_timeouts(0),
+	sent_naks(0),
+	response_timeouts(0),
+	corrupted_responses(0),
+	format_errors(0),
+	queue_wait(),
+	acknowledge_latency(),
+	response_latency(),
+	status_codes() { }
+
+metrics_recorder::metrics_recorder() :
+	counters(),
+	counter_indices() {
+	this->counter_indices.fill((std::uint8_t)tracked_code_count);
+
+	for (std::size_t i = 0; i < tracked_codes.size(); ++i) {
+		this->counter_indices[tracked_codes[i]] = (std::uint8_t)i;
+	}
+}
+
+command_counters& metrics_recorder::get_counters(std::uint8_t code) {
+	return this->counters[this->counter_indices[code]];
+}
+
+lcdm_metrics metrics_recorder::get_snapshot() const {
+	lcdm_metrics snapshot;
+
+	for (std::size_t i = 0; i < this->counters.size(); ++i) {
+		const command_counters& current_counters = this->counters[i];
+		const std::uint64_t commands = current_counters.commands.load(std::memory_order_relaxed);
+
+		if (commands == 0) {
+			continue;
+		}
+
+		const std::uint8_t code = (i < tracked_codes.size()) ? tracked_codes[i] : (std::uint8_t)command_code::unknown;
+		command_metrics& current_metrics = snapshot.commands[code];
+
+		current_metrics.commands = commands;
+		current_metrics.responses = current_counters.responses.load(std::memory_order_relaxed);
+		current_metrics.failed_commands = current_counters.failed_commands.load(std::memory_order_relaxed);
+		current_metrics.command_retries = current_counters.command_retries.load(std::memory_order_relaxed);
+		current_metrics.received_naks = current_counters.received_naks.load(std::memory_order_relaxed);
+		current_metrics.acknowledge_timeouts = current_counters.acknowledge_timeouts.load(std::memory_order_relaxed);
+		current_metrics.sent_naks = current_counters.sent_naks.load(std::memory_order_relaxed);
+		current_metrics.response_timeouts = current_counters.response_timeouts.load(std::memory_order_relaxed);
+		current_metrics.corrupted_responses = current_counters.corrupted_responses.load(std::memory_order_relaxed);
+		current_metrics.format_errors = current_counters.format_errors.load(std::memory_order_relaxed);
+		current_counters.queue_wait.load(current_metrics.queue_wait);
+		current_counters.acknowledge_latency.load(current_metrics.acknowledge_latency);
+		current_counters.response_latency.load(current_metrics.response_latency);
+
+		for (std::size_t status_code = 0; status_code < current_metrics.status_codes.size(); ++status_code) {
+			current_metrics.status_codes[status_code] = current_counters.status_codes[status_code].load(std::memory_order_relaxed);
+		}
+	}
+
+	return snapshot;
+}
@@ -0,0 +1,86 @@
+#ifndef METRICS_RECORDER_H
+#define METRICS_RECORDER_H
+
+#include "lcdm_metrics.h"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+namespace puloon {
+
+	namespace detail {
+
+		// histogram that is written by the engine
+		// and read by any thread
+		class atomic_latency_histogram {
+			public:
+				atomic_latency_histogram();
+
+				void record(std::chrono::steady_clock::duration latency);
+				void load(latency_histogram& histogram) const;
+
+			private:
+				std::array<std::atomic<std::uint64_t>, latency_histogram::bucket_count> buckets;
+				std::atomic<std::uint64_t> sample_count;
+				std::atomic<std::uint64_t> total_microseconds;
+		};
+
+		struct command_counters {
+			command_counters();
+
+			std::atomic<std::uint64_t> commands;
+			std::atomic<std::uint64_t> responses;
+			std::atomic<std::uint64_t> failed_commands;
+			std::atomic<std::uint64_t> command_retries;
+			std::atomic<std::uint64_t> received_naks;
+			std::atomic<std::uint64_t> acknowledge_timeouts;
+			std::atomic<std::uint64_t> sent_naks;
+			std::atomic<std::uint64_t> response_timeouts;
+			std::atomic<std::uint64_t> corrupted_responses;
+			std::atomic<std::uint64_t> format_errors;
+			atomic_latency_histogram queue_wait;
+			atomic_latency_histogram acknowledge_latency;
+			atomic_latency_histogram response_latency;
+			std::array<std::atomic<std::uint64_t>, 256> status_codes;
+		};
+
+		// metrics of the command exchange;
+		// written only on the strand of the engine,
+		// so counters are updated without read-modify-write instructions,
+		// and read by any thread with relaxed loads
+		class metrics_recorder {
+			public:
+				metrics_recorder();
+
+				metrics_recorder(const metrics_recorder&) = delete;
+				metrics_recorder& operator=(const metrics_recorder&) = delete;
+
+				// returns the counters of a command code,
+				// unknown codes share the last entry
+				command_counters& get_counters(std::uint8_t code);
+				lcdm_metrics get_snapshot() const;
+
+				// increments a counter that has a single writer
+				static void increment(std::atomic<std::uint64_t>& counter) {
+					counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+				}
+
+			private:
+				static const std::size_t tracked_code_count = 9;
+
+				// command codes with separate counters
+				static const std::array<std::uint8_t, tracked_code_count> tracked_codes;
+
+				// counters of the tracked codes in their order
+				// followed by the shared entry of unknown codes
+				std::array<command_counters, tracked_code_count + 1> counters;
+				// entry of the counters indexed by command code
+				std::array<std::uint8_t, 256> counter_indices;
+		};
+
+	}
+
+}
+
+#endif // METRICS_RECORDER_H
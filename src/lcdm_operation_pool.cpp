@@ -0,0 +1,36 @@
+#include "lcdm_operation_pool.h"
+#include <cassert>
+
+using namespace puloon;
+using namespace puloon::detail;
+
+void operation_deleter::operator()(operation* released_operation) const {
+	if (this->pool) {
+		this->pool->destroy(released_operation);
+	} else {
+		delete released_operation;
+	}
+}
+
+operation_pool::operation_pool(std::size_t capacity) :
+	slots(new slot[capacity]),
+	slot_count(capacity),
+	free_slots(capacity) {
+	for (std::size_t i = 0; i < this->slot_count; ++i) {
+		slot* free_slot = &this->slots[i];
+		this->free_slots.try_push(std::move(free_slot));
+	}
+}
+
+void operation_pool::destroy(operation* released_operation) {
+	// the slot is found by address, since a pointer to the base class
+	// does not have to point to the beginning of the slot
+	const std::uintptr_t slots_begin = (std::uintptr_t)this->slots.get();
+	const std::size_t slot_index = ((std::uintptr_t)released_operation - slots_begin) / sizeof(slot);
+	assert(slot_index < this->slot_count);
+
+	released_operation->~operation();
+
+	slot* free_slot = &this->slots[slot_index];
+	this->free_slots.try_push(std::move(free_slot));
+}
@@ -0,0 +1,68 @@
+#ifndef OPERATION_POOL_H
+#define OPERATION_POOL_H
+
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include "lcdm_bounded_queue.h"
+#include "lcdm_operations.h"
+
+namespace puloon {
+
+	namespace detail {
+
+		// fixed set of recycled storage slots for operations;
+		// slots are taken and returned without locks,
+		// when all slots are in use operations are allocated on the heap
+		class operation_pool {
+			public:
+				explicit operation_pool(std::size_t capacity);
+
+				operation_pool(const operation_pool&) = delete;
+				operation_pool& operator=(const operation_pool&) = delete;
+
+				// constructs an operation in a free slot,
+				// can be called from any thread
+				template <typename Operation, typename... Args>
+				operation_ptr create(Args&&... args);
+
+			private:
+				typedef std::aligned_union<0, purge_operation, status_operation, probe_operation, dispense_operation, coalesced_dispense_operation>::type slot;
+
+				friend struct operation_deleter;
+
+				// destroys an operation that lives in a slot
+				// and makes the slot free
+				void destroy(operation* released_operation);
+
+			private:
+				std::unique_ptr<slot[]> slots;
+				std::size_t slot_count;
+				bounded_queue<slot*> free_slots;
+		};
+
+		template <typename Operation, typename... Args>
+		operation_ptr operation_pool::create(Args&&... args) {
+			static_assert(std::is_base_of<operation, Operation>::value, "only operations can be pooled");
+			static_assert((sizeof(Operation) <= sizeof(slot)) && (alignof(Operation) <= alignof(slot)), "operation does not fit the pool slot");
+
+			slot* free_slot = nullptr;
+
+			if (!this->free_slots.try_pop(free_slot)) {
+				return operation_ptr(new Operation(std::forward<Args>(args)...), operation_deleter{ nullptr });
+			}
+
+			try {
+				return operation_ptr(new (free_slot) Operation(std::forward<Args>(args)...), operation_deleter{ this });
+			} catch (...) {
+				this->free_slots.try_push(std::move(free_slot));
+				throw;
+			}
+		}
+
+	}
+
+}
+
+#endif // OPERATION_POOL_H
@@ -1,262 +1,521 @@
 #include "lcdm_operations.h"
+#include <algorithm>
 #include <cassert>
-#include <exception>
+#include <stdexcept>
 
 using namespace puloon;
+using namespace puloon::detail;
 
-const std::map<std::uint8_t, lcdm::operation_status> operation_statuses_by_code {
-	{ 0x30, lcdm::operation_status::good },
-	{ 0x31, lcdm::operation_status::normal_stop },
-	{ 0x32, lcdm::operation_status::pickup_error },
-	{ 0x33, lcdm::operation_status::jam },
-	{ 0x34, lcdm::operation_status::overflow_bill },
-	{ 0x35, lcdm::operation_status::jam },
-	{ 0x36, lcdm::operation_status::jam },
-	{ 0x37, lcdm::operation_status::device_error },
-	{ 0x38, lcdm::operation_status::bill_end },
-	{ 0x3a, lcdm::operation_status::counting_error },
-	{ 0x3b, lcdm::operation_status::note_request_error },
-	{ 0x3c, lcdm::operation_status::counting_error },
-	{ 0x3d, lcdm::operation_status::counting_error },
-	{ 0x3f, lcdm::operation_status::device_error },
-	{ 0x40, lcdm::operation_status::bill_end },
-	{ 0x41, lcdm::operation_status::device_error },
-	{ 0x42, lcdm::operation_status::jam },
-	{ 0x43, lcdm::operation_status::timeout },
-	{ 0x44, lcdm::operation_status::over_reject },
-	{ 0x45, lcdm::operation_status::device_error },
-	{ 0x46, lcdm::operation_status::device_error },
-	{ 0x47, lcdm::operation_status::timeout },
-	{ 0x48, lcdm::operation_status::jam },
-	{ 0x49, lcdm::operation_status::device_error },
-	{ 0x4a, lcdm::operation_status::device_error },
-	{ 0x4c, lcdm::operation_status::jam },
-	{ 0x4e, lcdm::operation_status::jam }
-};
-
-lcdm::purge_operation::purge_operation() :
+const std::uint32_t dispense_operation::max_dispensable_bills;
+
+constexpr cassette_field command_descriptor<command_code::upper_dispense>::cassette_fields[];
+constexpr cassette_field command_descriptor<command_code::lower_dispense>::cassette_fields[];
+constexpr cassette_field command_descriptor<command_code::up_low_dispense>::cassette_fields[];
+constexpr cassette_field command_descriptor<command_code::multi_dispense>::cassette_fields[];
+
+purge_operation::purge_operation(const lcdm::purge_handler& handler) :
 	operation(),
 	operation_is_completed(false),
 	error(false),
-	result() { }
+	handler(handler) { }
 
-lcdm::command lcdm::purge_operation::get_command() const {
+command purge_operation::get_command() const {
 	if (this->is_completed()) {
-		throw std::exception("operation is completed");
+		throw std::runtime_error("operation is completed");
 	}
 
-	return command(command_code::purge, std::vector<std::uint8_t>(), result_data_size);
+	return make_command<command_code::purge>();
 }
 
-void lcdm::purge_operation::handle_result(const std::vector<std::uint8_t>& result_data) {
+void purge_operation::handle_result(const data_view& result_data) {
 	if (this->is_completed()) {
-		throw std::exception("operation is completed");
+		throw std::runtime_error("operation is completed");
 	}
 
-	if (result_data.size() == result_data_size) {
+	typedef command_descriptor<command_code::purge> descriptor;
+
+	if (result_data.size() == descriptor::result_data_size) {
 		if ((command_code)result_data[0] == command_code::purge) {
-			try {
-				this->result.set_value(operation_statuses_by_code.at(result_data[1]));
-				this->operation_is_completed = true;
-			} catch (std::out_of_range) {
-				this->result.set_exception(std::make_exception_ptr(std::exception("unknown operation status")));
-				this->operation_is_completed = true;
+			const status_entry& current_status = operation_statuses[result_data[descriptor::status_offset]];
+			this->operation_is_completed = true;
+
+			if (current_status.is_known) {
+				this->handler(nullptr, current_status.status);
+			} else {
+				this->handler(std::make_exception_ptr(std::runtime_error("unknown operation status")), lcdm::operation_status());
 			}
 		} else {
-			throw std::exception("unexpected command");
+			throw std::runtime_error("unexpected command");
 		}
 	} else {
-		throw std::exception("incorrect result data format");
+		throw std::runtime_error("incorrect result data format");
 	}
 }
 
-bool lcdm::purge_operation::is_completed() const {
+bool purge_operation::is_completed() const {
 	return ((this->operation_is_completed) || (this->error));
 }
 
-void lcdm::purge_operation::set_error() {
-	this->result.set_value(operation_status::connection_error);
+void purge_operation::set_error() {
 	this->error = true;
+	this->handler(nullptr, lcdm::operation_status::connection_error);
 }
 
-std::future<lcdm::operation_status> lcdm::purge_operation::get_future_result() {
-	return this->result.get_future();
+void purge_operation::cancel(lcdm::operation_status status) {
+	this->error = true;
+	this->handler(nullptr, status);
 }
 
-lcdm::dispense_operation::dispense_operation(const bill_quantity_by_cassette& requested_bills) :
+status_operation::status_operation(state_cache& cache) :
 	operation(),
-	upper_bills_to_dispense(0),
-	lower_bills_to_dispense(0),
-	upper_dispensed_bills(0),
-	lower_dispensed_bills(0),
-	upper_rejected_bills(0),
-	lower_rejected_bills(0),
+	operation_is_completed(false),
 	error(false),
-	result() {
-	bill_quantity_by_cassette::const_iterator cassette_iterator = requested_bills.find(((std::uint32_t)cassette::upper));
+	cache(cache) { }
 
-	if (cassette_iterator != requested_bills.end()) {
-		// upper cassette is requested
-		cassette_iterator = requested_bills.find(((std::uint32_t)cassette::lower));
+command status_operation::get_command() const {
+	if (this->is_completed()) {
+		throw std::runtime_error("operation is completed");
+	}
 
-		if (cassette_iterator != requested_bills.end()) {
-			// lower cassette is requested
-			this->upper_bills_to_dispense = requested_bills.at((std::uint32_t)cassette::upper);
-			this->lower_bills_to_dispense = requested_bills.at((std::uint32_t)cassette::lower);
-		} else {
-			// only upper cassette is requested
-			this->upper_bills_to_dispense = requested_bills.at((std::uint32_t)cassette::upper);
-		}
+	return make_command<command_code::status>();
+}
+
+void status_operation::handle_result(const data_view& result_data) {
+	if (this->is_completed()) {
+		throw std::runtime_error("operation is completed");
+	}
+
+	typedef command_descriptor<command_code::status> descriptor;
+
+	if (result_data.size() != descriptor::result_data_size) {
+		throw std::runtime_error("incorrect result data format");
+	}
+
+	if ((command_code)result_data[0] != command_code::status) {
+		throw std::runtime_error("unexpected command");
+	}
+
+	const status_entry& last_status = operation_statuses[result_data[descriptor::status_offset]];
+
+	this->operation_is_completed = true;
+	this->cache.store_status(last_status.is_known ? last_status.status : lcdm::operation_status::device_error,
+		result_data[descriptor::sensor_0_offset], result_data[descriptor::sensor_1_offset]);
+}
+
+bool status_operation::is_completed() const {
+	return ((this->operation_is_completed) || (this->error));
+}
+
+void status_operation::set_error() {
+	this->error = true;
+	this->cache.store_failure();
+}
+
+void status_operation::cancel(lcdm::operation_status) {
+	this->error = true;
+}
+
+probe_operation::probe_operation(state_cache& cache, const lcdm::open_handler& handler) :
+	operation(),
+	rom_version_is_received(false),
+	operation_is_completed(false),
+	error(false),
+	cache(cache),
+	capabilities(),
+	handler(handler) { }
+
+command probe_operation::get_command() const {
+	if (this->is_completed()) {
+		throw std::runtime_error("operation is completed");
+	}
+
+	command probe_command = this->rom_version_is_received
+		? make_command<command_code::status>()
+		: make_command<command_code::rom_version>();
+	probe_command.is_probe = true;
+
+	return probe_command;
+}
+
+void probe_operation::handle_result(const data_view& result_data) {
+	if (this->is_completed()) {
+		throw std::runtime_error("operation is completed");
+	}
+
+	if (this->rom_version_is_received) {
+		this->handle_status(result_data);
 	} else {
-		cassette_iterator = requested_bills.find(((std::uint32_t)cassette::lower));
+		this->handle_rom_version(result_data);
+	}
+}
 
-		if (cassette_iterator != requested_bills.end()) {
-			// only lower cassette is requested
-			this->lower_bills_to_dispense = requested_bills.at((std::uint32_t)cassette::lower);
-		} else {
-			// no cassette is requested
-			throw std::exception("invalid dispense request");
-		}
+bool probe_operation::is_completed() const {
+	return ((this->operation_is_completed) || (this->error));
+}
+
+void probe_operation::set_error() {
+	this->error = true;
+	this->cache.store_failure();
+	this->handler(nullptr, lcdm::operation_status::connection_error);
+}
+
+void probe_operation::cancel(lcdm::operation_status status) {
+	this->error = true;
+	this->handler(nullptr, status);
+}
+
+void probe_operation::handle_rom_version(const data_view& result_data) {
+	typedef command_descriptor<command_code::rom_version> descriptor;
+
+	if (result_data.size() != descriptor::result_data_size) {
+		throw std::runtime_error("incorrect result data format");
+	}
+
+	if ((command_code)result_data[0] != command_code::rom_version) {
+		throw std::runtime_error("unexpected command");
+	}
+
+	for (std::size_t i = 0; i < descriptor::version_size; ++i) {
+		this->capabilities.rom_version[i] = (char)result_data[descriptor::version_offset + i];
+	}
+
+	this->rom_version_is_received = true;
+}
+
+void probe_operation::handle_status(const data_view& result_data) {
+	typedef command_descriptor<command_code::status> descriptor;
+
+	if (result_data.size() != descriptor::result_data_size) {
+		throw std::runtime_error("incorrect result data format");
+	}
+
+	if ((command_code)result_data[0] != command_code::status) {
+		throw std::runtime_error("unexpected command");
 	}
+
+	const status_entry& last_status = operation_statuses[result_data[descriptor::status_offset]];
+
+	this->operation_is_completed = true;
+	this->cache.store_status(last_status.is_known ? last_status.status : lcdm::operation_status::device_error,
+		result_data[descriptor::sensor_0_offset], result_data[descriptor::sensor_1_offset]);
+
+	this->capabilities.is_known = true;
+	this->capabilities.state = this->cache.load();
+	this->cache.store_capabilities(this->capabilities);
+	this->handler(nullptr, lcdm::operation_status::good);
 }
 
-lcdm::command lcdm::dispense_operation::get_command() const {
+dispense_operation::dispense_operation(const device_profile& profile, const lcdm::bill_counts& requested_bills, const lcdm::dispense_handler& handler) :
+	dispense_operation(profile, requested_bills, lcdm::dispense_progress_handler(), handler) { }
+
+dispense_operation::dispense_operation(const device_profile& profile, const lcdm::bill_counts& requested_bills, const lcdm::dispense_progress_handler& progress_handler, const lcdm::dispense_handler& handler) :
+	operation(),
+	profile(profile),
+	bills_to_dispense(profile.cassette_count),
+	dispensed_bills(profile.cassette_count),
+	rejected_bills(profile.cassette_count),
+	completed_rounds(0),
+	error(false),
+	progress_handler(progress_handler),
+	handler(handler) {
+	if (requested_bills.size() > profile.cassette_count) {
+		// the device has no such cassette
+		throw std::runtime_error("invalid dispense request");
+	}
+
+	for (std::size_t i = 0; i < requested_bills.size(); ++i) {
+		this->bills_to_dispense[(lcdm::cassette_number)i] = requested_bills[(lcdm::cassette_number)i];
+	}
+
+	if (this->is_completed()) {
+		// no bills are requested
+		throw std::runtime_error("invalid dispense request");
+	}
+}
+
+command dispense_operation::get_command() const {
 	if (this->error) {
-		throw std::exception("operation is completed");
-	}
-
-	if (this->upper_bills_to_dispense > 0) {
-		// upper cassette is requested
-		if (this->lower_bills_to_dispense > 0) {
-			// lower cassette is requested
-			// upper and lower dispense command is generated
-			std::vector<std::uint8_t> current_command_data;
-			this->write_bills_count(current_command_data, this->upper_bills_to_dispense);
-			this->write_bills_count(current_command_data, this->lower_bills_to_dispense);
-			return command(command_code::up_low_dispense, current_command_data, double_cassette_result_data_size);
-		} else {
-			// only upper cassette is requested
-			// upper dispense command is generated
-			std::vector<std::uint8_t> current_command_data;
-			this->write_bills_count(current_command_data, this->upper_bills_to_dispense);
-			return command(command_code::upper_dispense, current_command_data, single_cassette_result_data_size);
+		throw std::runtime_error("operation is completed");
+	}
+
+	std::uint8_t requested_mask = 0;
+	for (std::size_t i = 0; i < this->bills_to_dispense.size(); ++i) {
+		if (this->bills_to_dispense[(lcdm::cassette_number)i] > 0) {
+			requested_mask |= (std::uint8_t)(1 << i);
 		}
-	} else if (this->lower_bills_to_dispense > 0) {
-		// only lower cassette is requested
-		// lower dispense command is generated
-		std::vector<std::uint8_t> current_command_data;
-		this->write_bills_count(current_command_data, this->lower_bills_to_dispense);
-		return command(command_code::lower_dispense, current_command_data, single_cassette_result_data_size);
-	} else {
+	}
+
+	if (requested_mask == 0) {
 		// no bills to dispense
-		throw std::exception("operation is completed");
+		throw std::runtime_error("operation is completed");
+	}
+
+	switch (this->profile.select_dispense_command(requested_mask)) {
+		case command_code::upper_dispense:
+			return this->build_command<command_code::upper_dispense>();
+		case command_code::lower_dispense:
+			return this->build_command<command_code::lower_dispense>();
+		case command_code::up_low_dispense:
+			return this->build_command<command_code::up_low_dispense>();
+		case command_code::multi_dispense:
+			return this->build_command<command_code::multi_dispense>();
+		default:
+			throw std::runtime_error("invalid dispense request");
 	}
 }
 
-void lcdm::dispense_operation::handle_result(const std::vector<std::uint8_t>& result_data) {
+void dispense_operation::handle_result(const data_view& result_data) {
 	if (this->is_completed()) {
-		throw std::exception("operation is completed");
+		throw std::runtime_error("operation is completed");
 	}
 
-	if (result_data.size() == single_cassette_result_data_size) {
-		if (result_data[0] == (std::uint8_t)command_code::upper_dispense) {
-			std::uint32_t bills_passed_exit_sensor = this->read_bills_count(result_data, 3);
-			this->upper_bills_to_dispense -= bills_passed_exit_sensor;
-			this->upper_dispensed_bills += bills_passed_exit_sensor;
-			this->upper_rejected_bills += this->read_bills_count(result_data, 7);
+	switch ((command_code)result_data[0]) {
+		case command_code::upper_dispense:
+			this->apply_result<command_code::upper_dispense>(result_data);
+			break;
+		case command_code::lower_dispense:
+			this->apply_result<command_code::lower_dispense>(result_data);
+			break;
+		case command_code::up_low_dispense:
+			this->apply_result<command_code::up_low_dispense>(result_data);
+			break;
+		case command_code::multi_dispense:
+			this->apply_result<command_code::multi_dispense>(result_data);
+			break;
+		default:
+			throw std::runtime_error("unexpected command");
+	}
+}
 
-			operation_status current_operation_status = operation_statuses_by_code.at(result_data[5]);
+bool dispense_operation::is_completed() const {
+	return ((std::all_of(this->bills_to_dispense.begin(), this->bills_to_dispense.end(), [](std::uint32_t bills) { return bills == 0; }))
+		|| this->error);
+}
 
-			if ((current_operation_status != operation_status::good)
-				&& (current_operation_status != operation_status::normal_stop)) {
-				this->result.set_value(this->build_result(current_operation_status));
-				this->error = true;
-			} else if ((this->upper_bills_to_dispense == 0) && (this->lower_bills_to_dispense == 0)) {
-				this->result.set_value(this->build_result(current_operation_status));
-			}
-		} else if (result_data[0] == (std::uint8_t)command_code::lower_dispense) {
-			std::uint32_t bills_passed_exit_sensor = this->read_bills_count(result_data, 3);
-			this->lower_bills_to_dispense -= bills_passed_exit_sensor;
-			this->lower_dispensed_bills += bills_passed_exit_sensor;
-			this->lower_rejected_bills += this->read_bills_count(result_data, 7);
-
-			operation_status current_operation_status = operation_statuses_by_code.at(result_data[5]);
-
-			if ((current_operation_status != operation_status::good)
-				&& (current_operation_status != operation_status::normal_stop)) {
-				this->result.set_value(this->build_result(current_operation_status));
-				this->error = true;
-			} else if ((this->upper_bills_to_dispense == 0) && (this->lower_bills_to_dispense == 0)) {
-				this->result.set_value(this->build_result(current_operation_status));
-			}
-		} else {
-			throw std::exception("unexpected command");
-		}
-	} else if (result_data.size() == double_cassette_result_data_size) {
-		if (result_data[0] == (std::uint8_t)command_code::up_low_dispense) {
-			std::uint32_t bills_passed_exit_sensor = this->read_bills_count(result_data, 3);
-			this->upper_bills_to_dispense -= bills_passed_exit_sensor;
-			this->upper_dispensed_bills += bills_passed_exit_sensor;
-			this->upper_rejected_bills += this->read_bills_count(result_data, 12);
-
-			bills_passed_exit_sensor = this->read_bills_count(result_data, 7);
-			this->lower_bills_to_dispense -= bills_passed_exit_sensor;
-			this->lower_dispensed_bills += bills_passed_exit_sensor;
-			this->lower_rejected_bills += this->read_bills_count(result_data, 14);
-
-			operation_status current_operation_status = operation_statuses_by_code.at(result_data[9]);
-
-			if ((current_operation_status != operation_status::good)
-				&& (current_operation_status != operation_status::normal_stop)) {
-				this->result.set_value(this->build_result(current_operation_status));
-				this->error = true;
-			} else if ((this->upper_bills_to_dispense == 0) && (this->lower_bills_to_dispense == 0)) {
-				this->result.set_value(this->build_result(current_operation_status));
-			}
-		} else {
-			throw std::exception("unexpected command");
+void dispense_operation::set_error() {
+	this->error = true;
+	this->handler(nullptr, this->build_result(lcdm::operation_status::connection_error));
+}
+
+void dispense_operation::cancel(lcdm::operation_status status) {
+	this->error = true;
+	this->handler(nullptr, this->build_result(status));
+}
+
+bool dispense_operation::get_coalescible_cassette(cassette& source) const {
+	if ((!this->profile.supports_coalescing) || this->error || (this->completed_rounds > 0)) {
+		return false;
+	}
+
+	std::size_t requested_cassette_count = 0;
+	for (std::size_t i = 0; i < this->bills_to_dispense.size(); ++i) {
+		if (this->bills_to_dispense[(lcdm::cassette_number)i] > 0) {
+			source = (cassette)i;
+			++requested_cassette_count;
 		}
-	} else {
-		throw std::exception("incorrect result data format");
 	}
+
+	return (requested_cassette_count == 1);
 }
 
-bool lcdm::dispense_operation::is_completed() const {
-	return (((this->upper_bills_to_dispense == 0) && (this->lower_bills_to_dispense == 0))
-		|| this->error);
+bool dispense_operation::get_dispense_counts(dispense_counts& counts) const {
+	counts.bills_to_dispense = this->bills_to_dispense;
+	counts.dispensed_bills = this->dispensed_bills;
+	counts.rejected_bills = this->rejected_bills;
+	return true;
 }
 
-void lcdm::dispense_operation::set_error() {
-	this->result.set_value(build_result(operation_status::connection_error));
-	this->error = true;
+void dispense_operation::apply_cassette_field(const data_view& result_data, const cassette_field& field) {
+	const lcdm::cassette_number source = (lcdm::cassette_number)field.source;
+	const std::uint32_t bills_passed_exit_sensor = read_bills_count(result_data, field.dispensed_offset);
+
+	this->bills_to_dispense[source] -= std::min(bills_passed_exit_sensor, this->bills_to_dispense[source]);
+	this->dispensed_bills[source] += bills_passed_exit_sensor;
+	this->rejected_bills[source] += read_bills_count(result_data, field.rejected_offset);
 }
 
-std::future<lcdm::dispense_result> lcdm::dispense_operation::get_future_result() {
-	return this->result.get_future();
+void dispense_operation::apply_status(const status_entry& current_status) {
+	if (!current_status.is_known) {
+		this->error = true;
+		this->handler(std::make_exception_ptr(std::runtime_error("unknown operation status")), this->build_result(lcdm::operation_status::device_error));
+	} else if ((current_status.status != lcdm::operation_status::good)
+		&& (current_status.status != lcdm::operation_status::normal_stop)) {
+		this->error = true;
+		this->handler(nullptr, this->build_result(current_status.status));
+	} else {
+		this->complete_round(current_status.status);
+	}
 }
 
-std::uint32_t lcdm::dispense_operation::read_bills_count(const std::vector<std::uint8_t>& result_data, const std::size_t offset) const {
+std::uint32_t dispense_operation::read_bills_count(const data_view& result_data, const std::size_t offset) {
 	assert(offset + 1 < result_data.size());
 	return ((std::uint32_t)(result_data[offset] - '0') * 10)
 		+ ((std::uint32_t)(result_data[offset + 1] - '0'));
 }
 
-void lcdm::dispense_operation::write_bills_count(std::vector<std::uint8_t>& command_data, std::uint32_t bills_count) const {
+void dispense_operation::write_bills_count(command& current_command, std::uint32_t bills_count) {
 	const std::uint32_t normalized_bills_count = std::min(bills_count, max_dispensable_bills);
 	const std::uint32_t tens = normalized_bills_count / 10;
 	const std::uint32_t units = normalized_bills_count % 10;
-	command_data.push_back(tens + '0');
-	command_data.push_back(units + '0');
+	current_command.append_data((std::uint8_t)(tens + '0'));
+	current_command.append_data((std::uint8_t)(units + '0'));
+	current_command.bills += normalized_bills_count;
+}
+
+std::uint32_t dispense_operation::get_round_count(const lcdm::bill_counts& bills) {
+	const std::uint32_t max_bills = bills.empty() ? 0 : *std::max_element(bills.begin(), bills.end());
+	return (max_bills + max_dispensable_bills - 1) / max_dispensable_bills;
 }
 
-lcdm::dispense_result lcdm::dispense_operation::build_result(operation_status status) const {
-	dispense_result result;
+lcdm::dispense_result dispense_operation::build_result(lcdm::operation_status status) const {
+	lcdm::dispense_result result;
 
-	result.dispensed_bills[(cassette_number)cassette::upper] = this->upper_dispensed_bills;
-	result.dispensed_bills[(cassette_number)cassette::lower] = this->lower_dispensed_bills;
-	result.rejected_bills[(cassette_number)cassette::upper] = this->upper_rejected_bills;
-	result.rejected_bills[(cassette_number)cassette::lower] = this->lower_rejected_bills;
+	result.dispensed_bills = this->dispensed_bills;
+	result.rejected_bills = this->rejected_bills;
 	result.status = status;
 
 	return result;
 }
+
+lcdm::dispense_progress dispense_operation::build_progress() const {
+	lcdm::dispense_progress progress;
+
+	progress.completed_rounds = this->completed_rounds;
+	progress.planned_rounds = this->completed_rounds + get_round_count(this->bills_to_dispense);
+	progress.dispensed_bills = this->dispensed_bills;
+	progress.rejected_bills = this->rejected_bills;
+
+	return progress;
+}
+
+void dispense_operation::complete_round(lcdm::operation_status status) {
+	++this->completed_rounds;
+
+	if (this->progress_handler) {
+		this->progress_handler(this->build_progress());
+	}
+
+	if (this->is_completed()) {
+		this->handler(nullptr, this->build_result(status));
+	}
+}
+
+coalesced_dispense_operation::coalesced_dispense_operation(operation_ptr upper_operation, operation_ptr lower_operation) :
+	operation(),
+	parts() {
+	this->parts[(std::size_t)cassette::upper] = std::move(upper_operation);
+	this->parts[(std::size_t)cassette::lower] = std::move(lower_operation);
+}
+
+command coalesced_dispense_operation::get_command() const {
+	typedef command_descriptor<command_code::up_low_dispense> descriptor;
+
+	if (this->is_completed()) {
+		throw std::runtime_error("operation is completed");
+	}
+
+	// the rest of a larger request is dispensed alone
+	const operation_ptr& upper_part = this->parts[(std::size_t)cassette::upper];
+	const operation_ptr& lower_part = this->parts[(std::size_t)cassette::lower];
+
+	if (upper_part->is_completed()) {
+		return lower_part->get_command();
+	} else if (lower_part->is_completed()) {
+		return upper_part->get_command();
+	}
+
+	command current_command(command_code::up_low_dispense, descriptor::result_data_size);
+	for (std::size_t i = 0; i < descriptor::cassette_field_count; ++i) {
+		const cassette source = descriptor::cassette_fields[i].source;
+		dispense_operation::write_bills_count(current_command, this->get_part(source).get_bills_to_dispense(source));
+	}
+
+	return current_command;
+}
+
+void coalesced_dispense_operation::handle_result(const data_view& result_data) {
+	typedef command_descriptor<command_code::up_low_dispense> descriptor;
+
+	if (this->is_completed()) {
+		throw std::runtime_error("operation is completed");
+	}
+
+	if ((command_code)result_data[0] == command_code::up_low_dispense) {
+		if (result_data.size() != descriptor::result_data_size) {
+			throw std::runtime_error("incorrect result data format");
+		}
+
+		for (std::size_t i = 0; i < descriptor::cassette_field_count; ++i) {
+			this->get_part(descriptor::cassette_fields[i].source).apply_cassette_field(result_data, descriptor::cassette_fields[i]);
+		}
+		this->notify_result_decoded();
+
+		// an error stops both cassettes
+		const status_entry& current_status = operation_statuses[result_data[descriptor::status_offset]];
+		for (operation_ptr& part : this->parts) {
+			static_cast<dispense_operation&>(*part).apply_status(current_status);
+		}
+	} else {
+		for (operation_ptr& part : this->parts) {
+			if (!part->is_completed()) {
+				part->handle_result(result_data);
+				break;
+			}
+		}
+	}
+
+	// a request cancelled by its caller
+	// does not take part in the next round
+	for (operation_ptr& part : this->parts) {
+		if ((!part->is_completed()) && part->get_options().cancellation.is_cancelled()) {
+			part->cancel(lcdm::operation_status::cancelled);
+		}
+	}
+}
+
+bool coalesced_dispense_operation::is_completed() const {
+	return std::all_of(this->parts.begin(), this->parts.end(), [](const operation_ptr& part) { return part->is_completed(); });
+}
+
+void coalesced_dispense_operation::set_error() {
+	for (operation_ptr& part : this->parts) {
+		if (!part->is_completed()) {
+			part->set_error();
+		}
+	}
+}
+
+void coalesced_dispense_operation::cancel(lcdm::operation_status status) {
+	for (operation_ptr& part : this->parts) {
+		if (!part->is_completed()) {
+			part->cancel(status);
+		}
+	}
+}
+
+bool coalesced_dispense_operation::get_dispense_counts(dispense_counts& counts) const {
+	counts = dispense_counts();
+
+	for (std::size_t i = 0; i < this->parts.size(); ++i) {
+		const dispense_operation& part = this->get_part((cassette)i);
+		const lcdm::cassette_number source = (lcdm::cassette_number)i;
+
+		counts.bills_to_dispense[source] = part.get_bills_to_dispense((cassette)i);
+		counts.dispensed_bills[source] = part.get_dispensed_bills((cassette)i);
+		counts.rejected_bills[source] = part.get_rejected_bills((cassette)i);
+	}
+
+	return true;
+}
+
+void coalesced_dispense_operation::set_result_observer(const result_observer& observer) {
+	operation::set_result_observer(observer);
+
+	for (operation_ptr& part : this->parts) {
+		part->set_result_observer(observer);
+	}
+}
+
+dispense_operation& coalesced_dispense_operation::get_part(cassette source) const {
+	return static_cast<dispense_operation&>(*this->parts[(std::size_t)source]);
+}
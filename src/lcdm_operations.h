@@ -2,84 +2,381 @@
 #define OPERATIONS_H
 
 #include "lcdm.h"
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include "lcdm_protocol.h"
+#include "lcdm_state_cache.h"
 
 namespace puloon {
 
-	class lcdm::operation {
-		public:
-			virtual ~operation() = default;
-
-			virtual command get_command() const = 0;
-			virtual void handle_result(const std::vector<std::uint8_t>& result_data) = 0;
-			virtual bool is_completed() const = 0;
-			virtual void set_error() = 0;
-
-		protected:
-			operation() = default;
-	};
-
-	class lcdm::purge_operation : public operation {
-		public:
-			purge_operation();
-			virtual ~purge_operation() override = default;
-
-			// purge command data structure:
-			// no command data
-			virtual command get_command() const override;
-			virtual void handle_result(const std::vector<std::uint8_t>& result_data) override;
-			virtual bool is_completed() const override;
-			virtual void set_error() override;
-			std::future<operation_status> get_future_result();
-
-		private:
-			bool operation_is_completed;
-			bool error;
-			std::promise<operation_status> result;
-
-			static const std::size_t result_data_size = 2;
-	};
-
-	class lcdm::dispense_operation : public operation {
-		public:
-			dispense_operation(const bill_quantity_by_cassette& requested_bills);
-			virtual ~dispense_operation() override = default;
-
-			// dispense command data structure:
-			// [upper] tens,
-			// [upper] units,
-			// [lower tens],
-			// [lower units]
-			virtual command get_command() const override;
-			virtual void handle_result(const std::vector<std::uint8_t>& result_data) override;
-			virtual bool is_completed() const override;
-			virtual void set_error() override;
-			std::future<dispense_result> get_future_result();
-
-		private:
-			// reads tens and units
-			// from a result data and
-			// converts them into bills count
-			std::uint32_t read_bills_count(const std::vector<std::uint8_t>& result_data, const std::size_t offset) const;
-			// converts bills count
-			// into tens and units
-			// and writes them to a command data
-			void write_bills_count(std::vector<std::uint8_t>& command_data, std::uint32_t bills_count) const;
-			dispense_result build_result(operation_status status) const;
-
-		private:
-			std::uint32_t upper_bills_to_dispense;
-			std::uint32_t lower_bills_to_dispense;
-			std::uint32_t upper_dispensed_bills;
-			std::uint32_t lower_dispensed_bills;
-			std::uint32_t upper_rejected_bills;
-			std::uint32_t lower_rejected_bills;
-			bool error;
-			std::promise<dispense_result> result;
-
-			static const std::uint32_t max_dispensable_bills = 60;
-			static const std::size_t single_cassette_result_data_size = 9;
-			static const std::size_t double_cassette_result_data_size = 16;
-	};
+	namespace detail {
+
+		struct command {
+			command(command_code code, std::size_t response_data_size) :
+				code(code),
+				data(),
+				data_size(0),
+				response_data_size(response_data_size),
+				bills(0),
+				is_probe(false) {
+			}
+
+			// appends a byte to the command data
+			void append_data(std::uint8_t value) {
+				assert(this->data_size < this->data.size());
+				this->data[this->data_size++] = value;
+			}
+
+			command_code code;
+			std::array<std::uint8_t, max_command_data_size> data;
+			std::size_t data_size;
+			std::size_t response_data_size;
+			// bills requested from all cassettes,
+			// the mechanical part of the response grows with them
+			std::uint32_t bills;
+			// the exchange runs under the fixed probe timeout
+			bool is_probe;
+		};
+
+		// non-owning view of result data
+		// inside the response frame
+		class data_view {
+			public:
+				data_view(const std::uint8_t* data, std::size_t size) :
+					data_begin(data),
+					data_size(size) {
+				}
+
+				const std::uint8_t& operator[](std::size_t index) const {
+					assert(index < this->data_size);
+					return this->data_begin[index];
+				}
+
+				std::size_t size() const {
+					return this->data_size;
+				}
+
+			private:
+				const std::uint8_t* data_begin;
+				std::size_t data_size;
+		};
+
+		// bills of a dispense operation, indexed by cassette
+		struct dispense_counts {
+			// bills left to dispense
+			lcdm::bill_counts bills_to_dispense;
+			// bills dispensed and rejected so far
+			lcdm::bill_counts dispensed_bills;
+			lcdm::bill_counts rejected_bills;
+		};
+
+		// called when the result of a command has been decoded
+		// into the counts of an operation, before its handlers
+		typedef std::function<void()> result_observer;
+
+		// makes a command without command data
+		// that expects the result data of its descriptor
+		template <command_code Code>
+		command make_command() {
+			static_assert(command_descriptor<Code>::command_data_size == 0, "command has command data");
+			return command(Code, command_descriptor<Code>::result_data_size);
+		}
+
+		class operation {
+			public:
+				virtual ~operation() = default;
+
+				virtual command get_command() const = 0;
+				virtual void handle_result(const data_view& result_data) = 0;
+				virtual bool is_completed() const = 0;
+				virtual void set_error() = 0;
+				// completes an operation that has not been started
+				// or is between commands
+				// with operation_status::cancelled or operation_status::expired
+				virtual void cancel(lcdm::operation_status status) = 0;
+				// returns true and the cassette if the operation
+				// is a dispense from a single cassette
+				// that can share a command with a dispense from the other one
+				virtual bool get_coalescible_cassette(cassette&) const {
+					return false;
+				}
+				// returns true and the bills of the operation
+				// if it dispenses bills, for the journal
+				virtual bool get_dispense_counts(dispense_counts&) const {
+					return false;
+				}
+				// observes the results of the operation
+				// that dispenses bills, for the journal
+				virtual void set_result_observer(const result_observer& observer) {
+					this->observer = observer;
+				}
+
+				// time of the submission to the engine
+				void set_submit_time(std::chrono::steady_clock::time_point submit_time) {
+					this->submit_time = submit_time;
+				}
+
+				std::chrono::steady_clock::time_point get_submit_time() const {
+					return this->submit_time;
+				}
+
+				// scheduling requested by the caller
+				void set_options(const lcdm::submit_options& options) {
+					this->options = options;
+				}
+
+				const lcdm::submit_options& get_options() const {
+					return this->options;
+				}
+
+				// position among the queued operations
+				// of the same priority
+				void set_sequence_number(std::uint64_t sequence_number) {
+					this->sequence_number = sequence_number;
+				}
+
+				std::uint64_t get_sequence_number() const {
+					return this->sequence_number;
+				}
+
+			protected:
+				operation() :
+					submit_time(),
+					options(),
+					sequence_number(0),
+					observer() {
+				}
+
+				void notify_result_decoded() const {
+					if (this->observer) {
+						this->observer();
+					}
+				}
+
+			private:
+				std::chrono::steady_clock::time_point submit_time;
+				lcdm::submit_options options;
+				std::uint64_t sequence_number;
+				result_observer observer;
+		};
+
+		class operation_pool;
+
+		// destroys an operation and returns its storage
+		// to the pool it was taken from,
+		// operations without a pool are deleted
+		struct operation_deleter {
+			void operator()(operation* released_operation) const;
+
+			operation_pool* pool;
+		};
+
+		// the only owner of an operation,
+		// from submission to completion
+		typedef std::unique_ptr<operation, operation_deleter> operation_ptr;
+
+		class purge_operation : public operation {
+			public:
+				purge_operation(const lcdm::purge_handler& handler);
+				virtual ~purge_operation() override = default;
+
+				virtual command get_command() const override;
+				virtual void handle_result(const data_view& result_data) override;
+				virtual bool is_completed() const override;
+				virtual void set_error() override;
+				virtual void cancel(lcdm::operation_status status) override;
+
+			private:
+				bool operation_is_completed;
+				bool error;
+				lcdm::purge_handler handler;
+		};
+
+		// internal status request of the engine,
+		// the result updates the state cache
+		class status_operation : public operation {
+			public:
+				explicit status_operation(state_cache& cache);
+				virtual ~status_operation() override = default;
+
+				virtual command get_command() const override;
+				virtual void handle_result(const data_view& result_data) override;
+				virtual bool is_completed() const override;
+				virtual void set_error() override;
+				virtual void cancel(lcdm::operation_status status) override;
+
+			private:
+				bool operation_is_completed;
+				bool error;
+				state_cache& cache;
+		};
+
+		// ROM version request followed by a status request
+		// under the probe timeout, the results update
+		// the state and the capabilities of the cache
+		class probe_operation : public operation {
+			public:
+				probe_operation(state_cache& cache, const lcdm::open_handler& handler);
+				virtual ~probe_operation() override = default;
+
+				virtual command get_command() const override;
+				virtual void handle_result(const data_view& result_data) override;
+				virtual bool is_completed() const override;
+				virtual void set_error() override;
+				virtual void cancel(lcdm::operation_status status) override;
+
+			private:
+				void handle_rom_version(const data_view& result_data);
+				void handle_status(const data_view& result_data);
+
+			private:
+				bool rom_version_is_received;
+				bool operation_is_completed;
+				bool error;
+				state_cache& cache;
+				lcdm::device_capabilities capabilities;
+				lcdm::open_handler handler;
+		};
+
+		class dispense_operation : public operation {
+			public:
+				// throws std::runtime_error if no bills are requested
+				// or the device model has no requested cassette
+				dispense_operation(const device_profile& profile, const lcdm::bill_counts& requested_bills, const lcdm::dispense_handler& handler);
+				dispense_operation(const device_profile& profile, const lcdm::bill_counts& requested_bills, const lcdm::dispense_progress_handler& progress_handler, const lcdm::dispense_handler& handler);
+				virtual ~dispense_operation() override = default;
+
+				// dispenses from all cassettes with bills left
+				// in a single command of the device model
+				virtual command get_command() const override;
+				virtual void handle_result(const data_view& result_data) override;
+				virtual bool is_completed() const override;
+				virtual void set_error() override;
+				virtual void cancel(lcdm::operation_status status) override;
+				virtual bool get_coalescible_cassette(cassette& source) const override;
+				virtual bool get_dispense_counts(dispense_counts& counts) const override;
+
+				std::uint32_t get_bills_to_dispense(cassette source) const {
+					return this->bills_to_dispense[(lcdm::cassette_number)source];
+				}
+
+				std::uint32_t get_dispensed_bills(cassette source) const {
+					return this->dispensed_bills[(lcdm::cassette_number)source];
+				}
+
+				std::uint32_t get_rejected_bills(cassette source) const {
+					return this->rejected_bills[(lcdm::cassette_number)source];
+				}
+
+				// adds the bills of a cassette in the result data
+				// to the counts of the operation
+				void apply_cassette_field(const data_view& result_data, const cassette_field& field);
+				// completes the round with the error code of the result data
+				void apply_status(const status_entry& current_status);
+
+				// reads tens and units
+				// from a result data and
+				// converts them into bills count
+				static std::uint32_t read_bills_count(const data_view& result_data, const std::size_t offset);
+				// converts bills count
+				// into tens and units
+				// and appends them to a command data
+				static void write_bills_count(command& current_command, std::uint32_t bills_count);
+				// returns the number of rounds
+				// needed to dispense bills from all cassettes,
+				// cassettes are dispensed together while they have bills left
+				static std::uint32_t get_round_count(const lcdm::bill_counts& bills);
+
+			private:
+				// encodes the bills left in the cassettes of a command
+				template <command_code Code>
+				command build_command() const;
+				// decodes the result of a command
+				// and completes the round
+				template <command_code Code>
+				void apply_result(const data_view& result_data);
+				lcdm::dispense_result build_result(lcdm::operation_status status) const;
+				lcdm::dispense_progress build_progress() const;
+				// reports the progress of a successful round
+				// and completes the operation after the last round
+				void complete_round(lcdm::operation_status status);
+
+			private:
+				const device_profile& profile;
+				// indexed by cassette
+				lcdm::bill_counts bills_to_dispense;
+				lcdm::bill_counts dispensed_bills;
+				lcdm::bill_counts rejected_bills;
+				std::uint32_t completed_rounds;
+				bool error;
+				lcdm::dispense_progress_handler progress_handler;
+				lcdm::dispense_handler handler;
+
+				static const std::uint32_t max_dispensable_bills = 60;
+		};
+
+		// dispense from the upper cassette and dispense from the lower one
+		// served by common up/low dispense commands
+		// while both have bills left;
+		// the bills of each cassette and the status of every command
+		// are reported to the operation that requested the cassette
+		class coalesced_dispense_operation : public operation {
+			public:
+				// the operations are dispenses from a single cassette
+				coalesced_dispense_operation(operation_ptr upper_operation, operation_ptr lower_operation);
+				virtual ~coalesced_dispense_operation() override = default;
+
+				virtual command get_command() const override;
+				virtual void handle_result(const data_view& result_data) override;
+				virtual bool is_completed() const override;
+				virtual void set_error() override;
+				virtual void cancel(lcdm::operation_status status) override;
+				// the counts of both parts, each has its own cassette
+				virtual bool get_dispense_counts(dispense_counts& counts) const override;
+				// a part dispensed alone notifies the observer itself
+				virtual void set_result_observer(const result_observer& observer) override;
+
+			private:
+				dispense_operation& get_part(cassette source) const;
+
+			private:
+				// indexed by cassette
+				std::array<operation_ptr, command_descriptor<command_code::up_low_dispense>::cassette_field_count> parts;
+		};
+
+		template <command_code Code>
+		command dispense_operation::build_command() const {
+			typedef command_descriptor<Code> descriptor;
+
+			command current_command(Code, descriptor::result_data_size);
+			for (std::size_t i = 0; i < descriptor::cassette_field_count; ++i) {
+				write_bills_count(current_command, this->bills_to_dispense[(lcdm::cassette_number)descriptor::cassette_fields[i].source]);
+			}
+
+			return current_command;
+		}
+
+		template <command_code Code>
+		void dispense_operation::apply_result(const data_view& result_data) {
+			typedef command_descriptor<Code> descriptor;
+
+			if (result_data.size() != descriptor::result_data_size) {
+				throw std::runtime_error("incorrect result data format");
+			}
+
+			for (std::size_t i = 0; i < descriptor::cassette_field_count; ++i) {
+				this->apply_cassette_field(result_data, descriptor::cassette_fields[i]);
+			}
+
+			this->notify_result_decoded();
+			this->apply_status(operation_statuses[result_data[descriptor::status_offset]]);
+		}
+
+	}
 
 }
 
@@ -0,0 +1,359 @@
+#include "lcdm_planner.h"
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+using namespace puloon;
+using namespace puloon::detail;
+
+// attempts to take a mix out of the inventory
+// while other threads take their bills
+const int max_reserve_try_count = 3;
+
+const std::uint32_t dispense_planner::max_dispensable_bills;
+const std::size_t dispense_planner::memoized_amount_count;
+
+static std::uint32_t get_greatest_common_divisor(std::uint32_t first, std::uint32_t second) {
+	while (second != 0) {
+		const std::uint32_t remainder = first % second;
+		first = second;
+		second = remainder;
+	}
+
+	return first;
+}
+
+dispense_planner::dispense_planner(const lcdm::cassette_inventory& inventory, std::size_t cassette_count) :
+	denominations(inventory.denominations),
+	available_bills(),
+	reserved_bills(),
+	reconciliation_required(false),
+	search_order(),
+	search_cassette_count(0),
+	level_divisors(),
+	memoized_mixes() {
+	if ((inventory.denominations.size() > cassette_count) || (inventory.bills.size() > cassette_count)) {
+		// the device has no such cassette
+		throw std::runtime_error("invalid cassette inventory");
+	}
+
+	for (std::size_t i = 0; i < this->available_bills.size(); ++i) {
+		this->available_bills[i].store((i < this->denominations.size()) ? inventory.bills[(lcdm::cassette_number)i] : 0, std::memory_order_relaxed);
+		this->reserved_bills[i].store(0, std::memory_order_relaxed);
+	}
+
+	for (std::size_t i = 0; i < this->denominations.size(); ++i) {
+		if (this->denominations[(lcdm::cassette_number)i] > 0) {
+			this->search_order[this->search_cassette_count++] = (lcdm::cassette_number)i;
+		}
+	}
+
+	std::stable_sort(this->search_order.begin(), this->search_order.begin() + this->search_cassette_count,
+		[this](lcdm::cassette_number first, lcdm::cassette_number second) {
+			return this->denominations[first] > this->denominations[second];
+		});
+
+	this->level_divisors[this->search_cassette_count] = 0;
+	for (std::size_t level = this->search_cassette_count; level > 0; --level) {
+		this->level_divisors[level - 1] = get_greatest_common_divisor(
+			this->denominations[this->search_order[level - 1]], this->level_divisors[level]);
+	}
+
+	if (this->search_cassette_count == 0) {
+		return;
+	}
+
+	const bill_array initial_bills = this->load_available_bills();
+	this->memoized_mixes.resize(memoized_amount_count);
+
+	for (std::size_t i = 0; i < memoized_amount_count; ++i) {
+		const std::uint64_t amount = (std::uint64_t)(i + 1) * this->level_divisors[0];
+
+		if ((amount > std::numeric_limits<std::uint32_t>::max())
+			|| (!this->plan((std::uint32_t)amount, initial_bills, this->memoized_mixes[i]))) {
+			this->memoized_mixes[i] = lcdm::bill_counts();
+		}
+	}
+}
+
+lcdm::bill_counts dispense_planner::reserve(std::uint32_t amount) {
+	if ((amount == 0) || (this->search_cassette_count == 0) || ((amount % this->level_divisors[0]) != 0)) {
+		throw std::runtime_error("amount cannot be dispensed");
+	}
+
+	const std::size_t memoized_index = (amount / this->level_divisors[0]) - 1;
+
+	for (int try_count = max_reserve_try_count; try_count > 0; --try_count) {
+		const bill_array current_bills = this->load_available_bills();
+		lcdm::bill_counts mix;
+		bool mix_is_planned = false;
+
+		if (memoized_index < this->memoized_mixes.size()) {
+			const lcdm::bill_counts& memoized_mix = this->memoized_mixes[memoized_index];
+
+			if (memoized_mix.empty()) {
+				// the bills left are a part of the initial ones
+				throw std::runtime_error("amount cannot be dispensed");
+			}
+
+			// a mix that is optimal for the initial bills
+			// is optimal for any part of them that contains it
+			mix_is_planned = true;
+			for (std::size_t i = 0; i < memoized_mix.size(); ++i) {
+				if (memoized_mix[(lcdm::cassette_number)i] > current_bills[i]) {
+					mix_is_planned = false;
+					break;
+				}
+			}
+
+			if (mix_is_planned) {
+				mix = memoized_mix;
+			}
+		}
+
+		if ((!mix_is_planned) && (!this->plan(amount, current_bills, mix))) {
+			throw std::runtime_error("amount cannot be dispensed");
+		}
+
+		if (this->try_take(mix)) {
+			return mix;
+		}
+	}
+
+	throw std::runtime_error("amount cannot be dispensed");
+}
+
+void dispense_planner::release(const lcdm::bill_counts& reserved_bills, const lcdm::dispense_result& result) {
+	for (std::size_t i = 0; i < reserved_bills.size(); ++i) {
+		const lcdm::cassette_number cassette = (lcdm::cassette_number)i;
+		// rejected bills left the cassette too
+		const std::uint32_t taken_bills = result.dispensed_bills[cassette] + result.rejected_bills[cassette];
+
+		if (reserved_bills[cassette] > taken_bills) {
+			this->available_bills[i].fetch_add(reserved_bills[cassette] - taken_bills, std::memory_order_relaxed);
+		}
+		this->reserved_bills[i].fetch_sub(reserved_bills[cassette], std::memory_order_relaxed);
+	}
+}
+
+void dispense_planner::retain(const lcdm::bill_counts& reserved_bills) {
+	for (std::size_t i = 0; i < reserved_bills.size(); ++i) {
+		this->reserved_bills[i].fetch_sub(reserved_bills[(lcdm::cassette_number)i], std::memory_order_relaxed);
+	}
+
+	this->reconciliation_required.store(true, std::memory_order_relaxed);
+}
+
+void dispense_planner::take_over_reservations(const dispense_planner& previous_planner) {
+	for (std::size_t i = 0; i < this->available_bills.size(); ++i) {
+		const std::uint32_t previous_reserved_bills = previous_planner.reserved_bills[i].load(std::memory_order_relaxed);
+		const std::uint32_t current_bills = this->available_bills[i].load(std::memory_order_relaxed);
+
+		if (current_bills < previous_reserved_bills) {
+			// the new inventory does not hold the bills
+			// of the dispenses in progress
+			this->reconciliation_required.store(true, std::memory_order_relaxed);
+		}
+
+		this->available_bills[i].store(current_bills - std::min(current_bills, previous_reserved_bills), std::memory_order_relaxed);
+		this->reserved_bills[i].store(previous_reserved_bills, std::memory_order_relaxed);
+	}
+}
+
+lcdm::cassette_inventory dispense_planner::get_inventory() const {
+	lcdm::cassette_inventory inventory;
+	inventory.denominations = this->denominations;
+	inventory.bills = lcdm::bill_counts(this->denominations.size());
+
+	for (std::size_t i = 0; i < this->denominations.size(); ++i) {
+		inventory.bills[(lcdm::cassette_number)i] = this->available_bills[i].load(std::memory_order_relaxed);
+	}
+	inventory.needs_reconciliation = this->reconciliation_required.load(std::memory_order_relaxed);
+
+	return inventory;
+}
+
+bool dispense_planner::plan(std::uint32_t amount, const bill_array& available_bills, lcdm::bill_counts& mix) const {
+	if ((amount == 0) || (this->search_cassette_count == 0) || ((amount % this->level_divisors[0]) != 0)) {
+		return false;
+	}
+
+	std::uint64_t amount_per_round = 0;
+	std::uint32_t max_available_bills = 0;
+	for (std::size_t level = 0; level < this->search_cassette_count; ++level) {
+		const lcdm::cassette_number cassette = this->search_order[level];
+		amount_per_round += (std::uint64_t)this->denominations[cassette] * max_dispensable_bills;
+		max_available_bills = std::max(max_available_bills, available_bills[cassette]);
+	}
+
+	// rounds are tried from the fewest the amount could need
+	// until every cassette may give all its bills,
+	// a round count without a mix is rejected by the first levels
+	const std::uint32_t max_round_count = std::max<std::uint32_t>(1, (max_available_bills + max_dispensable_bills - 1) / max_dispensable_bills);
+	search_state state;
+
+	for (std::uint32_t round_count = std::max<std::uint32_t>(1, (std::uint32_t)((amount + amount_per_round - 1) / amount_per_round));
+		round_count <= max_round_count; ++round_count) {
+		if (this->search_rounds(amount, available_bills, round_count, state)) {
+			mix = lcdm::bill_counts(this->denominations.size());
+			for (std::size_t i = 0; i < this->denominations.size(); ++i) {
+				mix[(lcdm::cassette_number)i] = state.best_mix[i];
+			}
+
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool dispense_planner::search_rounds(std::uint32_t amount, const bill_array& available_bills, std::uint32_t round_count, search_state& state) const {
+	state.bill_limits.fill(0);
+	state.current_mix.fill(0);
+	state.current_bills = 0;
+	state.best_mix.fill(0);
+	state.best_bills = std::numeric_limits<std::uint32_t>::max();
+
+	state.level_amounts[this->search_cassette_count] = 0;
+	for (std::size_t level = this->search_cassette_count; level > 0; --level) {
+		const lcdm::cassette_number cassette = this->search_order[level - 1];
+		state.bill_limits[cassette] = std::min(available_bills[cassette], round_count * max_dispensable_bills);
+		state.level_amounts[level - 1] = state.level_amounts[level] + ((std::uint64_t)this->denominations[cassette] * state.bill_limits[cassette]);
+	}
+
+	this->search(0, amount, state);
+
+	return (state.best_bills != std::numeric_limits<std::uint32_t>::max());
+}
+
+void dispense_planner::search(std::size_t level, std::uint32_t remaining_amount, search_state& state) const {
+	if (remaining_amount == 0) {
+		if (state.current_bills < state.best_bills) {
+			state.best_mix = state.current_mix;
+			state.best_bills = state.current_bills;
+		}
+		return;
+	}
+
+	if ((level == this->search_cassette_count)
+		|| ((remaining_amount % this->level_divisors[level]) != 0)
+		|| (remaining_amount > state.level_amounts[level])) {
+		return;
+	}
+
+	const lcdm::cassette_number cassette = this->search_order[level];
+	const std::uint32_t denomination = this->denominations[cassette];
+
+	// the largest denomination left needs the fewest bills
+	if (state.current_bills + ((remaining_amount + denomination - 1) / denomination) >= state.best_bills) {
+		return;
+	}
+
+	const std::uint32_t max_count = std::min(state.bill_limits[cassette], remaining_amount / denomination);
+
+	if (level + 1 == this->search_cassette_count) {
+		// the divisor of the level is the denomination
+		if (remaining_amount / denomination <= max_count) {
+			state.current_mix[cassette] = remaining_amount / denomination;
+			state.current_bills += remaining_amount / denomination;
+			this->search(level + 1, 0, state);
+			state.current_bills -= remaining_amount / denomination;
+			state.current_mix[cassette] = 0;
+		}
+		return;
+	}
+
+	const std::uint32_t next_denomination = this->denominations[this->search_order[level + 1]];
+
+	for (std::uint32_t count = max_count + 1; count-- > 0;) {
+		const std::uint32_t next_amount = remaining_amount - (count * denomination);
+
+		// fewer bills of this cassette leave more amount
+		// to smaller denominations
+		if ((next_amount > state.level_amounts[level + 1])
+			|| (state.current_bills + count + ((next_amount + next_denomination - 1) / next_denomination) >= state.best_bills)) {
+			break;
+		}
+
+		state.current_mix[cassette] = count;
+		state.current_bills += count;
+		this->search(level + 1, next_amount, state);
+		state.current_bills -= count;
+	}
+
+	state.current_mix[cassette] = 0;
+}
+
+dispense_planner::bill_array dispense_planner::load_available_bills() const {
+	bill_array bills;
+
+	for (std::size_t i = 0; i < bills.size(); ++i) {
+		bills[i] = this->available_bills[i].load(std::memory_order_relaxed);
+	}
+
+	return bills;
+}
+
+bool dispense_planner::try_take(const lcdm::bill_counts& mix) {
+	for (std::size_t i = 0; i < mix.size(); ++i) {
+		const std::uint32_t needed_bills = mix[(lcdm::cassette_number)i];
+		std::uint32_t current_bills = this->available_bills[i].load(std::memory_order_relaxed);
+
+		while ((current_bills >= needed_bills)
+			&& (!this->available_bills[i].compare_exchange_weak(current_bills, current_bills - needed_bills, std::memory_order_relaxed))) {
+		}
+
+		if (current_bills < needed_bills) {
+			// another dispense took the bills first
+			for (std::size_t j = 0; j < i; ++j) {
+				this->available_bills[j].fetch_add(mix[(lcdm::cassette_number)j], std::memory_order_relaxed);
+			}
+			return false;
+		}
+	}
+
+	for (std::size_t i = 0; i < mix.size(); ++i) {
+		this->reserved_bills[i].fetch_add(mix[(lcdm::cassette_number)i], std::memory_order_relaxed);
+	}
+
+	return true;
+}
+
+planner_slot::planner_slot() :
+	planner_mutex(),
+	current_planner() { }
+
+void planner_slot::replace(std::shared_ptr<dispense_planner> new_planner) {
+	std::lock_guard<std::mutex> lock(this->planner_mutex);
+
+	if (this->current_planner) {
+		new_planner->take_over_reservations(*this->current_planner);
+	}
+
+	this->current_planner = std::move(new_planner);
+}
+
+lcdm::bill_counts planner_slot::reserve(std::uint32_t amount) {
+	std::lock_guard<std::mutex> lock(this->planner_mutex);
+
+	if (!this->current_planner) {
+		throw std::runtime_error("cassette inventory is not set");
+	}
+
+	return this->current_planner->reserve(amount);
+}
+
+void planner_slot::settle(const lcdm::bill_counts& reserved_bills, bool result_is_known, const lcdm::dispense_result& result) {
+	std::lock_guard<std::mutex> lock(this->planner_mutex);
+
+	if (result_is_known) {
+		this->current_planner->release(reserved_bills, result);
+	} else {
+		this->current_planner->retain(reserved_bills);
+	}
+}
+
+lcdm::cassette_inventory planner_slot::get_inventory() const {
+	std::lock_guard<std::mutex> lock(this->planner_mutex);
+	return this->current_planner ? this->current_planner->get_inventory() : lcdm::cassette_inventory();
+}
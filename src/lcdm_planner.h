@@ -0,0 +1,132 @@
+#ifndef PLANNER_H
+#define PLANNER_H
+
+#include "lcdm.h"
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace puloon {
+
+	namespace detail {
+
+		// plans the bills of an amount over the cassettes
+		// and keeps the bills left in them;
+		// a mix takes the fewest rounds of 60 bills per cassette
+		// and, among those, the fewest bills;
+		// mixes of common amounts are computed once
+		class dispense_planner {
+			public:
+				// throws std::runtime_error if the device model
+				// has no such cassette
+				dispense_planner(const lcdm::cassette_inventory& inventory, std::size_t cassette_count);
+
+				dispense_planner(const dispense_planner&) = delete;
+				dispense_planner& operator=(const dispense_planner&) = delete;
+
+				// plans an amount and takes its bills out of the inventory,
+				// can be called from any thread;
+				// throws std::runtime_error if the amount
+				// cannot be made from the bills left
+				lcdm::bill_counts reserve(std::uint32_t amount);
+				// returns the reserved bills that did not leave the cassettes
+				// according to the result reported by the device
+				void release(const lcdm::bill_counts& reserved_bills, const lcdm::dispense_result& result);
+				// keeps the reserved bills taken when the device
+				// has not reported how many of them left the cassettes,
+				// the inventory needs to be counted again
+				void retain(const lcdm::bill_counts& reserved_bills);
+				// takes the bills of the dispenses in progress
+				// out of a new inventory, they are still in the cassettes;
+				// the dispenses are released to this planner from now on
+				void take_over_reservations(const dispense_planner& previous_planner);
+				lcdm::cassette_inventory get_inventory() const;
+
+			private:
+				typedef std::array<std::uint32_t, lcdm::bill_counts::capacity> bill_array;
+
+				// state of a search for the mix of an amount
+				struct search_state {
+					// largest number of bills of a cassette
+					bill_array bill_limits;
+					// largest amount of the cassettes from a search level on
+					std::array<std::uint64_t, lcdm::bill_counts::capacity + 1> level_amounts;
+					bill_array current_mix;
+					std::uint32_t current_bills;
+					bill_array best_mix;
+					std::uint32_t best_bills;
+				};
+
+				// returns false if the amount cannot be made from the bills
+				bool plan(std::uint32_t amount, const bill_array& available_bills, lcdm::bill_counts& mix) const;
+				// searches the mix with the fewest bills
+				// that takes no more than the rounds,
+				// returns false if there is none
+				bool search_rounds(std::uint32_t amount, const bill_array& available_bills, std::uint32_t round_count, search_state& state) const;
+				// searches the cassettes from the level on
+				// in descending order of denominations
+				void search(std::size_t level, std::uint32_t remaining_amount, search_state& state) const;
+				bill_array load_available_bills() const;
+				// subtracts a mix from the inventory if every cassette has its bills
+				bool try_take(const lcdm::bill_counts& mix);
+
+			private:
+				lcdm::bill_counts denominations;
+				std::array<std::atomic<std::uint32_t>, lcdm::bill_counts::capacity> available_bills;
+				// bills of the dispenses in progress
+				std::array<std::atomic<std::uint32_t>, lcdm::bill_counts::capacity> reserved_bills;
+				// bills may have left the cassettes without being counted
+				std::atomic<bool> reconciliation_required;
+				// cassettes with a denomination,
+				// largest denomination first
+				std::array<lcdm::cassette_number, lcdm::bill_counts::capacity> search_order;
+				std::size_t search_cassette_count;
+				// greatest common divisor of the denominations
+				// of the cassettes from a search level on
+				std::array<std::uint32_t, lcdm::bill_counts::capacity + 1> level_divisors;
+				// mixes of the first multiples of the divisor of all denominations
+				// for the initial inventory,
+				// empty if the amount cannot be dispensed
+				std::vector<lcdm::bill_counts> memoized_mixes;
+
+				static const std::uint32_t max_dispensable_bills = 60;
+				static const std::size_t memoized_amount_count = 500;
+		};
+
+		// planner of the inventory set last,
+		// shared with the dispenses of amounts in progress
+		// so they are released to the inventory that replaced theirs
+		class planner_slot {
+			public:
+				planner_slot();
+
+				planner_slot(const planner_slot&) = delete;
+				planner_slot& operator=(const planner_slot&) = delete;
+
+				// replaces the planner,
+				// the new one takes over the dispenses in progress
+				void replace(std::shared_ptr<dispense_planner> new_planner);
+				// throws std::runtime_error if no planner is set
+				// or the amount cannot be made from the bills left
+				lcdm::bill_counts reserve(std::uint32_t amount);
+				// releases the reserved bills if the result is known,
+				// otherwise keeps them taken
+				void settle(const lcdm::bill_counts& reserved_bills, bool result_is_known, const lcdm::dispense_result& result);
+				// an empty inventory if no planner is set
+				lcdm::cassette_inventory get_inventory() const;
+
+			private:
+				// a reservation is never taken from one planner
+				// while the next one takes over the reservations
+				mutable std::mutex planner_mutex;
+				std::shared_ptr<dispense_planner> current_planner;
+		};
+
+	}
+
+}
+
+#endif // PLANNER_H
@@ -0,0 +1,421 @@
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include "lcdm.h"
+#include <cstddef>
+#include <cstdint>
+
+namespace puloon {
+
+	namespace detail {
+
+		// cassettes from the top of the device,
+		// LCDM-2000 has the upper and lower ones
+		enum class cassette : std::uint32_t {
+			upper = 0,
+			lower = 1,
+			third = 2,
+			fourth = 3
+		};
+
+		// number of cassettes of the largest device model
+		const std::size_t max_cassette_count = 4;
+
+		static_assert(max_cassette_count <= lcdm::bill_counts::capacity, "bill counts do not cover the cassettes");
+
+		enum class command_code : std::uint8_t {
+			unknown = 0x00,
+			purge = 0x44,
+			upper_dispense = 0x45,
+			status = 0x46,
+			rom_version = 0x47,
+			lower_dispense = 0x55,
+			up_low_dispense = 0x56,
+			upper_test_dispense = 0x76,
+			lower_test_dispense = 0x77,
+			multi_dispense = 0x52
+		};
+
+		// maximum size of command data
+		// (tens and units for four cassettes)
+		const std::size_t max_command_data_size = 8;
+		// maximum size of result data
+		// (result of a dispense from four cassettes)
+		const std::size_t max_result_data_size = 28;
+
+		// bills of one cassette in the result data of a dispense,
+		// counts are written as tens and units
+		struct cassette_field {
+			cassette source;
+			// bills that passed the exit sensor
+			std::size_t dispensed_offset;
+			std::size_t rejected_offset;
+		};
+
+		// layout of a command and its response,
+		// specialized for every command the driver sends;
+		// offsets are relative to the command code
+		// that starts the result data
+		template <command_code Code>
+		struct command_descriptor;
+
+		// purge command data structure:
+		// no command data;
+		// result data structure:
+		// command code, error code
+		template <>
+		struct command_descriptor<command_code::purge> {
+			static constexpr std::size_t command_data_size = 0;
+			static constexpr std::size_t result_data_size = 2;
+			static constexpr std::size_t status_offset = 1;
+		};
+
+		// status command data structure:
+		// no command data;
+		// result data structure:
+		// command code, reserved, last error code, sensor 0, sensor 1
+		template <>
+		struct command_descriptor<command_code::status> {
+			static constexpr std::size_t command_data_size = 0;
+			static constexpr std::size_t result_data_size = 5;
+			static constexpr std::size_t status_offset = 2;
+			static constexpr std::size_t sensor_0_offset = 3;
+			static constexpr std::size_t sensor_1_offset = 4;
+		};
+
+		// ROM version command data structure:
+		// no command data;
+		// result data structure:
+		// command code, three version characters;
+		// the response carries no error code
+		template <>
+		struct command_descriptor<command_code::rom_version> {
+			static constexpr std::size_t command_data_size = 0;
+			static constexpr std::size_t result_data_size = 4;
+			static constexpr std::size_t status_offset = 0;
+			static constexpr std::size_t version_offset = 1;
+			static constexpr std::size_t version_size = 3;
+		};
+
+		// single cassette dispense command data structure:
+		// tens, units;
+		// result data structure:
+		// command code, bills passed the check sensor,
+		// bills passed the exit sensor, error code, status, rejected bills
+		template <>
+		struct command_descriptor<command_code::upper_dispense> {
+			static constexpr std::size_t command_data_size = 2;
+			static constexpr std::size_t result_data_size = 9;
+			static constexpr std::size_t status_offset = 5;
+			static constexpr std::size_t cassette_field_count = 1;
+			static constexpr cassette_field cassette_fields[cassette_field_count] = {
+				{ cassette::upper, 3, 7 }
+			};
+		};
+
+		template <>
+		struct command_descriptor<command_code::lower_dispense> {
+			static constexpr std::size_t command_data_size = 2;
+			static constexpr std::size_t result_data_size = 9;
+			static constexpr std::size_t status_offset = 5;
+			static constexpr std::size_t cassette_field_count = 1;
+			static constexpr cassette_field cassette_fields[cassette_field_count] = {
+				{ cassette::lower, 3, 7 }
+			};
+		};
+
+		// upper and lower dispense command data structure:
+		// upper tens, upper units, lower tens, lower units;
+		// result data structure:
+		// command code, upper bills passed the check sensor,
+		// upper bills passed the exit sensor,
+		// lower bills passed the check sensor,
+		// lower bills passed the exit sensor,
+		// error code, two status bytes,
+		// upper rejected bills, lower rejected bills
+		template <>
+		struct command_descriptor<command_code::up_low_dispense> {
+			static constexpr std::size_t command_data_size = 4;
+			static constexpr std::size_t result_data_size = 16;
+			static constexpr std::size_t status_offset = 9;
+			static constexpr std::size_t cassette_field_count = 2;
+			static constexpr cassette_field cassette_fields[cassette_field_count] = {
+				{ cassette::upper, 3, 12 },
+				{ cassette::lower, 7, 14 }
+			};
+		};
+
+		// dispense from all cassettes of LCDM-4000 in a single cycle,
+		// the layout extends the up/low dispense to four cassettes
+		// and is not taken from the LCDM-4000 manual
+		// (lcdm::device_model::lcdm_4000 is experimental);
+		// command data structure:
+		// tens and units for every cassette;
+		// result data structure:
+		// command code, for every cassette
+		// bills passed the check sensor and bills passed the exit sensor,
+		// error code, two status bytes,
+		// rejected bills of every cassette
+		template <>
+		struct command_descriptor<command_code::multi_dispense> {
+			static constexpr std::size_t command_data_size = 8;
+			static constexpr std::size_t result_data_size = 28;
+			static constexpr std::size_t status_offset = 17;
+			static constexpr std::size_t cassette_field_count = 4;
+			static constexpr cassette_field cassette_fields[cassette_field_count] = {
+				{ cassette::upper, 3, 20 },
+				{ cassette::lower, 7, 22 },
+				{ cassette::third, 11, 24 },
+				{ cassette::fourth, 15, 26 }
+			};
+		};
+
+		// checks that a command and its result data fit the frame buffers
+		// and that the status byte lies inside the result data
+		template <typename Descriptor>
+		constexpr bool fits_frame() {
+			return (Descriptor::command_data_size <= max_command_data_size)
+				&& (Descriptor::result_data_size <= max_result_data_size)
+				&& (Descriptor::status_offset > 0)
+				&& (Descriptor::status_offset < Descriptor::result_data_size);
+		}
+
+		// checks that the tens and units of every cassette
+		// lie inside the result data of a dispense
+		// and that the command carries tens and units for every cassette
+		template <typename Descriptor>
+		constexpr bool fits_dispense_frame() {
+			if ((!fits_frame<Descriptor>())
+				|| (Descriptor::command_data_size != Descriptor::cassette_field_count * 2)) {
+				return false;
+			}
+
+			for (std::size_t i = 0; i < Descriptor::cassette_field_count; ++i) {
+				if ((Descriptor::cassette_fields[i].dispensed_offset + 1 >= Descriptor::result_data_size)
+					|| (Descriptor::cassette_fields[i].rejected_offset + 1 >= Descriptor::result_data_size)) {
+					return false;
+				}
+			}
+
+			return true;
+		}
+
+		static_assert(fits_frame<command_descriptor<command_code::purge>>(), "purge layout does not fit the frame");
+		static_assert(fits_frame<command_descriptor<command_code::status>>()
+			&& (command_descriptor<command_code::status>::sensor_1_offset < command_descriptor<command_code::status>::result_data_size),
+			"status layout does not fit the frame");
+		static_assert((command_descriptor<command_code::rom_version>::result_data_size <= max_result_data_size)
+			&& (command_descriptor<command_code::rom_version>::version_offset + command_descriptor<command_code::rom_version>::version_size
+				== command_descriptor<command_code::rom_version>::result_data_size),
+			"ROM version layout does not fit the frame");
+		static_assert(fits_dispense_frame<command_descriptor<command_code::upper_dispense>>(), "upper dispense layout does not fit the frame");
+		static_assert(fits_dispense_frame<command_descriptor<command_code::lower_dispense>>(), "lower dispense layout does not fit the frame");
+		static_assert(fits_dispense_frame<command_descriptor<command_code::up_low_dispense>>(), "up/low dispense layout does not fit the frame");
+		static_assert(fits_dispense_frame<command_descriptor<command_code::multi_dispense>>(), "multi dispense layout does not fit the frame");
+
+		// sizes of a response indexed by command code,
+		// zero for commands the driver does not send
+		// and for responses without an error code
+		struct command_layout {
+			std::uint8_t result_data_size = 0;
+			std::uint8_t status_offset = 0;
+		};
+
+		class command_layout_table {
+			public:
+				constexpr command_layout_table() :
+					layouts() {
+					this->add<command_code::purge>();
+					this->add<command_code::status>();
+					this->add<command_code::rom_version>();
+					this->add<command_code::upper_dispense>();
+					this->add<command_code::lower_dispense>();
+					this->add<command_code::up_low_dispense>();
+					this->add<command_code::multi_dispense>();
+				}
+
+				constexpr const command_layout& operator[](std::uint8_t code) const {
+					return this->layouts[code];
+				}
+
+			private:
+				template <command_code Code>
+				constexpr void add() {
+					this->layouts[(std::uint8_t)Code].result_data_size = (std::uint8_t)command_descriptor<Code>::result_data_size;
+					this->layouts[(std::uint8_t)Code].status_offset = (std::uint8_t)command_descriptor<Code>::status_offset;
+				}
+
+			private:
+				command_layout layouts[256];
+		};
+
+		// decoded error code of a response
+		struct status_entry {
+			bool is_known = false;
+			lcdm::operation_status status = lcdm::operation_status::device_error;
+		};
+
+		// operation statuses indexed by error code
+		class status_table {
+			public:
+				constexpr status_table() :
+					entries() {
+					this->set(0x30, lcdm::operation_status::good);
+					this->set(0x31, lcdm::operation_status::normal_stop);
+					this->set(0x32, lcdm::operation_status::pickup_error);
+					this->set(0x33, lcdm::operation_status::jam);
+					this->set(0x34, lcdm::operation_status::overflow_bill);
+					this->set(0x35, lcdm::operation_status::jam);
+					this->set(0x36, lcdm::operation_status::jam);
+					this->set(0x37, lcdm::operation_status::device_error);
+					this->set(0x38, lcdm::operation_status::bill_end);
+					this->set(0x3a, lcdm::operation_status::counting_error);
+					this->set(0x3b, lcdm::operation_status::note_request_error);
+					this->set(0x3c, lcdm::operation_status::counting_error);
+					this->set(0x3d, lcdm::operation_status::counting_error);
+					this->set(0x3f, lcdm::operation_status::device_error);
+					this->set(0x40, lcdm::operation_status::bill_end);
+					this->set(0x41, lcdm::operation_status::device_error);
+					this->set(0x42, lcdm::operation_status::jam);
+					this->set(0x43, lcdm::operation_status::timeout);
+					this->set(0x44, lcdm::operation_status::over_reject);
+					this->set(0x45, lcdm::operation_status::device_error);
+					this->set(0x46, lcdm::operation_status::device_error);
+					this->set(0x47, lcdm::operation_status::timeout);
+					this->set(0x48, lcdm::operation_status::jam);
+					this->set(0x49, lcdm::operation_status::device_error);
+					this->set(0x4a, lcdm::operation_status::device_error);
+					this->set(0x4c, lcdm::operation_status::jam);
+					this->set(0x4e, lcdm::operation_status::jam);
+				}
+
+				constexpr const status_entry& operator[](std::uint8_t code) const {
+					return this->entries[code];
+				}
+
+			private:
+				constexpr void set(std::uint8_t code, lcdm::operation_status status) {
+					this->entries[code].is_known = true;
+					this->entries[code].status = status;
+				}
+
+			private:
+				status_entry entries[256];
+		};
+
+		// dispense command of a device model
+		// and the cassettes it dispenses from
+		struct dispense_command {
+			command_code code = command_code::unknown;
+			// bit per cassette
+			std::uint8_t cassette_mask = 0;
+		};
+
+		template <command_code Code>
+		constexpr dispense_command make_dispense_command() {
+			typedef command_descriptor<Code> descriptor;
+
+			dispense_command new_command;
+			new_command.code = Code;
+			for (std::size_t i = 0; i < descriptor::cassette_field_count; ++i) {
+				new_command.cassette_mask |= (std::uint8_t)(1 << (std::uint32_t)descriptor::cassette_fields[i].source);
+			}
+
+			return new_command;
+		}
+
+		const std::size_t max_dispense_command_count = 3;
+
+		// cassettes and dispense commands of a device model,
+		// status and purge are common to the family
+		struct device_profile {
+			std::size_t cassette_count = 0;
+			dispense_command dispense_commands[max_dispense_command_count];
+			std::size_t dispense_command_count = 0;
+			// single cassette dispenses can share an up/low dispense
+			bool supports_coalescing = false;
+
+			// returns the command that dispenses from the cassettes of the mask
+			// and from the fewest other cassettes,
+			// cassettes without bills are sent zero bills;
+			// returns command_code::unknown if no command covers the mask
+			constexpr command_code select_dispense_command(std::uint8_t requested_mask) const {
+				command_code selected_code = command_code::unknown;
+				std::size_t selected_cassette_count = max_cassette_count + 1;
+
+				for (std::size_t i = 0; i < this->dispense_command_count; ++i) {
+					const dispense_command& current_command = this->dispense_commands[i];
+					std::size_t current_cassette_count = 0;
+					for (std::uint8_t mask = current_command.cassette_mask; mask != 0; mask &= (std::uint8_t)(mask - 1)) {
+						++current_cassette_count;
+					}
+
+					if (((current_command.cassette_mask & requested_mask) == requested_mask)
+						&& (current_cassette_count < selected_cassette_count)) {
+						selected_code = current_command.code;
+						selected_cassette_count = current_cassette_count;
+					}
+				}
+
+				return selected_code;
+			}
+		};
+
+		class device_profile_table {
+			public:
+				constexpr device_profile_table() :
+					lcdm_2000(),
+					lcdm_4000() {
+					this->lcdm_2000.cassette_count = 2;
+					this->lcdm_2000.dispense_commands[0] = make_dispense_command<command_code::upper_dispense>();
+					this->lcdm_2000.dispense_commands[1] = make_dispense_command<command_code::lower_dispense>();
+					this->lcdm_2000.dispense_commands[2] = make_dispense_command<command_code::up_low_dispense>();
+					this->lcdm_2000.dispense_command_count = 3;
+					this->lcdm_2000.supports_coalescing = true;
+
+					this->lcdm_4000.cassette_count = 4;
+					this->lcdm_4000.dispense_commands[0] = make_dispense_command<command_code::multi_dispense>();
+					this->lcdm_4000.dispense_command_count = 1;
+				}
+
+				constexpr const device_profile& operator[](lcdm::device_model model) const {
+					return (model == lcdm::device_model::lcdm_4000) ? this->lcdm_4000 : this->lcdm_2000;
+				}
+
+			private:
+				device_profile lcdm_2000;
+				device_profile lcdm_4000;
+		};
+
+		constexpr command_layout_table command_layouts;
+		constexpr status_table operation_statuses;
+		constexpr device_profile_table device_profiles;
+
+		static_assert(operation_statuses[0x30].is_known && (operation_statuses[0x30].status == lcdm::operation_status::good), "good status is not decoded");
+		static_assert(!operation_statuses[0x39].is_known, "reserved status is decoded");
+		static_assert((device_profiles[lcdm::device_model::lcdm_2000].select_dispense_command(0x01) == command_code::upper_dispense)
+			&& (device_profiles[lcdm::device_model::lcdm_2000].select_dispense_command(0x03) == command_code::up_low_dispense)
+			&& (device_profiles[lcdm::device_model::lcdm_2000].select_dispense_command(0x04) == command_code::unknown)
+			&& (device_profiles[lcdm::device_model::lcdm_4000].select_dispense_command(0x02) == command_code::multi_dispense),
+			"dispense commands are not selected");
+
+		// returns the size of result data
+		// in the response to a command
+		// or zero if the command is unknown
+		constexpr std::size_t get_result_data_size(std::uint8_t code) {
+			return command_layouts[code].result_data_size;
+		}
+
+		// returns the offset of the error code
+		// in the result data of a command
+		// or zero if the command is unknown
+		// or its response has no error code
+		constexpr std::size_t get_status_code_offset(std::uint8_t code) {
+			return command_layouts[code].status_offset;
+		}
+
+	}
+
+}
+
+#endif // PROTOCOL_H
@@ -0,0 +1,100 @@
+#include "lcdm_replay_transport.h"
+#include <algorithm>
+#include <cstring>
+
+using namespace boost::asio;
+using namespace puloon;
+using namespace puloon::detail;
+
+replay_transport::replay_transport(boost::asio::io_service& io_service, std::vector<capture_record> records) :
+	lcdm_transport(),
+	io_service(io_service),
+	records(std::move(records)),
+	record_index(0),
+	record_offset(0),
+	read_buffer(),
+	read_handler(),
+	closed(false) { }
+
+void replay_transport::async_write(const write_buffers& buffers, io_handler handler) {
+	if (this->closed) {
+		this->post_handler(std::move(handler), error::bad_descriptor, 0);
+		return;
+	}
+
+	this->skip_transmitted_records();
+	this->post_handler(std::move(handler), boost::system::error_code(), buffer_size(buffers));
+}
+
+void replay_transport::async_read_some(const boost::asio::mutable_buffer& buffer, io_handler handler) {
+	if (this->closed) {
+		this->post_handler(std::move(handler), error::bad_descriptor, 0);
+		return;
+	}
+
+	this->read_buffer = buffer;
+	this->read_handler = std::move(handler);
+	this->complete_read();
+}
+
+void replay_transport::cancel() {
+	if (!this->read_handler) {
+		return;
+	}
+
+	// the deadline of the engine ends the silence
+	if ((this->record_index < this->records.size())
+		&& (this->records[this->record_index].type == capture_record_type::timeout)) {
+		++this->record_index;
+		this->record_offset = 0;
+	}
+
+	this->post_handler(std::move(this->read_handler), error::operation_aborted, 0);
+	this->read_handler = nullptr;
+}
+
+void replay_transport::close() {
+	this->closed = true;
+
+	if (this->read_handler) {
+		this->post_handler(std::move(this->read_handler), error::operation_aborted, 0);
+		this->read_handler = nullptr;
+	}
+}
+
+void replay_transport::skip_transmitted_records() {
+	// a write also ends a silence that is recorded
+	// as a timeout of the capturing engine
+	while ((this->record_index < this->records.size())
+		&& (this->records[this->record_index].type != capture_record_type::received)) {
+		++this->record_index;
+		this->record_offset = 0;
+	}
+}
+
+void replay_transport::complete_read() {
+	if ((this->record_index >= this->records.size())
+		|| (this->records[this->record_index].type != capture_record_type::received)) {
+		// the device was silent, the read is pending
+		return;
+	}
+
+	const capture_record& current_record = this->records[this->record_index];
+	const std::size_t bytes_transferred = std::min(this->read_buffer.size(), current_record.data_size - this->record_offset);
+	std::memcpy(this->read_buffer.data(), current_record.data.data() + this->record_offset, bytes_transferred);
+
+	this->record_offset += bytes_transferred;
+	if (this->record_offset == current_record.data_size) {
+		++this->record_index;
+		this->record_offset = 0;
+	}
+
+	this->post_handler(std::move(this->read_handler), boost::system::error_code(), bytes_transferred);
+	this->read_handler = nullptr;
+}
+
+void replay_transport::post_handler(io_handler handler, const boost::system::error_code& error, std::size_t bytes_transferred) {
+	post(this->io_service, [handler = std::move(handler), error, bytes_transferred]() {
+		handler(error, bytes_transferred);
+	});
+}
@@ -0,0 +1,52 @@
+#ifndef REPLAY_TRANSPORT_H
+#define REPLAY_TRANSPORT_H
+
+#include "lcdm_transport.h"
+#include <vector>
+#include <boost/asio.hpp>
+#include "lcdm_capture.h"
+
+namespace puloon {
+
+	namespace detail {
+
+		// transport that plays the received data of a capture back
+		// as fast as the engine reads it;
+		// written data is skipped, and silence of the device
+		// in the capture is replayed as a read
+		// that is pending until the deadline of the engine cancels it
+		class replay_transport : public lcdm_transport {
+			public:
+				replay_transport(boost::asio::io_service& io_service, std::vector<capture_record> records);
+				virtual ~replay_transport() override = default;
+
+				virtual void async_write(const write_buffers& buffers, io_handler handler) override;
+				virtual void async_read_some(const boost::asio::mutable_buffer& buffer, io_handler handler) override;
+				virtual void cancel() override;
+				virtual void close() override;
+
+			private:
+				// skips records that are not received data
+				// except the ones that mark silence of the device
+				void skip_transmitted_records();
+				// copies received data into the buffer of the pending read
+				// if the next record holds received data
+				void complete_read();
+				void post_handler(io_handler handler, const boost::system::error_code& error, std::size_t bytes_transferred);
+
+			private:
+				boost::asio::io_service& io_service;
+				std::vector<capture_record> records;
+				// next record and the offset of its next byte
+				std::size_t record_index;
+				std::size_t record_offset;
+				boost::asio::mutable_buffer read_buffer;
+				io_handler read_handler;
+				bool closed;
+		};
+
+	}
+
+}
+
+#endif // REPLAY_TRANSPORT_H
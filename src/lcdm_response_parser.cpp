@@ -0,0 +1,97 @@
+#include "lcdm_response_parser.h"
+#include "lcdm_frame.h"
+
+using namespace puloon;
+using namespace puloon::detail;
+
+response_parser::response_parser() :
+	state(parse_state::wait_soh),
+	result_data(),
+	result_data_size(0),
+	received_result_data_size(0),
+	bcc(0) { }
+
+void response_parser::reset() {
+	this->state = parse_state::wait_soh;
+	this->result_data_size = 0;
+	this->received_result_data_size = 0;
+	this->bcc = 0;
+}
+
+response_parser::parse_result response_parser::parse(const std::uint8_t*& begin, const std::uint8_t* end) {
+	while (begin != end) {
+		parse_result current_result = this->parse_byte(*begin++);
+
+		if (current_result != parse_result::incomplete) {
+			return current_result;
+		}
+	}
+
+	return parse_result::incomplete;
+}
+
+data_view response_parser::get_result_data() const {
+	return data_view(this->result_data.data(), this->result_data_size);
+}
+
+response_parser::parse_result response_parser::parse_byte(std::uint8_t value) {
+	switch (this->state) {
+		case parse_state::wait_soh:
+		case parse_state::wait_id:
+		case parse_state::wait_stx:
+			if ((this->state == parse_state::wait_id) && (value == id)) {
+				this->state = parse_state::wait_stx;
+			} else if ((this->state == parse_state::wait_stx) && (value == stx)) {
+				this->state = parse_state::wait_command_code;
+			} else {
+				this->resynchronize(value);
+			}
+			break;
+		case parse_state::wait_command_code:
+			this->result_data_size = get_result_data_size(value);
+
+			if ((this->result_data_size == 0) || (this->result_data_size > this->result_data.size())) {
+				// unknown command, the header was a part of noise
+				this->resynchronize(value);
+			} else {
+				this->bcc = soh ^ id ^ stx ^ value;
+				this->result_data[0] = value;
+				this->received_result_data_size = 1;
+				this->state = (this->received_result_data_size < this->result_data_size) ? parse_state::read_result_data : parse_state::wait_etx;
+			}
+			break;
+		case parse_state::read_result_data:
+			this->bcc ^= value;
+			this->result_data[this->received_result_data_size++] = value;
+
+			if (this->received_result_data_size == this->result_data_size) {
+				this->state = parse_state::wait_etx;
+			}
+			break;
+		case parse_state::wait_etx:
+			if (value == etx) {
+				this->bcc ^= value;
+				this->state = parse_state::wait_bcc;
+			} else {
+				// a byte of the frame is lost or inserted,
+				// the frame is requested again;
+				// the byte may start the next frame
+				this->resynchronize(value);
+				return parse_result::corrupted;
+			}
+			break;
+		case parse_state::wait_bcc:
+			this->state = parse_state::wait_soh;
+			return (value == this->bcc) ? parse_result::completed : parse_result::corrupted;
+	}
+
+	return parse_result::incomplete;
+}
+
+void response_parser::resynchronize(std::uint8_t value) {
+	this->reset();
+
+	if (value == soh) {
+		this->state = parse_state::wait_id;
+	}
+}
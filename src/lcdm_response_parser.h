@@ -0,0 +1,72 @@
+#ifndef RESPONSE_PARSER_H
+#define RESPONSE_PARSER_H
+
+#include <array>
+#include "lcdm_operations.h"
+
+namespace puloon {
+
+	namespace detail {
+
+		// byte-driven parser of response frames
+		// (SOH, ID, STX, result data, ETX, BCC);
+		// accepts data in chunks of any size,
+		// skips bytes that do not belong to a frame
+		// and takes the result data size from the command code
+		class response_parser {
+			public:
+				enum class parse_result {
+					// more data is needed
+					incomplete,
+					// a frame with correct bcc is received
+					completed,
+					// a frame with incorrect ETX or bcc is received
+					corrupted
+				};
+
+			public:
+				response_parser();
+
+				// drops a partially received frame
+				void reset();
+				// consumes data until a frame is completed or corrupted,
+				// unconsumed data is left for the next call
+				parse_result parse(const std::uint8_t*& begin, const std::uint8_t* end);
+				// result data of the completed frame
+				data_view get_result_data() const;
+				// a frame header has been received
+				// and the rest of the frame is awaited
+				bool is_receiving_frame() const {
+					return (this->state != parse_state::wait_soh);
+				}
+
+			private:
+				enum class parse_state {
+					wait_soh,
+					wait_id,
+					wait_stx,
+					wait_command_code,
+					read_result_data,
+					wait_etx,
+					wait_bcc
+				};
+
+			private:
+				parse_result parse_byte(std::uint8_t value);
+				// restarts the search of a frame header
+				// from the given byte
+				void resynchronize(std::uint8_t value);
+
+			private:
+				parse_state state;
+				std::array<std::uint8_t, max_result_data_size> result_data;
+				std::size_t result_data_size;
+				std::size_t received_result_data_size;
+				std::uint8_t bcc;
+		};
+
+	}
+
+}
+
+#endif // RESPONSE_PARSER_H
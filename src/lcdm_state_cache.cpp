@@ -0,0 +1,91 @@
+#include "lcdm_state_cache.h"
+
+using namespace puloon;
+using namespace puloon::detail;
+
+// layout of the packed status
+const std::uint32_t sensor_0_shift = 8;
+const std::uint32_t sensor_1_shift = 16;
+const std::uint32_t known_flag = 0x01000000;
+const std::uint32_t responding_flag = 0x02000000;
+
+// sensor bits of the status response
+const std::uint8_t bill_in_exit_path_bit = 0x10;
+const std::uint8_t upper_cassette_near_end_bit = 0x01;
+const std::uint8_t lower_cassette_near_end_bit = 0x02;
+const std::uint8_t upper_cassette_present_bit = 0x04;
+const std::uint8_t lower_cassette_present_bit = 0x08;
+
+state_cache::state_cache() :
+	sequence(0),
+	packed_status(0),
+	update_time(0),
+	capabilities() { }
+
+void state_cache::store_status(lcdm::operation_status last_error, std::uint8_t sensor_0, std::uint8_t sensor_1) {
+	const std::uint32_t status = (std::uint32_t)last_error
+		| ((std::uint32_t)sensor_0 << sensor_0_shift)
+		| ((std::uint32_t)sensor_1 << sensor_1_shift)
+		| known_flag
+		| responding_flag;
+
+	this->store(status, std::chrono::steady_clock::now().time_since_epoch().count());
+}
+
+void state_cache::store_failure() {
+	const std::uint32_t status = this->packed_status.load(std::memory_order_relaxed) & ~responding_flag;
+
+	this->store(status, this->update_time.load(std::memory_order_relaxed));
+}
+
+lcdm::device_state state_cache::load() const {
+	std::uint32_t status = 0;
+	std::int64_t time = 0;
+	std::uint32_t start_sequence = 0;
+
+	do {
+		start_sequence = this->sequence.load(std::memory_order_acquire);
+		status = this->packed_status.load(std::memory_order_relaxed);
+		time = this->update_time.load(std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_acquire);
+	} while (((start_sequence & 1) != 0) || (start_sequence != this->sequence.load(std::memory_order_relaxed)));
+
+	const std::uint8_t sensor_0 = (std::uint8_t)(status >> sensor_0_shift);
+	const std::uint8_t sensor_1 = (std::uint8_t)(status >> sensor_1_shift);
+
+	lcdm::device_state state;
+	state.is_known = ((status & known_flag) != 0);
+	state.is_responding = ((status & responding_flag) != 0);
+	state.update_time = std::chrono::steady_clock::time_point(std::chrono::steady_clock::duration(time));
+	state.last_error = (lcdm::operation_status)(status & 0xff);
+	state.bill_in_exit_path = ((sensor_0 & bill_in_exit_path_bit) != 0);
+	state.upper_cassette_near_end = ((sensor_1 & upper_cassette_near_end_bit) != 0);
+	state.lower_cassette_near_end = ((sensor_1 & lower_cassette_near_end_bit) != 0);
+	state.upper_cassette_present = ((sensor_1 & upper_cassette_present_bit) != 0);
+	state.lower_cassette_present = ((sensor_1 & lower_cassette_present_bit) != 0);
+	state.sensor_0 = sensor_0;
+	state.sensor_1 = sensor_1;
+
+	return state;
+}
+
+void state_cache::store_capabilities(const lcdm::device_capabilities& capabilities) {
+	std::atomic_store(&this->capabilities, std::shared_ptr<const lcdm::device_capabilities>(std::make_shared<lcdm::device_capabilities>(capabilities)));
+}
+
+lcdm::device_capabilities state_cache::load_capabilities() const {
+	const std::shared_ptr<const lcdm::device_capabilities> current_capabilities = std::atomic_load(&this->capabilities);
+
+	// value-initialized capabilities are unknown
+	return current_capabilities ? *current_capabilities : lcdm::device_capabilities();
+}
+
+void state_cache::store(std::uint32_t status, std::int64_t time) {
+	const std::uint32_t current_sequence = this->sequence.load(std::memory_order_relaxed);
+
+	this->sequence.store(current_sequence + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	this->packed_status.store(status, std::memory_order_relaxed);
+	this->update_time.store(time, std::memory_order_relaxed);
+	this->sequence.store(current_sequence + 2, std::memory_order_release);
+}
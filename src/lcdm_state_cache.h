@@ -0,0 +1,58 @@
+#ifndef STATE_CACHE_H
+#define STATE_CACHE_H
+
+#include "lcdm.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+
+namespace puloon {
+
+	namespace detail {
+
+		// last known state of the device,
+		// written by the engine and read from any thread;
+		// a sequence counter lets readers detect a concurrent update
+		// and retry, so neither side ever blocks
+		class state_cache {
+			public:
+				state_cache();
+
+				state_cache(const state_cache&) = delete;
+				state_cache& operator=(const state_cache&) = delete;
+
+				// stores a status response,
+				// only the engine writes
+				void store_status(lcdm::operation_status last_error, std::uint8_t sensor_0, std::uint8_t sensor_1);
+				// marks the device as not responding,
+				// the last status is kept
+				void store_failure();
+				// returns a consistent copy of the state
+				lcdm::device_state load() const;
+				// replaces the capabilities found by a probe,
+				// only the engine writes
+				void store_capabilities(const lcdm::device_capabilities& capabilities);
+				// returns the last stored capabilities,
+				// unknown until a probe has succeeded
+				lcdm::device_capabilities load_capabilities() const;
+
+			private:
+				void store(std::uint32_t status, std::int64_t time);
+
+			private:
+				// odd while an update is in progress
+				std::atomic<std::uint32_t> sequence;
+				// flags, last error and sensor bytes
+				std::atomic<std::uint32_t> packed_status;
+				// steady clock time of the last status response
+				std::atomic<std::int64_t> update_time;
+				// replaced atomically, probes are rare
+				std::shared_ptr<const lcdm::device_capabilities> capabilities;
+		};
+
+	}
+
+}
+
+#endif // STATE_CACHE_H
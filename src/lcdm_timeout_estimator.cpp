@@ -0,0 +1,111 @@
+#include "lcdm_timeout_estimator.h"
+#include <algorithm>
+#include <iterator>
+
+using namespace puloon;
+using namespace puloon::detail;
+
+// smallest spread of the deadline over the smoothed latency
+const std::int64_t timeout_granularity_us = 1000;
+
+// smallest number of bills of every load class but the first,
+// a multi cassette dispense takes up to 60 bills
+// from each of the four cassettes of LCDM-4000
+const std::uint32_t load_class_bills[] = { 1, 10, 30, 60, 120, 180, 240 };
+
+const std::uint32_t latency_estimator::max_backoff_shift;
+const std::size_t timeout_estimator::load_class_count;
+
+latency_estimator::latency_estimator() :
+	has_samples(false),
+	smoothed_latency_us(0),
+	latency_deviation_us(0),
+	backoff_shift(0) { }
+
+void latency_estimator::record(std::chrono::steady_clock::duration latency) {
+	const std::int64_t latency_us = std::chrono::duration_cast<std::chrono::microseconds>(latency).count();
+
+	if (!this->has_samples) {
+		this->has_samples = true;
+		this->smoothed_latency_us = latency_us;
+		this->latency_deviation_us = latency_us / 2;
+	} else {
+		const std::int64_t error_us = latency_us - this->smoothed_latency_us;
+		this->smoothed_latency_us += error_us / 8;
+		this->latency_deviation_us += (((error_us < 0) ? -error_us : error_us) - this->latency_deviation_us) / 4;
+	}
+
+	this->backoff_shift = 0;
+}
+
+void latency_estimator::back_off() {
+	this->backoff_shift = std::min(this->backoff_shift + 1, max_backoff_shift);
+}
+
+std::chrono::milliseconds latency_estimator::get_timeout(std::chrono::milliseconds initial_timeout,
+	std::chrono::milliseconds min_timeout, std::chrono::milliseconds max_timeout) const {
+	std::chrono::milliseconds timeout = initial_timeout;
+
+	if (this->has_samples) {
+		const std::int64_t timeout_us = this->smoothed_latency_us + std::max(timeout_granularity_us, 4 * this->latency_deviation_us);
+		timeout = std::chrono::milliseconds((timeout_us + 999) / 1000);
+		timeout = std::min(std::max(timeout, min_timeout), max_timeout);
+	}
+
+	// the configured initial timeout is never cut by the bounds
+	return std::min(timeout * (1 << this->backoff_shift), std::max(max_timeout, initial_timeout));
+}
+
+timeout_estimator::timeout_estimator(const lcdm::timeouts& port_timeouts) :
+	port_timeouts(port_timeouts),
+	ack_estimators(),
+	response_estimators() { }
+
+std::chrono::milliseconds timeout_estimator::get_ack_timeout(std::uint8_t code) const {
+	if (!this->port_timeouts.adaptive) {
+		return this->port_timeouts.ack_timeout;
+	}
+
+	return this->ack_estimators[code].get_timeout(this->port_timeouts.ack_timeout,
+		this->port_timeouts.min_ack_timeout, this->port_timeouts.max_ack_timeout);
+}
+
+std::chrono::milliseconds timeout_estimator::get_response_timeout(std::uint8_t code, std::uint32_t bills) const {
+	if (!this->port_timeouts.adaptive) {
+		return this->port_timeouts.response_timeout;
+	}
+
+	return this->response_estimators[code][get_load_class(bills)].get_timeout(this->port_timeouts.response_timeout,
+		this->port_timeouts.min_response_timeout, this->port_timeouts.max_response_timeout);
+}
+
+int timeout_estimator::get_try_count() const {
+	return std::max(this->port_timeouts.try_count, 1);
+}
+
+std::chrono::milliseconds timeout_estimator::get_probe_timeout() const {
+	return this->port_timeouts.probe_timeout;
+}
+
+void timeout_estimator::record_ack_latency(std::uint8_t code, std::chrono::steady_clock::duration latency) {
+	this->ack_estimators[code].record(latency);
+}
+
+void timeout_estimator::record_response_latency(std::uint8_t code, std::uint32_t bills, std::chrono::steady_clock::duration latency) {
+	this->response_estimators[code][get_load_class(bills)].record(latency);
+}
+
+void timeout_estimator::back_off_ack(std::uint8_t code) {
+	this->ack_estimators[code].back_off();
+}
+
+void timeout_estimator::back_off_response(std::uint8_t code, std::uint32_t bills) {
+	this->response_estimators[code][get_load_class(bills)].back_off();
+}
+
+std::size_t timeout_estimator::get_load_class(std::uint32_t bills) {
+	static_assert(sizeof(load_class_bills) / sizeof(load_class_bills[0]) + 1 == load_class_count, "every load class needs its bills");
+
+	// the mechanical part grows with the bills of a command
+	return (std::size_t)(std::upper_bound(std::begin(load_class_bills), std::end(load_class_bills), bills) - std::begin(load_class_bills));
+}
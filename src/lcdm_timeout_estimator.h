@@ -0,0 +1,79 @@
+#ifndef TIMEOUT_ESTIMATOR_H
+#define TIMEOUT_ESTIMATOR_H
+
+#include "lcdm.h"
+#include <array>
+#include <chrono>
+#include <cstdint>
+
+namespace puloon {
+
+	namespace detail {
+
+		// running estimate of the latency of an exchange
+		// (Jacobson/Karels): the smoothed latency gains 1/8
+		// and the mean deviation 1/4 of every new sample
+		class latency_estimator {
+			public:
+				latency_estimator();
+
+				void record(std::chrono::steady_clock::duration latency);
+				// doubles the timeout after an expired deadline
+				// until the next latency is recorded
+				void back_off();
+				// returns the smoothed latency plus four mean deviations
+				// within the bounds, or the initial timeout
+				// until a latency has been recorded
+				std::chrono::milliseconds get_timeout(std::chrono::milliseconds initial_timeout,
+					std::chrono::milliseconds min_timeout, std::chrono::milliseconds max_timeout) const;
+
+			private:
+				bool has_samples;
+				std::int64_t smoothed_latency_us;
+				std::int64_t latency_deviation_us;
+				std::uint32_t backoff_shift;
+
+				static const std::uint32_t max_backoff_shift = 6;
+		};
+
+		// deadlines of the command exchange
+		// from the latencies observed for every command code;
+		// a mechanical response is estimated separately
+		// for ranges of the number of bills up to a dispense
+		// of every cassette of the largest device;
+		// used only on the strand of the engine
+		class timeout_estimator {
+			public:
+				explicit timeout_estimator(const lcdm::timeouts& port_timeouts);
+
+				std::chrono::milliseconds get_ack_timeout(std::uint8_t code) const;
+				std::chrono::milliseconds get_response_timeout(std::uint8_t code, std::uint32_t bills) const;
+				int get_try_count() const;
+				// fixed deadline of the probe commands,
+				// probes do not adapt and do not back off
+				std::chrono::milliseconds get_probe_timeout() const;
+
+				// latencies of exchanges that were repeated are ambiguous
+				// and are not recorded (Karn's algorithm)
+				void record_ack_latency(std::uint8_t code, std::chrono::steady_clock::duration latency);
+				void record_response_latency(std::uint8_t code, std::uint32_t bills, std::chrono::steady_clock::duration latency);
+				void back_off_ack(std::uint8_t code);
+				void back_off_response(std::uint8_t code, std::uint32_t bills);
+
+			private:
+				static std::size_t get_load_class(std::uint32_t bills);
+
+			private:
+				static const std::size_t load_class_count = 8;
+
+				lcdm::timeouts port_timeouts;
+				std::array<latency_estimator, 256> ack_estimators;
+				// indexed by command code and load class
+				std::array<std::array<latency_estimator, load_class_count>, 256> response_estimators;
+		};
+
+	}
+
+}
+
+#endif // TIMEOUT_ESTIMATOR_H
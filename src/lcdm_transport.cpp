@@ -0,0 +1,336 @@
+#include "lcdm_transport.h"
+#include <algorithm>
+#include <mutex>
+
+using namespace boost::asio;
+using namespace puloon;
+
+// serial port parameters
+const serial_port::baud_rate baud_rate(9600);
+const serial_port::character_size char_size(8);
+const serial_port::parity parity(serial_port::parity::none);
+const serial_port::stop_bits stop_bits(serial_port::stop_bits::one);
+const serial_port::flow_control flow_ctrl(serial_port::flow_control::none);
+
+// bytes a pipe holds for an end that is not reading,
+// a few frames of the protocol
+const std::size_t pipe_buffer_size = 256;
+
+constexpr std::chrono::milliseconds tcp_transport::default_connect_timeout;
+
+// posts a handler to the io_service of its transport
+static void post_io_handler(boost::asio::io_service& io_service, lcdm_transport::io_handler handler, const boost::system::error_code& error, std::size_t bytes_transferred) {
+	post(io_service, [handler = std::move(handler), error, bytes_transferred]() {
+		handler(error, bytes_transferred);
+	});
+}
+
+serial_transport::serial_transport(boost::asio::io_service& io_service, const std::string& port_name) :
+	lcdm_transport(),
+	serial_port(io_service, port_name) {
+	this->serial_port.set_option(baud_rate);
+	this->serial_port.set_option(char_size);
+	this->serial_port.set_option(parity);
+	this->serial_port.set_option(stop_bits);
+	this->serial_port.set_option(flow_ctrl);
+}
+
+void serial_transport::async_write(const write_buffers& buffers, io_handler handler) {
+	boost::asio::async_write(this->serial_port, buffers, std::move(handler));
+}
+
+void serial_transport::async_read_some(const boost::asio::mutable_buffer& buffer, io_handler handler) {
+	this->serial_port.async_read_some(boost::asio::buffer(buffer), std::move(handler));
+}
+
+void serial_transport::cancel() {
+	boost::system::error_code ignored_error;
+	this->serial_port.cancel(ignored_error);
+}
+
+void serial_transport::close() {
+	boost::system::error_code ignored_error;
+	this->serial_port.close(ignored_error);
+}
+
+tcp_transport::tcp_transport(boost::asio::io_service& io_service, const std::string& host, const std::string& service,
+	std::chrono::milliseconds connect_timeout) :
+	lcdm_transport(),
+	socket(io_service) {
+	// the io_service of the engine may not be running yet,
+	// the connection is made on an io_service of its own
+	// and the connected socket is handed over
+	boost::asio::io_service connect_io_service;
+	ip::tcp::resolver resolver(connect_io_service);
+	ip::tcp::socket connecting_socket(connect_io_service);
+	steady_timer deadline_timer(connect_io_service);
+	boost::system::error_code connect_error;
+	bool deadline_expired = false;
+
+	deadline_timer.expires_after(connect_timeout);
+	deadline_timer.async_wait([&resolver, &connecting_socket, &deadline_expired](const boost::system::error_code& error) {
+		if (!error) {
+			// the pending resolution or connection
+			// completes with operation_aborted
+			deadline_expired = true;
+			resolver.cancel();
+			boost::system::error_code ignored_error;
+			connecting_socket.close(ignored_error);
+		}
+	});
+
+	resolver.async_resolve(host, service,
+		[&connecting_socket, &deadline_timer, &connect_error](const boost::system::error_code& error, ip::tcp::resolver::results_type endpoints) {
+			if (error) {
+				connect_error = error;
+				deadline_timer.cancel();
+				return;
+			}
+
+			boost::asio::async_connect(connecting_socket, endpoints,
+				[&deadline_timer, &connect_error](const boost::system::error_code& error, const ip::tcp::endpoint&) {
+					connect_error = error;
+					deadline_timer.cancel();
+				});
+		});
+
+	connect_io_service.run();
+
+	if (deadline_expired) {
+		throw boost::system::system_error(error::timed_out);
+	} else if (connect_error) {
+		throw boost::system::system_error(connect_error);
+	}
+
+	const ip::tcp::endpoint remote_endpoint = connecting_socket.remote_endpoint();
+	this->socket.assign(remote_endpoint.protocol(), connecting_socket.release());
+
+	// frames are a few bytes long and must not wait
+	// for more data, a bridge that is gone is found
+	// by the deadlines of the engine
+	this->socket.set_option(ip::tcp::no_delay(true));
+}
+
+void tcp_transport::async_write(const write_buffers& buffers, io_handler handler) {
+	boost::asio::async_write(this->socket, buffers, std::move(handler));
+}
+
+void tcp_transport::async_read_some(const boost::asio::mutable_buffer& buffer, io_handler handler) {
+	this->socket.async_read_some(boost::asio::buffer(buffer), std::move(handler));
+}
+
+void tcp_transport::cancel() {
+	boost::system::error_code ignored_error;
+	this->socket.cancel(ignored_error);
+}
+
+void tcp_transport::close() {
+	boost::system::error_code ignored_error;
+	this->socket.close(ignored_error);
+}
+
+// state of both ends of a pipe,
+// the data written by an end is read by the other one
+struct pipe_transport::channel {
+	struct end_state {
+		end_state() :
+			io_service(nullptr),
+			read_buffer(),
+			read_handler(),
+			write_data(),
+			write_size(0),
+			write_handler(),
+			buffered_data(),
+			buffered_begin(0),
+			buffered_size(0),
+			closed(false) {
+		}
+
+		boost::asio::io_service* io_service;
+		boost::asio::mutable_buffer read_buffer;
+		io_handler read_handler;
+		// part of the pending write that has not been read
+		write_buffers write_data;
+		std::size_t write_size;
+		io_handler write_handler;
+		// ring of written bytes that wait for a read of the other end
+		std::array<std::uint8_t, pipe_buffer_size> buffered_data;
+		std::size_t buffered_begin;
+		std::size_t buffered_size;
+		bool closed;
+	};
+
+	// moves the data written by an end
+	// to the other end and completes the operations
+	// that are done; called with the mutex locked
+	void transfer(std::size_t writer_side);
+	void complete_read(end_state& reader, const boost::system::error_code& error, std::size_t bytes_transferred);
+	void complete_write(end_state& writer, const boost::system::error_code& error);
+
+	std::mutex mutex;
+	std::array<end_state, 2> ends;
+};
+
+static void consume_write_data(lcdm_transport::write_buffers& write_data, std::size_t size) {
+	for (const_buffer& data : write_data) {
+		const std::size_t consumed_size = std::min(size, data.size());
+		data += consumed_size;
+		size -= consumed_size;
+	}
+}
+
+void pipe_transport::channel::transfer(std::size_t writer_side) {
+	end_state& writer = this->ends[writer_side];
+	end_state& reader = this->ends[1 - writer_side];
+
+	// a closed end has no pending operations
+	if (reader.read_handler) {
+		std::size_t read_size = 0;
+
+		if (writer.buffered_size > 0) {
+			// the bytes held by the pipe come first,
+			// from both parts of the ring
+			while ((writer.buffered_size > 0) && (read_size < reader.read_buffer.size())) {
+				const std::size_t chunk_size = std::min(std::min(writer.buffered_size, pipe_buffer_size - writer.buffered_begin),
+					reader.read_buffer.size() - read_size);
+				std::copy_n(writer.buffered_data.data() + writer.buffered_begin, chunk_size, (std::uint8_t*)reader.read_buffer.data() + read_size);
+				writer.buffered_begin = (writer.buffered_begin + chunk_size) % pipe_buffer_size;
+				writer.buffered_size -= chunk_size;
+				read_size += chunk_size;
+			}
+		} else if (writer.write_handler) {
+			// straight from the buffer of the writer
+			// into the buffer of the reader
+			read_size = buffer_copy(reader.read_buffer, writer.write_data);
+			consume_write_data(writer.write_data, read_size);
+		}
+
+		if (read_size > 0) {
+			this->complete_read(reader, boost::system::error_code(), read_size);
+		} else if (writer.closed) {
+			this->complete_read(reader, error::eof, 0);
+		}
+	}
+
+	if (!writer.write_handler) {
+		return;
+	}
+
+	if (reader.closed) {
+		this->complete_write(writer, error::broken_pipe);
+		return;
+	}
+
+	// the rest waits in the ring while it has room
+	for (const_buffer& data : writer.write_data) {
+		while ((data.size() > 0) && (writer.buffered_size < pipe_buffer_size)) {
+			const std::size_t buffered_end = (writer.buffered_begin + writer.buffered_size) % pipe_buffer_size;
+			const std::size_t chunk_size = std::min(std::min(data.size(), pipe_buffer_size - writer.buffered_size),
+				pipe_buffer_size - buffered_end);
+			std::copy_n((const std::uint8_t*)data.data(), chunk_size, writer.buffered_data.data() + buffered_end);
+			writer.buffered_size += chunk_size;
+			data += chunk_size;
+		}
+	}
+
+	if (buffer_size(writer.write_data) == 0) {
+		this->complete_write(writer, boost::system::error_code());
+	}
+}
+
+void pipe_transport::channel::complete_read(end_state& reader, const boost::system::error_code& error, std::size_t bytes_transferred) {
+	post_io_handler(*reader.io_service, std::move(reader.read_handler), error, bytes_transferred);
+	reader.read_handler = nullptr;
+	reader.read_buffer = mutable_buffer();
+}
+
+void pipe_transport::channel::complete_write(end_state& writer, const boost::system::error_code& error) {
+	post_io_handler(*writer.io_service, std::move(writer.write_handler), error, error ? 0 : writer.write_size);
+	writer.write_handler = nullptr;
+	writer.write_data = write_buffers();
+	writer.write_size = 0;
+}
+
+std::pair<std::unique_ptr<pipe_transport>, std::unique_ptr<pipe_transport>> pipe_transport::create_pair(
+	boost::asio::io_service& first_io_service, boost::asio::io_service& second_io_service) {
+	std::shared_ptr<channel> shared_channel = std::make_shared<channel>();
+	shared_channel->ends[0].io_service = &first_io_service;
+	shared_channel->ends[1].io_service = &second_io_service;
+
+	return std::make_pair(std::unique_ptr<pipe_transport>(new pipe_transport(shared_channel, 0)),
+		std::unique_ptr<pipe_transport>(new pipe_transport(shared_channel, 1)));
+}
+
+pipe_transport::pipe_transport(std::shared_ptr<channel> shared_channel, std::size_t side) :
+	lcdm_transport(),
+	shared_channel(std::move(shared_channel)),
+	side(side) { }
+
+pipe_transport::~pipe_transport() {
+	this->close();
+}
+
+void pipe_transport::async_write(const write_buffers& buffers, io_handler handler) {
+	std::lock_guard<std::mutex> channel_lock(this->shared_channel->mutex);
+	channel::end_state& writer = this->shared_channel->ends[this->side];
+
+	if (writer.closed) {
+		post_io_handler(*writer.io_service, std::move(handler), error::bad_descriptor, 0);
+		return;
+	}
+
+	writer.write_data = buffers;
+	writer.write_size = buffer_size(buffers);
+	writer.write_handler = std::move(handler);
+	this->shared_channel->transfer(this->side);
+}
+
+void pipe_transport::async_read_some(const boost::asio::mutable_buffer& buffer, io_handler handler) {
+	std::lock_guard<std::mutex> channel_lock(this->shared_channel->mutex);
+	channel::end_state& reader = this->shared_channel->ends[this->side];
+
+	if (reader.closed) {
+		post_io_handler(*reader.io_service, std::move(handler), error::bad_descriptor, 0);
+		return;
+	}
+
+	reader.read_buffer = buffer;
+	reader.read_handler = std::move(handler);
+	// a write of the other end waiting for room
+	// in the ring is moved on by the same transfer
+	this->shared_channel->transfer(1 - this->side);
+}
+
+void pipe_transport::cancel() {
+	std::lock_guard<std::mutex> channel_lock(this->shared_channel->mutex);
+	channel::end_state& current_end = this->shared_channel->ends[this->side];
+
+	// a write is not cancelled, its bytes may have been read
+	if (current_end.read_handler) {
+		this->shared_channel->complete_read(current_end, error::operation_aborted, 0);
+	}
+}
+
+void pipe_transport::close() {
+	std::lock_guard<std::mutex> channel_lock(this->shared_channel->mutex);
+	channel::end_state& current_end = this->shared_channel->ends[this->side];
+
+	if (current_end.closed) {
+		return;
+	}
+
+	current_end.closed = true;
+	// the bytes held for the other end are still delivered
+	if (current_end.read_handler) {
+		this->shared_channel->complete_read(current_end, error::operation_aborted, 0);
+	}
+
+	if (current_end.write_handler) {
+		this->shared_channel->complete_write(current_end, error::operation_aborted);
+	}
+
+	// the other end reads the end of the stream
+	// and its pending write fails
+	this->shared_channel->transfer(this->side);
+	this->shared_channel->transfer(1 - this->side);
+}
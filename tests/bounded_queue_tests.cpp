@@ -0,0 +1,98 @@
+#include "test.h"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "lcdm_bounded_queue.h"
+
+using namespace puloon;
+using namespace puloon::detail;
+
+// values are popped in the order they were pushed
+// and a full queue refuses a value until one is popped
+static void test_fifo_order_and_capacity() {
+	bounded_queue<int> queue(4);
+	test::check(queue.capacity() == 4, "capacity is not kept");
+
+	for (int i = 0; i < 4; ++i) {
+		int value = i;
+		test::check(queue.try_push(std::move(value)), "value is not pushed into a queue with room");
+	}
+
+	int extra_value = 4;
+	test::check(!queue.try_push(std::move(extra_value)), "value is pushed into a full queue");
+
+	int value = -1;
+	test::check(queue.try_pop(value) && (value == 0), "first value is not popped first");
+	extra_value = 4;
+	test::check(queue.try_push(std::move(extra_value)), "value is not pushed after a pop");
+
+	for (int expected_value = 1; expected_value <= 4; ++expected_value) {
+		test::check(queue.try_pop(value) && (value == expected_value), "values are not popped in order");
+	}
+
+	test::check(!queue.try_pop(value), "value is popped from an empty queue");
+}
+
+// move-only values are moved through the queue
+static void test_move_only_values() {
+	bounded_queue<std::unique_ptr<int>> queue(2);
+
+	std::unique_ptr<int> pushed_value(new int(42));
+	test::check(queue.try_push(std::move(pushed_value)), "move-only value is not pushed");
+
+	std::unique_ptr<int> popped_value;
+	test::check(queue.try_pop(popped_value) && popped_value && (*popped_value == 42), "move-only value is not popped");
+}
+
+// every value pushed by several producers
+// is popped exactly once by several consumers
+static void test_concurrent_producers_and_consumers() {
+	const std::size_t thread_count = 4;
+	const std::uint32_t values_per_producer = 20000;
+
+	bounded_queue<std::uint32_t> queue(64);
+	std::vector<std::atomic<std::uint32_t>> pop_counts(thread_count * values_per_producer);
+	for (std::atomic<std::uint32_t>& pop_count : pop_counts) {
+		pop_count.store(0);
+	}
+	std::atomic<std::uint32_t> popped_value_count(0);
+
+	std::vector<std::thread> threads;
+	for (std::size_t i = 0; i < thread_count; ++i) {
+		threads.emplace_back([&queue, i, values_per_producer]() {
+			for (std::uint32_t j = 0; j < values_per_producer; ++j) {
+				std::uint32_t value = (std::uint32_t)i * values_per_producer + j;
+				while (!queue.try_push(std::move(value))) {
+					std::this_thread::yield();
+				}
+			}
+		});
+		threads.emplace_back([&queue, &pop_counts, &popped_value_count]() {
+			while (popped_value_count.load() < pop_counts.size()) {
+				std::uint32_t value = 0;
+				if (queue.try_pop(value)) {
+					++pop_counts[value];
+					++popped_value_count;
+				} else {
+					std::this_thread::yield();
+				}
+			}
+		});
+	}
+
+	for (std::thread& current_thread : threads) {
+		current_thread.join();
+	}
+
+	for (const std::atomic<std::uint32_t>& pop_count : pop_counts) {
+		test::check(pop_count.load() == 1, "value is not popped exactly once");
+	}
+}
+
+void puloon::test::run_bounded_queue_tests() {
+	test_fifo_order_and_capacity();
+	test_move_only_values();
+	test_concurrent_producers_and_consumers();
+}
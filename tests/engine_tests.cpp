@@ -0,0 +1,256 @@
+#include "test.h"
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <future>
+#include <memory>
+#include <vector>
+#include <boost/asio.hpp>
+#include "lcdm.h"
+#include "lcdm_frame.h"
+#include "lcdm_transport.h"
+
+using namespace puloon;
+using namespace puloon::detail;
+
+// device end of a pipe to the driver
+// that answers with scripted bytes
+class scripted_device {
+	public:
+		scripted_device() :
+			io_service(),
+			io_service_work(io_service),
+			transport() {
+		}
+
+		lcdm_transport_factory get_transport_factory() {
+			return [this](boost::asio::io_service& driver_io_service) {
+				std::pair<std::unique_ptr<pipe_transport>, std::unique_ptr<pipe_transport>> transports = pipe_transport::create_pair(driver_io_service, this->io_service);
+				this->transport = std::move(transports.second);
+				return std::unique_ptr<lcdm_transport>(std::move(transports.first));
+			};
+		}
+
+		// reads the bytes written by the driver
+		std::vector<std::uint8_t> read(std::size_t size) {
+			std::vector<std::uint8_t> data(size);
+			std::size_t read_size = 0;
+
+			while (read_size < size) {
+				bool is_completed = false;
+				boost::system::error_code read_error;
+				this->transport->async_read_some(boost::asio::buffer(data.data() + read_size, size - read_size),
+					[&is_completed, &read_error, &read_size](const boost::system::error_code& error, std::size_t bytes_transferred) {
+						is_completed = true;
+						read_error = error;
+						read_size += bytes_transferred;
+					});
+				this->run_until(is_completed);
+				test::check(!read_error, "driver data is not read");
+			}
+
+			return data;
+		}
+
+		void write(const std::vector<std::uint8_t>& data) {
+			bool is_completed = false;
+			boost::system::error_code write_error;
+			lcdm_transport::write_buffers buffers;
+			buffers[0] = boost::asio::buffer(data);
+			this->transport->async_write(buffers, [&is_completed, &write_error](const boost::system::error_code& error, std::size_t) {
+				is_completed = true;
+				write_error = error;
+			});
+			this->run_until(is_completed);
+			test::check(!write_error, "device data is not written");
+		}
+
+		// the driver reads the end of the data
+		void close() {
+			this->transport->close();
+		}
+
+	private:
+		// the pipe keeps no work on the io_service
+		// while an operation waits for the other end
+		void run_until(const bool& is_completed) {
+			while (!is_completed) {
+				this->io_service.run_one();
+			}
+		}
+
+	private:
+		boost::asio::io_service io_service;
+		boost::asio::io_service::work io_service_work;
+		std::unique_ptr<pipe_transport> transport;
+};
+
+static std::vector<std::uint8_t> build_purge_response_frame() {
+	std::vector<std::uint8_t> response_frame{ soh, id, stx, (std::uint8_t)command_code::purge, 0x30, etx };
+	response_frame.push_back(get_bcc(response_frame.data(), response_frame.data() + response_frame.size()));
+	return response_frame;
+}
+
+// bills passed the check sensor, bills passed the exit sensor,
+// error code, status, rejected bills
+static std::vector<std::uint8_t> build_upper_dispense_response_frame(std::uint32_t dispensed_bills) {
+	const std::uint8_t tens = (std::uint8_t)('0' + (dispensed_bills / 10));
+	const std::uint8_t units = (std::uint8_t)('0' + (dispensed_bills % 10));
+	std::vector<std::uint8_t> response_frame{ soh, id, stx, (std::uint8_t)command_code::upper_dispense,
+		tens, units, tens, units, 0x30, '0', '0', '0', etx };
+	response_frame.push_back(get_bcc(response_frame.data(), response_frame.data() + response_frame.size()));
+	return response_frame;
+}
+
+// size of the purge command frame:
+// EOT, ID, STX, command code, ETX, BCC
+const std::size_t purge_command_frame_size = 6;
+// size of a dispense command frame from a single cassette,
+// with tens and units of the bills
+const std::size_t upper_dispense_command_frame_size = 8;
+
+const char journal_file_name[] = "puloon-cxx-tests-engine.journal";
+
+// a corrupted frame followed by a valid one in the same data
+// is not requested again
+static void test_resynchronization_after_corrupted_frame() {
+	scripted_device device;
+	lcdm driver(device.get_transport_factory());
+	std::future<lcdm::operation_status> purge_result = driver.purge();
+
+	device.read(purge_command_frame_size);
+	device.write(std::vector<std::uint8_t>{ ack });
+
+	std::vector<std::uint8_t> response_data = build_purge_response_frame();
+	response_data.back() ^= 0xff;
+	const std::vector<std::uint8_t> response_frame = build_purge_response_frame();
+	response_data.insert(response_data.end(), response_frame.begin(), response_frame.end());
+	device.write(response_data);
+
+	test::check(device.read(1)[0] == ack, "valid frame after a corrupted one is not acknowledged");
+	test::check(purge_result.wait_for(std::chrono::seconds(5)) == std::future_status::ready, "purge is not completed");
+	test::check(purge_result.get() == lcdm::operation_status::good, "purge is not completed with its result");
+}
+
+// a corrupted frame followed by noise is requested again
+static void test_corrupted_frame_is_requested_again() {
+	scripted_device device;
+	lcdm driver(device.get_transport_factory());
+	std::future<lcdm::operation_status> purge_result = driver.purge();
+
+	device.read(purge_command_frame_size);
+	device.write(std::vector<std::uint8_t>{ ack });
+
+	std::vector<std::uint8_t> response_data = build_purge_response_frame();
+	response_data.back() ^= 0xff;
+	response_data.push_back(0x00);
+	device.write(response_data);
+
+	test::check(device.read(1)[0] == nak, "corrupted frame is not requested again");
+	device.write(build_purge_response_frame());
+	test::check(device.read(1)[0] == ack, "repeated frame is not acknowledged");
+	test::check(purge_result.wait_for(std::chrono::seconds(5)) == std::future_status::ready, "purge is not completed");
+	test::check(purge_result.get() == lcdm::operation_status::good, "purge is not completed with its result");
+}
+
+// an operation submitted while the submission queue is full
+// is completed with queue_full outside the call
+static void test_full_submission_queue() {
+	// the driver takes no submissions
+	// while its io_service is not run
+	boost::asio::io_service driver_io_service;
+	scripted_device device;
+	lcdm driver(driver_io_service, device.get_transport_factory());
+	const std::size_t queue_capacity = 64;
+
+	std::size_t queued_completion_count = 0;
+	for (std::size_t i = 0; i < queue_capacity; ++i) {
+		driver.purge([&queued_completion_count](std::exception_ptr, lcdm::operation_status) {
+			++queued_completion_count;
+		});
+	}
+
+	bool is_rejected = false;
+	lcdm::operation_status rejected_status = lcdm::operation_status::good;
+	driver.purge([&is_rejected, &rejected_status](std::exception_ptr, lcdm::operation_status status) {
+		is_rejected = true;
+		rejected_status = status;
+	});
+	test::check(!is_rejected, "rejected operation is completed inside the call");
+
+	driver_io_service.poll();
+	test::check(is_rejected && (rejected_status == lcdm::operation_status::queue_full), "operation beyond the queue is not rejected with queue_full");
+	test::check(queued_completion_count == 0, "queued operations are completed");
+}
+
+// a dispense abandoned at each of its records
+// is recovered with the counts of that record,
+// its result is journaled before its handler is called
+static void test_journaled_dispenses() {
+	scripted_device device;
+	lcdm driver(device.get_transport_factory());
+	driver.start_journal(journal_file_name);
+
+	std::vector<lcdm::journaled_dispense> handler_dispenses;
+	std::promise<lcdm::dispense_result> completed_result;
+	driver.dispense({ { 0, 70 }, { 1, 0 } }, [&handler_dispenses, &completed_result](std::exception_ptr, lcdm::dispense_result result) {
+		handler_dispenses = lcdm::recover_journal(journal_file_name);
+		completed_result.set_value(result);
+	});
+
+	device.read(upper_dispense_command_frame_size);
+	std::vector<lcdm::journaled_dispense> dispenses = lcdm::recover_journal(journal_file_name);
+	test::check((dispenses.size() == 1) && (dispenses[0].outcome == lcdm::journaled_outcome::in_progress)
+		&& (dispenses[0].requested_bills[0] == 70) && (dispenses[0].dispensed_bills[0] == 0)
+		&& dispenses[0].command_pending,
+		"dispense is not journaled before its command is written");
+
+	// the second round follows ACK of the first result
+	device.write(std::vector<std::uint8_t>{ ack });
+	device.write(build_upper_dispense_response_frame(60));
+	device.read(1 + upper_dispense_command_frame_size);
+	dispenses = lcdm::recover_journal(journal_file_name);
+	test::check((dispenses.size() == 1) && (dispenses[0].dispensed_bills[0] == 60) && dispenses[0].command_pending,
+		"first round is not journaled before the second command is written");
+
+	device.write(std::vector<std::uint8_t>{ ack });
+	device.write(build_upper_dispense_response_frame(10));
+	device.read(1);
+	std::future<lcdm::dispense_result> result = completed_result.get_future();
+	test::check(result.wait_for(std::chrono::seconds(5)) == std::future_status::ready, "dispense is not completed");
+	test::check(result.get().dispensed_bills[0] == 70, "dispense is not completed with its result");
+	test::check((handler_dispenses.size() == 1) && (handler_dispenses[0].dispensed_bills[0] == 70)
+		&& (!handler_dispenses[0].command_pending),
+		"result is not journaled before the handler is called");
+
+	dispenses = lcdm::recover_journal(journal_file_name);
+	test::check((dispenses.size() == 1) && (dispenses[0].outcome == lcdm::journaled_outcome::completed)
+		&& (dispenses[0].dispensed_bills[0] == 70),
+		"completed dispense is not recovered with its counts");
+
+	// the connection is lost after the command
+	std::promise<lcdm::dispense_result> failed_result;
+	driver.dispense({ { 0, 5 }, { 1, 0 } }, [&handler_dispenses, &failed_result](std::exception_ptr, lcdm::dispense_result result) {
+		handler_dispenses = lcdm::recover_journal(journal_file_name);
+		failed_result.set_value(result);
+	});
+
+	device.read(upper_dispense_command_frame_size);
+	device.close();
+	result = failed_result.get_future();
+	test::check(result.wait_for(std::chrono::seconds(5)) == std::future_status::ready, "dispense is not failed");
+	test::check(result.get().status == lcdm::operation_status::connection_error, "dispense is not failed with connection_error");
+	test::check((handler_dispenses.size() == 2) && (handler_dispenses[1].outcome == lcdm::journaled_outcome::failed)
+		&& (handler_dispenses[1].requested_bills[0] == 5) && handler_dispenses[1].command_pending,
+		"failed dispense is not journaled before the handler is called");
+
+	driver.close();
+	std::remove(journal_file_name);
+}
+
+void puloon::test::run_engine_tests() {
+	test_resynchronization_after_corrupted_frame();
+	test_corrupted_frame_is_requested_again();
+	test_full_submission_queue();
+	test_journaled_dispenses();
+}
@@ -0,0 +1,146 @@
+#include "test.h"
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "lcdm_journal.h"
+
+using namespace puloon;
+using namespace puloon::detail;
+
+const char journal_file_name[] = "puloon-cxx-tests.journal";
+
+static dispense_counts make_counts(std::uint32_t bills_to_dispense, std::uint32_t dispensed_bills, std::uint32_t rejected_bills) {
+	dispense_counts counts;
+	counts.bills_to_dispense = { { 0, bills_to_dispense }, { 1, 0 } };
+	counts.dispensed_bills = { { 0, dispensed_bills }, { 1, 0 } };
+	counts.rejected_bills = { { 0, rejected_bills }, { 1, 0 } };
+	return counts;
+}
+
+// the records are read from the mapping of a journal
+// that is still open, as after a crash of its process
+static std::vector<lcdm::journaled_dispense> recover() {
+	return find_recoverable_dispenses(read_journal_file(journal_file_name));
+}
+
+// a dispense abandoned after each of its records
+// is recovered with the counts of that record
+static void test_recovery_at_every_record() {
+	dispense_journal journal(journal_file_name);
+	const std::uint8_t command_code = 0x45;
+
+	test::check(recover().empty(), "new journal has dispenses");
+
+	const std::uint64_t operation_id = journal.start_operation();
+	journal.record(journal_record_type::command_sent, operation_id, command_code, make_counts(70, 0, 0));
+	std::vector<lcdm::journaled_dispense> dispenses = recover();
+	test::check((dispenses.size() == 1) && (dispenses[0].operation_id == operation_id)
+		&& (dispenses[0].outcome == lcdm::journaled_outcome::in_progress)
+		&& (dispenses[0].requested_bills[0] == 70) && (dispenses[0].dispensed_bills[0] == 0)
+		&& dispenses[0].command_pending,
+		"dispense with a sent command is not recovered");
+
+	journal.record(journal_record_type::result_decoded, operation_id, command_code, make_counts(12, 58, 2));
+	dispenses = recover();
+	test::check((dispenses.size() == 1) && (dispenses[0].requested_bills[0] == 70)
+		&& (dispenses[0].dispensed_bills[0] == 58) && (dispenses[0].rejected_bills[0] == 2)
+		&& (!dispenses[0].command_pending),
+		"dispense with a decoded result is not recovered with its counts");
+
+	journal.record(journal_record_type::command_sent, operation_id, command_code, make_counts(12, 58, 2));
+	dispenses = recover();
+	test::check((dispenses.size() == 1) && (dispenses[0].requested_bills[0] == 70)
+		&& (dispenses[0].dispensed_bills[0] == 58) && dispenses[0].command_pending,
+		"dispense with a second command is not recovered");
+
+	journal.record(journal_record_type::operation_completed, operation_id, command_code, make_counts(0, 70, 2));
+	dispenses = recover();
+	test::check((dispenses.size() == 1) && (dispenses[0].outcome == lcdm::journaled_outcome::completed)
+		&& (dispenses[0].requested_bills[0] == 70) && (dispenses[0].dispensed_bills[0] == 70)
+		&& (dispenses[0].rejected_bills[0] == 2) && (!dispenses[0].command_pending),
+		"completed dispense is not recovered with its counts");
+}
+
+// a dispense that failed after a command keeps the command pending
+static void test_failed_dispense() {
+	dispense_journal journal(journal_file_name);
+	const std::uint8_t command_code = 0x45;
+
+	const std::uint64_t operation_id = journal.start_operation();
+	journal.record(journal_record_type::command_sent, operation_id, command_code, make_counts(30, 0, 0));
+	journal.record(journal_record_type::operation_failed, operation_id, command_code, make_counts(30, 0, 0));
+
+	const std::vector<lcdm::journaled_dispense> dispenses = recover();
+	test::check((dispenses.size() == 1) && (dispenses[0].outcome == lcdm::journaled_outcome::failed)
+		&& (dispenses[0].requested_bills[0] == 30) && (dispenses[0].dispensed_bills[0] == 0)
+		&& dispenses[0].command_pending,
+		"failed dispense is not recovered with its pending command");
+}
+
+// only the last completed dispenses are recovered,
+// every failed one is
+static void test_last_completed_dispenses() {
+	dispense_journal journal(journal_file_name);
+	const std::uint8_t command_code = 0x45;
+	const std::uint64_t failed_operation_id = journal.start_operation();
+	journal.record(journal_record_type::command_sent, failed_operation_id, command_code, make_counts(1, 0, 0));
+	journal.record(journal_record_type::operation_failed, failed_operation_id, command_code, make_counts(1, 0, 0));
+
+	for (std::uint32_t i = 0; i < 20; ++i) {
+		const std::uint64_t operation_id = journal.start_operation();
+		journal.record(journal_record_type::command_sent, operation_id, command_code, make_counts(i + 1, 0, 0));
+		journal.record(journal_record_type::result_decoded, operation_id, command_code, make_counts(0, i + 1, 0));
+		journal.record(journal_record_type::operation_completed, operation_id, command_code, make_counts(0, i + 1, 0));
+	}
+
+	const std::vector<lcdm::journaled_dispense> dispenses = recover();
+	test::check((dispenses.size() == 17) && (dispenses[0].operation_id == failed_operation_id)
+		&& (dispenses[0].outcome == lcdm::journaled_outcome::failed),
+		"failed dispense is not recovered among the completed ones");
+	test::check((dispenses[1].dispensed_bills[0] == 5) && (dispenses[16].dispensed_bills[0] == 20),
+		"last completed dispenses are not recovered in order");
+}
+
+// dispenses are recovered separately
+// and a torn record is skipped
+static void test_torn_record() {
+	{
+		dispense_journal journal(journal_file_name);
+		const std::uint64_t first_operation_id = journal.start_operation();
+		journal.record(journal_record_type::command_sent, first_operation_id, 0x45, make_counts(5, 0, 0));
+		const std::uint64_t second_operation_id = journal.start_operation();
+		journal.record(journal_record_type::command_sent, second_operation_id, 0x45, make_counts(7, 0, 0));
+
+		test::check(recover().size() == 2, "dispenses are not recovered separately");
+	}
+
+	const std::vector<journal_record> records = read_journal_file(journal_file_name);
+	test::check(records.size() == 2, "records are not written to the disk");
+
+	// a byte of the second record is lost,
+	// the records follow a header of 64 bytes
+	std::fstream journal_file(journal_file_name, std::ios::binary | std::ios::in | std::ios::out);
+	journal_file.seekp((std::streamoff)(64 + sizeof(journal_record) + offsetof(journal_record, bills_to_dispense)));
+	journal_file.put('\x7f');
+	journal_file.close();
+
+	const std::vector<lcdm::journaled_dispense> dispenses = recover();
+	test::check((dispenses.size() == 1) && (dispenses[0].requested_bills[0] == 5), "torn record is not skipped");
+}
+
+// a file that does not exist has no dispenses
+static void test_missing_file() {
+	std::remove(journal_file_name);
+	test::check(recover().empty(), "missing journal has dispenses");
+}
+
+void puloon::test::run_journal_tests() {
+	test_recovery_at_every_record();
+	test_failed_dispense();
+	test_last_completed_dispenses();
+	test_torn_record();
+	test_missing_file();
+}
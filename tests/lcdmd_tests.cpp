@@ -0,0 +1,207 @@
+#include "test.h"
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <future>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <boost/asio.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/interprocess/shared_memory_object.hpp>
+#include "lcdm.h"
+#include "lcdm_simulator.h"
+#include "lcdm_transport.h"
+#include "lcdmd_client.h"
+#include "lcdmd_protocol.h"
+#include "lcdmd_server.h"
+
+using namespace puloon;
+
+const char socket_path[] = "puloon-cxx-tests-lcdmd.sock";
+
+// waits until the condition holds, up to five seconds
+template <typename Condition>
+static bool wait_until(Condition condition) {
+	const std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+
+	while (!condition()) {
+		if (std::chrono::steady_clock::now() > deadline) {
+			return false;
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+
+	return true;
+}
+
+// runs a server on a thread of its own
+class server_thread {
+	public:
+		explicit server_thread(const std::vector<lcdm*>& devices) :
+			io_service(),
+			server(io_service, socket_path, devices),
+			thread([this]() { this->io_service.run(); }) {
+		}
+
+		~server_thread() {
+			this->io_service.stop();
+			this->thread.join();
+		}
+
+	private:
+		boost::asio::io_service io_service;
+		lcdmd_server server;
+		std::thread thread;
+};
+
+// slots are popped in the order they were pushed
+// and a full ring takes no more
+static void test_shared_ring() {
+	lcdmd::shared_ring<std::uint64_t, 4> ring;
+	std::uint64_t value = 0;
+
+	test::check(!ring.try_pop(value), "empty ring pops a slot");
+
+	for (std::uint64_t round = 0; round < 3; ++round) {
+		for (std::uint64_t i = 0; i < 4; ++i) {
+			test::check(ring.try_push(round * 4 + i), "ring with room does not take a slot");
+		}
+		test::check(!ring.try_push(0), "full ring takes a slot");
+		test::check(ring.get_size() == 4, "full ring has a wrong size");
+
+		for (std::uint64_t i = 0; i < 4; ++i) {
+			test::check(ring.try_pop(value) && (value == round * 4 + i), "slots are not popped in order across the wrap");
+		}
+		test::check(ring.get_size() == 0, "drained ring has slots");
+	}
+}
+
+// a producer and a consumer on separate threads
+// pass every slot once and in order
+static void test_concurrent_shared_ring() {
+	const std::uint64_t slot_count = 200000;
+	std::unique_ptr<lcdmd::shared_ring<std::uint64_t, 64>> ring(new lcdmd::shared_ring<std::uint64_t, 64>());
+
+	std::thread producer([&ring, slot_count]() {
+		for (std::uint64_t i = 0; i < slot_count; ) {
+			if (ring->try_push(i)) {
+				++i;
+			} else {
+				std::this_thread::yield();
+			}
+		}
+	});
+
+	bool slots_are_ordered = true;
+	for (std::uint64_t i = 0; i < slot_count; ) {
+		std::uint64_t value = 0;
+		if (ring->try_pop(value)) {
+			slots_are_ordered = slots_are_ordered && (value == i);
+			++i;
+		} else {
+			std::this_thread::yield();
+		}
+	}
+	producer.join();
+
+	test::check(slots_are_ordered, "slots are lost, repeated or reordered between threads");
+}
+
+// a client reaches a device of the daemon
+// and gets its results back
+static void test_round_trip() {
+	lcdm_simulator::settings simulator_settings;
+	simulator_settings.ack_latency = std::chrono::microseconds(0);
+	simulator_settings.response_latency = std::chrono::microseconds(0);
+	lcdm_simulator simulator(lcdm_simulator::in_process_pipe(), simulator_settings);
+	lcdm device([&simulator](boost::asio::io_service& io_service) {
+		return simulator.create_transport(io_service);
+	});
+
+	server_thread server({ &device });
+	lcdmd_client client(socket_path);
+	test::check(client.get_device_count() == 1, "client does not see the device of the daemon");
+
+	std::future<lcdm::operation_status> purge_result = client.purge(0);
+	test::check(purge_result.wait_for(std::chrono::seconds(5)) == std::future_status::ready, "purge is not completed");
+	test::check(purge_result.get() == lcdm::operation_status::good, "purge is not completed with its result");
+
+	std::future<lcdm::dispense_result> dispense_result = client.dispense(0, { { 0, 3 }, { 1, 2 } });
+	test::check(dispense_result.wait_for(std::chrono::seconds(5)) == std::future_status::ready, "dispense is not completed");
+	const lcdm::dispense_result result = dispense_result.get();
+	test::check((result.status == lcdm::operation_status::good)
+		&& (result.dispensed_bills[0] == 3) && (result.dispensed_bills[1] == 2),
+		"dispense is not completed with its counts");
+
+	bool request_is_rejected = false;
+	try {
+		client.purge(1).get();
+	} catch (std::runtime_error) {
+		request_is_rejected = true;
+	}
+	test::check(request_is_rejected, "request to a missing device is not rejected");
+}
+
+// requests of a client beyond the room of its result ring
+// are rejected before they reach the device
+static void test_requests_beyond_ring_capacity() {
+	const std::size_t extra_request_count = 44;
+
+	// the device takes the requests
+	// and completes none while its io_service is not run
+	boost::asio::io_service device_io_service;
+	lcdm device(device_io_service, [](boost::asio::io_service& io_service) {
+		return std::unique_ptr<lcdm_transport>(std::move(pipe_transport::create_pair(io_service, io_service).first));
+	});
+
+	{
+		server_thread server({ &device });
+
+		// a client that ignores the limit of its table
+		boost::asio::io_service client_io_service;
+		boost::asio::local::stream_protocol::socket socket(client_io_service);
+		socket.connect(boost::asio::local::stream_protocol::endpoint(socket_path));
+
+		lcdmd::hello_message hello;
+		boost::asio::read(socket, boost::asio::buffer(&hello, sizeof(hello)));
+		boost::interprocess::shared_memory_object segment_object(boost::interprocess::open_only, hello.segment_name, boost::interprocess::read_write);
+		boost::interprocess::mapped_region segment_region(segment_object, boost::interprocess::read_write);
+		lcdmd::shared_segment& segment = *(lcdmd::shared_segment*)segment_region.get_address();
+
+		lcdmd::request_slot request;
+		std::memset(&request, 0, sizeof(request));
+		request.type = lcdmd::request_type::purge;
+
+		for (std::size_t i = 0; i < lcdmd::ring_capacity + extra_request_count; ++i) {
+			request.request_id = i;
+			test::check(wait_until([&segment, &request]() { return segment.requests.try_push(request); }), "daemon does not take the requests");
+			boost::asio::write(socket, boost::asio::buffer(&lcdmd::doorbell, 1));
+		}
+
+		test::check(wait_until([&segment, extra_request_count]() { return segment.results.get_size() == extra_request_count; }),
+			"requests beyond the limit are not completed");
+
+		lcdmd::result_slot result;
+		for (std::size_t i = 0; i < extra_request_count; ++i) {
+			test::check(segment.results.try_pop(result)
+				&& (result.request_id == lcdmd::ring_capacity + i)
+				&& (result.error == lcdmd::result_error::invalid_request),
+				"request beyond the limit is not rejected with invalid_request");
+		}
+
+		// the requests in progress are completed
+		// while their sessions can still be reached
+		device.close();
+		device_io_service.run();
+	}
+}
+
+void puloon::test::run_lcdmd_tests() {
+	test_shared_ring();
+	test_concurrent_shared_ring();
+	test_round_trip();
+	test_requests_beyond_ring_capacity();
+}
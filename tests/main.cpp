@@ -0,0 +1,64 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "test.h"
+
+using namespace puloon;
+
+struct test_suite {
+	const char* name;
+	void (*run)();
+};
+
+static const test_suite test_suites[] = {
+	{ "bounded_queue", test::run_bounded_queue_tests },
+	{ "response_parser", test::run_response_parser_tests },
+	{ "operations", test::run_operation_tests },
+	{ "metrics", test::run_metrics_tests },
+	{ "timeout_estimator", test::run_timeout_estimator_tests },
+	{ "planner", test::run_planner_tests },
+	{ "journal", test::run_journal_tests },
+	{ "transport", test::run_transport_tests },
+	{ "engine", test::run_engine_tests },
+#if defined(PULOON_TEST_LCDMD)
+	{ "lcdmd", test::run_lcdmd_tests },
+#endif
+};
+
+static void print_usage(const char* program_name) {
+	std::fprintf(stderr, "usage: %s [SUITE]\n", program_name);
+}
+
+int main(int argc, char* argv[]) {
+	if (argc > 2) {
+		print_usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	// all suites are run by default
+	const char* suite_name = (argc == 2) ? argv[1] : nullptr;
+	bool suite_is_found = false;
+	int exit_code = EXIT_SUCCESS;
+
+	for (const test_suite& current_suite : test_suites) {
+		if ((suite_name != nullptr) && (std::strcmp(suite_name, current_suite.name) != 0)) {
+			continue;
+		}
+
+		suite_is_found = true;
+		try {
+			current_suite.run();
+			std::printf("%-20s passed\n", current_suite.name);
+		} catch (const std::exception& error) {
+			std::printf("%-20s FAILED: %s\n", current_suite.name, error.what());
+			exit_code = EXIT_FAILURE;
+		}
+	}
+
+	if (!suite_is_found) {
+		print_usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	return exit_code;
+}
@@ -0,0 +1,58 @@
+#include "test.h"
+#include <cstdint>
+#include <map>
+#include "lcdm_metrics_recorder.h"
+#include "lcdm_protocol.h"
+
+using namespace puloon;
+using namespace puloon::detail;
+
+// every tracked command code has counters of its own
+// and the snapshot reports them under their code
+static void test_tracked_codes() {
+	const command_code tracked_codes[] = {
+		command_code::purge,
+		command_code::upper_dispense,
+		command_code::status,
+		command_code::rom_version,
+		command_code::lower_dispense,
+		command_code::up_low_dispense,
+		command_code::upper_test_dispense,
+		command_code::lower_test_dispense,
+		command_code::multi_dispense
+	};
+	metrics_recorder metrics;
+
+	for (std::size_t i = 0; i < sizeof(tracked_codes) / sizeof(tracked_codes[0]); ++i) {
+		command_counters& counters = metrics.get_counters((std::uint8_t)tracked_codes[i]);
+		for (std::size_t j = 0; j <= i; ++j) {
+			metrics_recorder::increment(counters.commands);
+		}
+	}
+
+	const lcdm_metrics snapshot = metrics.get_snapshot();
+	test::check(snapshot.commands.size() == sizeof(tracked_codes) / sizeof(tracked_codes[0]), "tracked codes do not have counters of their own");
+	for (std::size_t i = 0; i < sizeof(tracked_codes) / sizeof(tracked_codes[0]); ++i) {
+		const std::map<std::uint8_t, command_metrics>::const_iterator found_metrics = snapshot.commands.find((std::uint8_t)tracked_codes[i]);
+		test::check((found_metrics != snapshot.commands.end()) && (found_metrics->second.commands == i + 1),
+			"metrics are not reported under their command code");
+	}
+}
+
+// codes that are not tracked share the entry of the unknown code
+static void test_unknown_codes() {
+	metrics_recorder metrics;
+
+	test::check(&metrics.get_counters(0x01) == &metrics.get_counters(0xff), "unknown codes do not share their counters");
+	test::check(&metrics.get_counters(0x01) != &metrics.get_counters((std::uint8_t)command_code::multi_dispense), "unknown codes share the counters of a tracked code");
+
+	metrics_recorder::increment(metrics.get_counters(0x01).commands);
+	const lcdm_metrics snapshot = metrics.get_snapshot();
+	test::check((snapshot.commands.size() == 1) && (snapshot.commands.count((std::uint8_t)command_code::unknown) == 1),
+		"unknown codes are not reported under the unknown code");
+}
+
+void puloon::test::run_metrics_tests() {
+	test_tracked_codes();
+	test_unknown_codes();
+}
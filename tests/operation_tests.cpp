@@ -0,0 +1,144 @@
+#include "test.h"
+#include <cstdint>
+#include <exception>
+#include <vector>
+#include "lcdm_operations.h"
+
+using namespace puloon;
+using namespace puloon::detail;
+
+// completion of a dispense operation
+struct dispense_completion {
+	std::size_t handler_call_count = 0;
+	std::exception_ptr error;
+	lcdm::dispense_result result;
+};
+
+static operation_ptr make_dispense_operation(const lcdm::bill_counts& requested_bills, dispense_completion& completion) {
+	return operation_ptr(new dispense_operation(device_profiles[lcdm::device_model::lcdm_2000], requested_bills,
+		[&completion](std::exception_ptr error, lcdm::dispense_result result) {
+			++completion.handler_call_count;
+			completion.error = error;
+			completion.result = result;
+		}), operation_deleter{ nullptr });
+}
+
+static void write_bills_count(std::vector<std::uint8_t>& result_data, std::size_t offset, std::uint32_t bills_count) {
+	result_data[offset] = (std::uint8_t)('0' + bills_count / 10);
+	result_data[offset + 1] = (std::uint8_t)('0' + bills_count % 10);
+}
+
+// result data of an up/low dispense
+static std::vector<std::uint8_t> build_up_low_result_data(std::uint32_t upper_dispensed, std::uint32_t upper_rejected,
+	std::uint32_t lower_dispensed, std::uint32_t lower_rejected, std::uint8_t error_code) {
+	typedef command_descriptor<command_code::up_low_dispense> descriptor;
+
+	std::vector<std::uint8_t> result_data(descriptor::result_data_size, '0');
+	result_data[0] = (std::uint8_t)command_code::up_low_dispense;
+	write_bills_count(result_data, descriptor::cassette_fields[0].dispensed_offset, upper_dispensed);
+	write_bills_count(result_data, descriptor::cassette_fields[0].rejected_offset, upper_rejected);
+	write_bills_count(result_data, descriptor::cassette_fields[1].dispensed_offset, lower_dispensed);
+	write_bills_count(result_data, descriptor::cassette_fields[1].rejected_offset, lower_rejected);
+	result_data[descriptor::status_offset] = error_code;
+	return result_data;
+}
+
+// result data of a single cassette dispense
+template <command_code Code>
+static std::vector<std::uint8_t> build_single_result_data(std::uint32_t dispensed, std::uint32_t rejected, std::uint8_t error_code) {
+	typedef command_descriptor<Code> descriptor;
+
+	std::vector<std::uint8_t> result_data(descriptor::result_data_size, '0');
+	result_data[0] = (std::uint8_t)Code;
+	write_bills_count(result_data, descriptor::cassette_fields[0].dispensed_offset, dispensed);
+	write_bills_count(result_data, descriptor::cassette_fields[0].rejected_offset, rejected);
+	result_data[descriptor::status_offset] = error_code;
+	return result_data;
+}
+
+static void handle_result(operation& current_operation, const std::vector<std::uint8_t>& result_data) {
+	current_operation.handle_result(data_view(result_data.data(), result_data.size()));
+}
+
+// the bills of a shared up/low dispense are credited
+// to the request of their cassette
+static void test_coalesced_dispense_accounting() {
+	dispense_completion upper_completion;
+	dispense_completion lower_completion;
+	coalesced_dispense_operation coalesced_operation(
+		make_dispense_operation({ { 0, 3 } }, upper_completion),
+		make_dispense_operation({ { 1, 5 } }, lower_completion));
+
+	const command up_low_command = coalesced_operation.get_command();
+	test::check(up_low_command.code == command_code::up_low_dispense, "coalesced requests do not share an up/low dispense");
+	test::check(up_low_command.bills == 8, "bills of both requests are not sent");
+
+	handle_result(coalesced_operation, build_up_low_result_data(3, 1, 5, 2, 0x30));
+
+	test::check(coalesced_operation.is_completed(), "coalesced operation is not completed");
+	test::check(upper_completion.handler_call_count == 1, "upper request is not completed once");
+	test::check(lower_completion.handler_call_count == 1, "lower request is not completed once");
+	test::check((upper_completion.result.status == lcdm::operation_status::good)
+		&& (upper_completion.result.dispensed_bills[0] == 3) && (upper_completion.result.dispensed_bills[1] == 0)
+		&& (upper_completion.result.rejected_bills[0] == 1) && (upper_completion.result.rejected_bills[1] == 0),
+		"upper request is not credited with the upper cassette only");
+	test::check((lower_completion.result.status == lcdm::operation_status::good)
+		&& (lower_completion.result.dispensed_bills[0] == 0) && (lower_completion.result.dispensed_bills[1] == 5)
+		&& (lower_completion.result.rejected_bills[0] == 0) && (lower_completion.result.rejected_bills[1] == 2),
+		"lower request is not credited with the lower cassette only");
+
+	dispense_counts counts;
+	test::check(coalesced_operation.get_dispense_counts(counts), "coalesced operation has no counts");
+	test::check((counts.dispensed_bills[0] == 3) && (counts.dispensed_bills[1] == 5)
+		&& (counts.rejected_bills[0] == 1) && (counts.rejected_bills[1] == 2)
+		&& (counts.bills_to_dispense[0] == 0) && (counts.bills_to_dispense[1] == 0),
+		"counts of the parts are not combined");
+}
+
+// a part that is short of bills after the shared round
+// is dispensed alone and completes on its own
+static void test_coalesced_dispense_rest() {
+	dispense_completion upper_completion;
+	dispense_completion lower_completion;
+	coalesced_dispense_operation coalesced_operation(
+		make_dispense_operation({ { 0, 4 } }, upper_completion),
+		make_dispense_operation({ { 1, 2 } }, lower_completion));
+
+	handle_result(coalesced_operation, build_up_low_result_data(1, 0, 2, 0, 0x30));
+	test::check(!coalesced_operation.is_completed(), "coalesced operation with bills left is completed");
+	test::check(lower_completion.handler_call_count == 1, "completed lower request is not reported");
+	test::check(upper_completion.handler_call_count == 0, "upper request with bills left is reported");
+
+	const command upper_command = coalesced_operation.get_command();
+	test::check((upper_command.code == command_code::upper_dispense) && (upper_command.bills == 3), "rest of the upper request is not dispensed alone");
+
+	handle_result(coalesced_operation, build_single_result_data<command_code::upper_dispense>(3, 0, 0x30));
+	test::check(coalesced_operation.is_completed(), "coalesced operation is not completed after the rest");
+	test::check((upper_completion.handler_call_count == 1) && (upper_completion.result.dispensed_bills[0] == 4),
+		"upper request is not credited with both rounds");
+	test::check(lower_completion.handler_call_count == 1, "lower request is reported again");
+}
+
+// an error of the shared round stops both requests
+static void test_coalesced_dispense_error() {
+	dispense_completion upper_completion;
+	dispense_completion lower_completion;
+	coalesced_dispense_operation coalesced_operation(
+		make_dispense_operation({ { 0, 4 } }, upper_completion),
+		make_dispense_operation({ { 1, 4 } }, lower_completion));
+
+	handle_result(coalesced_operation, build_up_low_result_data(2, 0, 1, 1, 0x33));
+	test::check(coalesced_operation.is_completed(), "coalesced operation is not stopped by an error");
+	test::check((upper_completion.handler_call_count == 1) && (upper_completion.result.status == lcdm::operation_status::jam)
+		&& (upper_completion.result.dispensed_bills[0] == 2),
+		"upper request does not report the error with its bills");
+	test::check((lower_completion.handler_call_count == 1) && (lower_completion.result.status == lcdm::operation_status::jam)
+		&& (lower_completion.result.dispensed_bills[1] == 1) && (lower_completion.result.rejected_bills[1] == 1),
+		"lower request does not report the error with its bills");
+}
+
+void puloon::test::run_operation_tests() {
+	test_coalesced_dispense_accounting();
+	test_coalesced_dispense_rest();
+	test_coalesced_dispense_error();
+}
@@ -0,0 +1,197 @@
+#include "test.h"
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include "lcdm_planner.h"
+
+using namespace puloon;
+using namespace puloon::detail;
+
+static lcdm::cassette_inventory make_inventory(const lcdm::bill_counts& denominations, const lcdm::bill_counts& bills) {
+	lcdm::cassette_inventory inventory;
+	inventory.denominations = denominations;
+	inventory.bills = bills;
+	return inventory;
+}
+
+static bool has_counts(const lcdm::bill_counts& counts, std::uint32_t first_count, std::uint32_t second_count) {
+	return (counts[0] == first_count) && (counts[1] == second_count);
+}
+
+static bool reserve_fails(dispense_planner& planner, std::uint32_t amount) {
+	try {
+		planner.reserve(amount);
+	} catch (std::runtime_error) {
+		return true;
+	}
+
+	return false;
+}
+
+// common amounts take their memoized mix
+// while the cassettes hold its bills
+// and are planned again once they do not
+static void test_memoized_mix() {
+	dispense_planner planner(make_inventory({ { 0, 5 }, { 1, 1 } }, { { 0, 2 }, { 1, 10 } }), 2);
+
+	test::check(has_counts(planner.reserve(7), 1, 2), "memoized mix is not reserved");
+	test::check(has_counts(planner.get_inventory().bills, 1, 8), "memoized mix is not taken out of the inventory");
+	test::check(has_counts(planner.reserve(12), 1, 7), "amount is not planned again for the bills left");
+	test::check(has_counts(planner.get_inventory().bills, 0, 1), "planned mix is not taken out of the inventory");
+}
+
+// amounts beyond the memoized ones are planned
+// in the fewest rounds and then with the fewest bills
+static void test_planned_mix() {
+	dispense_planner planner(make_inventory({ { 0, 5 }, { 1, 1 } }, { { 0, 200 }, { 1, 200 } }), 2);
+
+	test::check(has_counts(planner.reserve(700), 120, 100), "mix does not take the fewest rounds and bills");
+}
+
+// amounts that cannot be made leave the inventory unchanged
+static void test_amount_that_cannot_be_made() {
+	dispense_planner planner(make_inventory({ { 0, 100 }, { 1, 50 } }, { { 0, 2 }, { 1, 1 } }), 2);
+
+	test::check(reserve_fails(planner, 0), "zero amount is reserved");
+	test::check(reserve_fails(planner, 30), "amount below the smallest denomination is reserved");
+	test::check(reserve_fails(planner, 75), "amount off the denominations is reserved");
+	test::check(reserve_fails(planner, 300), "amount above the bills left is reserved");
+	test::check(has_counts(planner.get_inventory().bills, 2, 1), "failed reserves change the inventory");
+
+	test::check(has_counts(planner.reserve(250), 2, 1), "amount of all bills is not reserved");
+	test::check(reserve_fails(planner, 50), "amount is reserved from empty cassettes");
+}
+
+// reserved bills that did not leave the cassettes are returned
+static void test_release() {
+	dispense_planner planner(make_inventory({ { 0, 100 }, { 1, 50 } }, { { 0, 4 }, { 1, 4 } }), 2);
+
+	const lcdm::bill_counts reserved_bills = planner.reserve(250);
+	test::check(has_counts(reserved_bills, 2, 1), "mix is not reserved");
+
+	lcdm::dispense_result result;
+	result.dispensed_bills = { { 0, 1 }, { 1, 0 } };
+	result.rejected_bills = { { 0, 0 }, { 1, 0 } };
+	result.status = lcdm::operation_status::pickup_error;
+	planner.release(reserved_bills, result);
+
+	test::check(has_counts(planner.get_inventory().bills, 3, 4), "bills left in the cassettes are not returned");
+}
+
+// bills of a dispense without a result stay taken
+// until the inventory is set again
+static void test_retain() {
+	dispense_planner planner(make_inventory({ { 0, 100 }, { 1, 50 } }, { { 0, 4 }, { 1, 4 } }), 2);
+
+	test::check(!planner.get_inventory().needs_reconciliation, "new inventory needs reconciliation");
+
+	planner.retain(planner.reserve(250));
+
+	const lcdm::cassette_inventory inventory = planner.get_inventory();
+	test::check(has_counts(inventory.bills, 2, 3), "bills of an unknown result are returned");
+	test::check(inventory.needs_reconciliation, "unknown result does not need reconciliation");
+}
+
+// a new inventory takes the bills of the dispenses in progress
+// and gets their unused bills back
+static void test_reservations_taken_over() {
+	planner_slot slot;
+	slot.replace(std::make_shared<dispense_planner>(make_inventory({ { 0, 100 }, { 1, 50 } }, { { 0, 4 }, { 1, 4 } }), 2));
+
+	const lcdm::bill_counts reserved_bills = slot.reserve(250);
+	slot.replace(std::make_shared<dispense_planner>(make_inventory({ { 0, 100 }, { 1, 50 } }, { { 0, 10 }, { 1, 10 } }), 2));
+	test::check(has_counts(slot.get_inventory().bills, 8, 9), "bills in progress are not taken out of the new inventory");
+	test::check(!slot.get_inventory().needs_reconciliation, "new inventory holding the bills in progress needs reconciliation");
+
+	lcdm::dispense_result result;
+	result.dispensed_bills = { { 0, 1 }, { 1, 1 } };
+	result.rejected_bills = { { 0, 0 }, { 1, 0 } };
+	result.status = lcdm::operation_status::pickup_error;
+	slot.settle(reserved_bills, true, result);
+	test::check(has_counts(slot.get_inventory().bills, 9, 9), "unused bills are not returned to the new inventory");
+
+	// the next inventory no longer has the bills of the settled dispense
+	slot.replace(std::make_shared<dispense_planner>(make_inventory({ { 0, 100 }, { 1, 50 } }, { { 0, 1 }, { 1, 1 } }), 2));
+	test::check(has_counts(slot.get_inventory().bills, 1, 1), "settled dispense is taken over");
+
+	const lcdm::bill_counts lost_bills = slot.reserve(150);
+	slot.settle(lost_bills, false, lcdm::dispense_result());
+	slot.replace(std::make_shared<dispense_planner>(make_inventory({ { 0, 100 }, { 1, 50 } }, { { 0, 0 }, { 1, 5 } }), 2));
+	test::check(has_counts(slot.get_inventory().bills, 0, 5), "retained dispense is taken over");
+	test::check(!slot.get_inventory().needs_reconciliation, "reconciliation outlives the inventory set again");
+}
+
+// a new inventory without the bills of the dispenses in progress
+// needs reconciliation
+static void test_reservations_beyond_new_inventory() {
+	planner_slot slot;
+	test::check(slot.get_inventory().bills.size() == 0, "inventory is set before the first one");
+
+	slot.replace(std::make_shared<dispense_planner>(make_inventory({ { 0, 100 }, { 1, 50 } }, { { 0, 4 }, { 1, 4 } }), 2));
+	slot.reserve(250);
+	slot.replace(std::make_shared<dispense_planner>(make_inventory({ { 0, 100 }, { 1, 50 } }, { { 0, 1 }, { 1, 4 } }), 2));
+
+	const lcdm::cassette_inventory inventory = slot.get_inventory();
+	test::check(has_counts(inventory.bills, 0, 3), "bills in progress are not taken out of the new inventory");
+	test::check(inventory.needs_reconciliation, "short new inventory does not need reconciliation");
+}
+
+// concurrent reserves never take more bills than the cassettes hold
+// and every bill is either reserved or left
+static void test_concurrent_reserves() {
+	const std::size_t thread_count = 4;
+	const std::uint32_t initial_bills = 1000;
+
+	dispense_planner planner(make_inventory({ { 0, 20 }, { 1, 10 } }, { { 0, initial_bills }, { 1, initial_bills } }), 2);
+	std::vector<std::thread> threads;
+	std::array<std::atomic<std::uint32_t>, 2> reserved_bills;
+	for (std::atomic<std::uint32_t>& bills : reserved_bills) {
+		bills.store(0);
+	}
+
+	for (std::size_t i = 0; i < thread_count; ++i) {
+		threads.emplace_back([&planner, &reserved_bills, i]() {
+			const std::uint32_t amounts[] = { 30, 50, 120, 10 };
+			for (std::size_t j = 0; ; ++j) {
+				lcdm::bill_counts mix;
+				try {
+					mix = planner.reserve(amounts[(i + j) % 4]);
+				} catch (std::runtime_error) {
+					// other threads have taken the bills
+					// or keep changing them
+					if (planner.get_inventory().bills[1] == 0) {
+						break;
+					}
+					continue;
+				}
+
+				reserved_bills[0] += mix[0];
+				reserved_bills[1] += mix[1];
+			}
+		});
+	}
+
+	for (std::thread& current_thread : threads) {
+		current_thread.join();
+	}
+
+	const lcdm::cassette_inventory inventory = planner.get_inventory();
+	test::check((reserved_bills[0].load() + inventory.bills[0] == initial_bills)
+		&& (reserved_bills[1].load() + inventory.bills[1] == initial_bills),
+		"bills are lost or taken twice by concurrent reserves");
+}
+
+void puloon::test::run_planner_tests() {
+	test_memoized_mix();
+	test_planned_mix();
+	test_amount_that_cannot_be_made();
+	test_release();
+	test_retain();
+	test_reservations_taken_over();
+	test_reservations_beyond_new_inventory();
+	test_concurrent_reserves();
+}
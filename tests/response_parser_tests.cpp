@@ -0,0 +1,137 @@
+#include "test.h"
+#include <cstdint>
+#include <vector>
+#include "lcdm_frame.h"
+#include "lcdm_response_parser.h"
+
+using namespace puloon;
+using namespace puloon::detail;
+
+// builds a response frame with bcc around result data
+static std::vector<std::uint8_t> build_response_frame(const std::vector<std::uint8_t>& result_data) {
+	std::vector<std::uint8_t> response_frame;
+	response_frame.push_back(soh);
+	response_frame.push_back(id);
+	response_frame.push_back(stx);
+	response_frame.insert(response_frame.end(), result_data.begin(), result_data.end());
+	response_frame.push_back(etx);
+	response_frame.push_back(get_bcc(response_frame.data(), response_frame.data() + response_frame.size()));
+	return response_frame;
+}
+
+// result data of a purge that ended with the good status
+static std::vector<std::uint8_t> get_purge_result_data() {
+	return std::vector<std::uint8_t>{ (std::uint8_t)command_code::purge, 0x30 };
+}
+
+static bool has_result_data(const response_parser& parser, const std::vector<std::uint8_t>& expected_result_data) {
+	const data_view result_data = parser.get_result_data();
+	if (result_data.size() != expected_result_data.size()) {
+		return false;
+	}
+
+	for (std::size_t i = 0; i < result_data.size(); ++i) {
+		if (result_data[i] != expected_result_data[i]) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+// a frame in a single chunk is completed on its last byte
+static void test_complete_frame() {
+	const std::vector<std::uint8_t> response_frame = build_response_frame(get_purge_result_data());
+	response_parser parser;
+
+	const std::uint8_t* data_begin = response_frame.data();
+	const std::uint8_t* data_end = response_frame.data() + response_frame.size();
+	test::check(parser.parse(data_begin, data_end) == response_parser::parse_result::completed, "frame is not completed");
+	test::check(data_begin == data_end, "bytes of the frame are left");
+	test::check(has_result_data(parser, get_purge_result_data()), "result data is not kept");
+}
+
+// a frame split across reads at every position
+// is completed by its last chunk
+static void test_frame_split_across_reads() {
+	const std::vector<std::uint8_t> response_frame = build_response_frame(get_purge_result_data());
+
+	for (std::size_t split_position = 1; split_position < response_frame.size(); ++split_position) {
+		response_parser parser;
+
+		const std::uint8_t* data_begin = response_frame.data();
+		const std::uint8_t* split_end = response_frame.data() + split_position;
+		test::check(parser.parse(data_begin, split_end) == response_parser::parse_result::incomplete, "part of a frame is not incomplete");
+		test::check(data_begin == split_end, "part of a frame is not consumed");
+
+		const std::uint8_t* data_end = response_frame.data() + response_frame.size();
+		test::check(parser.parse(data_begin, data_end) == response_parser::parse_result::completed, "split frame is not completed");
+		test::check(has_result_data(parser, get_purge_result_data()), "result data of a split frame is not kept");
+	}
+}
+
+// a frame with a wrong bcc is corrupted,
+// the parser then waits for the next frame
+static void test_bad_bcc() {
+	std::vector<std::uint8_t> response_frame = build_response_frame(get_purge_result_data());
+	response_frame.back() ^= 0xff;
+	const std::vector<std::uint8_t> next_frame = build_response_frame(get_purge_result_data());
+	response_frame.insert(response_frame.end(), next_frame.begin(), next_frame.end());
+	response_parser parser;
+
+	const std::uint8_t* data_begin = response_frame.data();
+	const std::uint8_t* data_end = response_frame.data() + response_frame.size();
+	test::check(parser.parse(data_begin, data_end) == response_parser::parse_result::corrupted, "frame with a bad bcc is not corrupted");
+	test::check(data_begin == data_end - next_frame.size(), "parsing does not stop after a corrupted frame");
+	test::check(parser.parse(data_begin, data_end) == response_parser::parse_result::completed, "frame after a corrupted one is not completed");
+}
+
+// noise before a frame and a header of an unknown command
+// are skipped
+static void test_resynchronization() {
+	std::vector<std::uint8_t> response_data{ 0x00, 0xff, soh, soh, id, soh, id, stx, 0x99, 0x42 };
+	const std::vector<std::uint8_t> response_frame = build_response_frame(get_purge_result_data());
+	response_data.insert(response_data.end(), response_frame.begin(), response_frame.end());
+	response_parser parser;
+
+	const std::uint8_t* data_begin = response_data.data();
+	const std::uint8_t* data_end = response_data.data() + response_data.size();
+	test::check(parser.parse(data_begin, data_end) == response_parser::parse_result::completed, "frame after noise is not completed");
+	test::check(has_result_data(parser, get_purge_result_data()), "result data after noise is not kept");
+}
+
+// a missing etx corrupts the frame
+static void test_missing_etx() {
+	std::vector<std::uint8_t> response_frame = build_response_frame(get_purge_result_data());
+	response_frame[response_frame.size() - 2] = 0x00;
+	response_parser parser;
+
+	const std::uint8_t* data_begin = response_frame.data();
+	const std::uint8_t* data_end = response_frame.data() + response_frame.size();
+	test::check(parser.parse(data_begin, data_end) == response_parser::parse_result::corrupted, "frame without etx is not corrupted");
+}
+
+// a frame cut before its etx is corrupted
+// and the frame that starts in its place is received
+static void test_frame_cut_before_etx() {
+	std::vector<std::uint8_t> response_data{ soh, id, stx, (std::uint8_t)command_code::purge, 0x30 };
+	const std::vector<std::uint8_t> response_frame = build_response_frame(get_purge_result_data());
+	response_data.insert(response_data.end(), response_frame.begin(), response_frame.end());
+	response_parser parser;
+
+	const std::uint8_t* data_begin = response_data.data();
+	const std::uint8_t* data_end = response_data.data() + response_data.size();
+	test::check(parser.parse(data_begin, data_end) == response_parser::parse_result::corrupted, "cut frame is not corrupted");
+	test::check(parser.is_receiving_frame(), "frame in place of the etx is not started");
+	test::check(parser.parse(data_begin, data_end) == response_parser::parse_result::completed, "frame after a cut one is not completed");
+	test::check(has_result_data(parser, get_purge_result_data()), "result data after a cut frame is not kept");
+}
+
+void puloon::test::run_response_parser_tests() {
+	test_complete_frame();
+	test_frame_split_across_reads();
+	test_bad_bcc();
+	test_resynchronization();
+	test_missing_etx();
+	test_frame_cut_before_etx();
+}
@@ -0,0 +1,37 @@
+#ifndef TEST_H
+#define TEST_H
+
+#include <stdexcept>
+#include <string>
+
+namespace puloon {
+
+	namespace test {
+
+		// fails the running test with the description
+		// if the condition does not hold
+		inline void check(bool condition, const std::string& description) {
+			if (!condition) {
+				throw std::runtime_error(description);
+			}
+		}
+
+		// every suite throws an exception at the first failed check
+		void run_bounded_queue_tests();
+		void run_response_parser_tests();
+		void run_operation_tests();
+		void run_metrics_tests();
+		void run_timeout_estimator_tests();
+		void run_planner_tests();
+		void run_journal_tests();
+		void run_transport_tests();
+		void run_engine_tests();
+#if defined(PULOON_TEST_LCDMD)
+		void run_lcdmd_tests();
+#endif
+
+	}
+
+}
+
+#endif // TEST_H
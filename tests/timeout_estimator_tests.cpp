@@ -0,0 +1,48 @@
+#include "test.h"
+#include <chrono>
+#include <cstdint>
+#include "lcdm_timeout_estimator.h"
+
+using namespace puloon;
+using namespace puloon::detail;
+
+// a response of a few bills does not shorten the deadline
+// of a response of many more bills, up to a dispense of every cassette
+static void test_load_classes() {
+	const std::uint8_t code = 0x52;
+	const std::uint32_t bills[] = { 0, 5, 20, 45, 90, 150, 210, 240 };
+
+	timeout_estimator deadlines((lcdm::timeouts()));
+
+	for (std::size_t i = 0; i < sizeof(bills) / sizeof(bills[0]); ++i) {
+		for (int j = 0; j < 16; ++j) {
+			deadlines.record_response_latency(code, bills[i], std::chrono::milliseconds(2000 + 500 * (std::int64_t)i));
+		}
+	}
+
+	for (std::size_t i = 1; i < sizeof(bills) / sizeof(bills[0]); ++i) {
+		test::check(deadlines.get_response_timeout(code, bills[i]) > deadlines.get_response_timeout(code, bills[i - 1]),
+			"responses of " + std::to_string(bills[i - 1]) + " and " + std::to_string(bills[i]) + " bills share a deadline");
+	}
+}
+
+// a deadline follows the latencies of its command
+// and is doubled after it expires
+static void test_back_off() {
+	const std::uint8_t code = 0x50;
+
+	timeout_estimator deadlines((lcdm::timeouts()));
+	deadlines.record_response_latency(code, 0, std::chrono::milliseconds(4000));
+	const std::chrono::milliseconds timeout = deadlines.get_response_timeout(code, 0);
+
+	deadlines.back_off_response(code, 0);
+	test::check(deadlines.get_response_timeout(code, 0) == 2 * timeout, "expired deadline is not doubled");
+
+	deadlines.record_response_latency(code, 0, std::chrono::milliseconds(4000));
+	test::check(deadlines.get_response_timeout(code, 0) < 2 * timeout, "observed latency does not end the back off");
+}
+
+void puloon::test::run_timeout_estimator_tests() {
+	test_load_classes();
+	test_back_off();
+}
@@ -0,0 +1,210 @@
+#include "test.h"
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include <boost/asio.hpp>
+#include "lcdm_transport.h"
+
+using namespace puloon;
+
+// completion of a transport operation
+struct io_completion {
+	bool is_completed = false;
+	boost::system::error_code error;
+	std::size_t transferred_size = 0;
+};
+
+static lcdm_transport::io_handler make_io_handler(io_completion& completion) {
+	return [&completion](const boost::system::error_code& error, std::size_t transferred_size) {
+		completion.is_completed = true;
+		completion.error = error;
+		completion.transferred_size = transferred_size;
+	};
+}
+
+static lcdm_transport::write_buffers make_write_buffers(const std::string& data) {
+	lcdm_transport::write_buffers buffers;
+	buffers[0] = boost::asio::buffer(data);
+	return buffers;
+}
+
+// runs the handlers that are ready
+static void run_handlers(boost::asio::io_service& io_service) {
+	io_service.restart();
+	io_service.poll();
+}
+
+// a write before the read is held by the pipe,
+// a write during the read is copied into its buffer
+static void test_pipe_write_and_read() {
+	boost::asio::io_service io_service;
+	std::pair<std::unique_ptr<pipe_transport>, std::unique_ptr<pipe_transport>> transports = pipe_transport::create_pair(io_service, io_service);
+	const std::string first_data = "first";
+	const std::string second_data = "second";
+	std::array<char, 16> read_buffer;
+
+	io_completion write_completion;
+	transports.first->async_write(make_write_buffers(first_data), make_io_handler(write_completion));
+	test::check(!write_completion.is_completed, "handler is invoked from inside the call");
+	run_handlers(io_service);
+	test::check(write_completion.is_completed && (!write_completion.error) && (write_completion.transferred_size == first_data.size()),
+		"held write is not completed");
+
+	io_completion read_completion;
+	transports.second->async_read_some(boost::asio::buffer(read_buffer), make_io_handler(read_completion));
+	run_handlers(io_service);
+	test::check(read_completion.is_completed && (!read_completion.error)
+		&& (std::string(read_buffer.data(), read_completion.transferred_size) == first_data),
+		"held data is not read");
+
+	read_completion = io_completion();
+	transports.second->async_read_some(boost::asio::buffer(read_buffer), make_io_handler(read_completion));
+	run_handlers(io_service);
+	test::check(!read_completion.is_completed, "read completes without data");
+
+	write_completion = io_completion();
+	transports.first->async_write(make_write_buffers(second_data), make_io_handler(write_completion));
+	run_handlers(io_service);
+	test::check(write_completion.is_completed && (!write_completion.error), "write into a pending read is not completed");
+	test::check(read_completion.is_completed && (!read_completion.error)
+		&& (std::string(read_buffer.data(), read_completion.transferred_size) == second_data),
+		"data is not copied into the pending read");
+}
+
+// cancel completes the pending read with operation_aborted
+// and leaves the pending write in progress
+static void test_pipe_cancel() {
+	boost::asio::io_service io_service;
+	std::pair<std::unique_ptr<pipe_transport>, std::unique_ptr<pipe_transport>> transports = pipe_transport::create_pair(io_service, io_service);
+	// more than the pipe holds for an end that is not reading
+	const std::string data(300, 'x');
+	std::array<char, 16> read_buffer;
+
+	io_completion write_completion;
+	transports.first->async_write(make_write_buffers(data), make_io_handler(write_completion));
+	io_completion read_completion;
+	transports.first->async_read_some(boost::asio::buffer(read_buffer), make_io_handler(read_completion));
+	transports.first->cancel();
+	run_handlers(io_service);
+	test::check(read_completion.is_completed && (read_completion.error == boost::asio::error::operation_aborted),
+		"cancelled read is not aborted");
+	test::check(!write_completion.is_completed, "pending write is cancelled with the read");
+
+	std::string received_data;
+	while (received_data.size() < data.size()) {
+		read_completion = io_completion();
+		transports.second->async_read_some(boost::asio::buffer(read_buffer), make_io_handler(read_completion));
+		run_handlers(io_service);
+		test::check(read_completion.is_completed && (!read_completion.error), "data of the pending write is not read");
+		received_data.append(read_buffer.data(), read_completion.transferred_size);
+	}
+
+	test::check(received_data == data, "data of the pending write is changed");
+	test::check(write_completion.is_completed && (!write_completion.error) && (write_completion.transferred_size == data.size()),
+		"pending write is not completed after cancel");
+}
+
+// a bridge that accepts carries the bytes both ways
+static void test_tcp_connect() {
+	boost::asio::io_service io_service;
+	boost::asio::ip::tcp::acceptor acceptor(io_service, boost::asio::ip::tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0));
+	const std::string service = std::to_string(acceptor.local_endpoint().port());
+	const std::string data = "data";
+	std::array<char, 16> read_buffer;
+
+	tcp_transport transport(io_service, "127.0.0.1", service);
+	boost::asio::ip::tcp::socket bridge_socket(io_service);
+	acceptor.accept(bridge_socket);
+
+	io_completion write_completion;
+	transport.async_write(make_write_buffers(data), make_io_handler(write_completion));
+	while (!write_completion.is_completed) {
+		io_service.run_one();
+	}
+	test::check(!write_completion.error, "data is not written to the bridge");
+	test::check((boost::asio::read(bridge_socket, boost::asio::buffer(read_buffer, data.size())) == data.size())
+		&& (std::string(read_buffer.data(), data.size()) == data),
+		"bridge does not receive the data");
+
+	// nothing listens on the port any more
+	bridge_socket.close();
+	acceptor.close();
+	bool connection_is_refused = false;
+	try {
+		tcp_transport refused_transport(io_service, "127.0.0.1", service);
+	} catch (boost::system::system_error) {
+		connection_is_refused = true;
+	}
+	test::check(connection_is_refused, "refused connection does not throw");
+}
+
+// a bridge that does not answer the connection
+// fails the transport once the timeout expires
+static void test_tcp_connect_timeout() {
+	boost::asio::io_service io_service;
+	boost::asio::ip::tcp::acceptor acceptor(io_service, boost::asio::ip::tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0));
+	const std::string service = std::to_string(acceptor.local_endpoint().port());
+
+	// connections that are never accepted fill the backlog,
+	// further connection requests are dropped
+	acceptor.listen(0);
+	std::vector<std::unique_ptr<boost::asio::ip::tcp::socket>> waiting_sockets;
+	for (int i = 0; i < 4; ++i) {
+		waiting_sockets.emplace_back(new boost::asio::ip::tcp::socket(io_service));
+		waiting_sockets.back()->async_connect(acceptor.local_endpoint(), [](const boost::system::error_code&) { });
+	}
+	io_service.poll();
+
+	const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	boost::system::error_code connect_error;
+	try {
+		tcp_transport transport(io_service, "127.0.0.1", service, std::chrono::milliseconds(200));
+	} catch (const boost::system::system_error& error) {
+		connect_error = error.code();
+	}
+
+	test::check(connect_error == boost::asio::error::timed_out, "unanswered connection does not time out");
+	test::check(std::chrono::steady_clock::now() - start < std::chrono::seconds(2), "connection outlives its timeout");
+}
+
+// the other end of a closed end reads eof after the data
+// and its writes fail with broken_pipe
+static void test_pipe_close() {
+	boost::asio::io_service io_service;
+	std::pair<std::unique_ptr<pipe_transport>, std::unique_ptr<pipe_transport>> transports = pipe_transport::create_pair(io_service, io_service);
+	const std::string data = "data";
+	std::array<char, 16> read_buffer;
+
+	io_completion write_completion;
+	transports.first->async_write(make_write_buffers(data), make_io_handler(write_completion));
+	transports.first->close();
+	run_handlers(io_service);
+
+	io_completion read_completion;
+	transports.second->async_read_some(boost::asio::buffer(read_buffer), make_io_handler(read_completion));
+	run_handlers(io_service);
+	test::check(read_completion.is_completed && (!read_completion.error) && (read_completion.transferred_size == data.size()),
+		"data written before close is not read");
+
+	read_completion = io_completion();
+	transports.second->async_read_some(boost::asio::buffer(read_buffer), make_io_handler(read_completion));
+	run_handlers(io_service);
+	test::check(read_completion.is_completed && (read_completion.error == boost::asio::error::eof), "read after close is not eof");
+
+	write_completion = io_completion();
+	transports.second->async_write(make_write_buffers(data), make_io_handler(write_completion));
+	run_handlers(io_service);
+	test::check(write_completion.is_completed && (write_completion.error == boost::asio::error::broken_pipe),
+		"write to a closed end is not broken_pipe");
+}
+
+void puloon::test::run_transport_tests() {
+	test_pipe_write_and_read();
+	test_pipe_cancel();
+	test_pipe_close();
+	test_tcp_connect();
+	test_tcp_connect_timeout();
+}
@@ -0,0 +1,594 @@
+#include "lcdm_simulator.h"
+#include <algorithm>
+#include <stdexcept>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <termios.h>
+#include <unistd.h>
+
+using namespace puloon;
+
+// start of heading
+const std::uint8_t soh = 0x01;
+// end of transmission
+const std::uint8_t eot = 0x04;
+// id
+const std::uint8_t id = 0x50;
+// start of text
+const std::uint8_t stx = 0x02;
+// end of text
+const std::uint8_t etx = 0x03;
+// acknowledge
+const std::uint8_t ack = 0x06;
+// negative acknowledge
+const std::uint8_t nak = 0x15;
+
+// command codes
+const std::uint8_t purge_code = 0x44;
+const std::uint8_t upper_dispense_code = 0x45;
+const std::uint8_t status_code = 0x46;
+const std::uint8_t rom_version_code = 0x47;
+const std::uint8_t lower_dispense_code = 0x55;
+const std::uint8_t up_low_dispense_code = 0x56;
+const std::uint8_t upper_test_dispense_code = 0x76;
+const std::uint8_t lower_test_dispense_code = 0x77;
+const std::uint8_t multi_dispense_code = 0x52;
+
+// error codes
+const std::uint8_t good_code = 0x30;
+const std::uint8_t jam_code = 0x33;
+const std::uint8_t bill_end_code = 0x38;
+const std::uint8_t over_reject_code = 0x44;
+
+// maximum number of bills in a command
+const std::uint32_t max_dispensable_bills = 60;
+// maximum number of rejected bills in a command
+const std::uint32_t max_rejected_bills = 8;
+// cassette is near end below this number of bills
+const std::uint32_t near_end_bills = 50;
+// time to wait for ACK/NAK of the host after a response
+const std::chrono::milliseconds host_acknowledge_timeout(1000);
+const int max_try_count = 3;
+
+lcdm_simulator::settings::settings() :
+	ack_latency(std::chrono::microseconds(500)),
+	response_latency(std::chrono::microseconds(2000)),
+	bill_latency(std::chrono::microseconds(0)),
+	reject_rate(0.0),
+	jam_rate(0.0),
+	corruption_rate(0.0),
+	drop_rate(0.0),
+	cassette_count(2),
+	upper_cassette_bills(2000),
+	lower_cassette_bills(2000),
+	third_cassette_bills(2000),
+	fourth_cassette_bills(2000),
+	seed(0) { }
+
+lcdm_simulator::lcdm_simulator(const settings& simulator_settings) :
+	simulator_settings(simulator_settings),
+	master_descriptor(-1),
+	slave_descriptor(-1),
+	port_name(),
+	pipe_is_used(false),
+	pipe_io_service(),
+	pipe_io_service_work(pipe_io_service),
+	pipe_mutex(),
+	device_end(),
+	received_data(),
+	cassette_bills{ simulator_settings.upper_cassette_bills, simulator_settings.lower_cassette_bills,
+		simulator_settings.third_cassette_bills, simulator_settings.fourth_cassette_bills },
+	last_error_code(good_code),
+	jammed(false),
+	random_engine(simulator_settings.seed),
+	command_count(0),
+	simulator_is_working(false),
+	simulator_thread() {
+	this->master_descriptor = posix_openpt(O_RDWR | O_NOCTTY);
+
+	if ((this->master_descriptor < 0)
+		|| (grantpt(this->master_descriptor) != 0)
+		|| (unlockpt(this->master_descriptor) != 0)
+		|| (ptsname(this->master_descriptor) == nullptr)) {
+		if (this->master_descriptor >= 0) {
+			::close(this->master_descriptor);
+		}
+		throw std::runtime_error("unable to open pseudo-terminal");
+	}
+
+	this->port_name = ptsname(this->master_descriptor);
+	this->slave_descriptor = ::open(this->port_name.c_str(), O_RDWR | O_NOCTTY);
+
+	if (this->slave_descriptor < 0) {
+		::close(this->master_descriptor);
+		throw std::runtime_error("unable to open pseudo-terminal");
+	}
+
+	// raw mode until the driver sets its own options
+	termios slave_options;
+	tcgetattr(this->slave_descriptor, &slave_options);
+	cfmakeraw(&slave_options);
+	tcsetattr(this->slave_descriptor, TCSANOW, &slave_options);
+
+	this->simulator_is_working = true;
+	this->simulator_thread = std::thread(&lcdm_simulator::operate, this);
+}
+
+lcdm_simulator::lcdm_simulator(in_process_pipe, const settings& simulator_settings) :
+	simulator_settings(simulator_settings),
+	master_descriptor(-1),
+	slave_descriptor(-1),
+	port_name(),
+	pipe_is_used(true),
+	pipe_io_service(),
+	pipe_io_service_work(pipe_io_service),
+	pipe_mutex(),
+	device_end(),
+	received_data(),
+	cassette_bills{ simulator_settings.upper_cassette_bills, simulator_settings.lower_cassette_bills,
+		simulator_settings.third_cassette_bills, simulator_settings.fourth_cassette_bills },
+	last_error_code(good_code),
+	jammed(false),
+	random_engine(simulator_settings.seed),
+	command_count(0),
+	simulator_is_working(true),
+	simulator_thread() {
+	this->simulator_thread = std::thread(&lcdm_simulator::operate, this);
+}
+
+lcdm_simulator::~lcdm_simulator() {
+	this->simulator_is_working = false;
+	this->simulator_thread.join();
+
+	if (this->pipe_is_used) {
+		return;
+	}
+
+	::close(this->slave_descriptor);
+	::close(this->master_descriptor);
+}
+
+const std::string& lcdm_simulator::get_port_name() const {
+	return this->port_name;
+}
+
+std::unique_ptr<lcdm_transport> lcdm_simulator::create_transport(boost::asio::io_service& io_service) {
+	if (!this->pipe_is_used) {
+		return std::unique_ptr<lcdm_transport>(new serial_transport(io_service, this->port_name));
+	}
+
+	std::pair<std::unique_ptr<pipe_transport>, std::unique_ptr<pipe_transport>> ends = pipe_transport::create_pair(io_service, this->pipe_io_service);
+	std::lock_guard<std::mutex> pipe_lock(this->pipe_mutex);
+	// the host of the previous pipe reads the end of the stream
+	this->device_end = std::move(ends.second);
+
+	return std::move(ends.first);
+}
+
+std::uint64_t lcdm_simulator::get_command_count() const {
+	return this->command_count;
+}
+
+void lcdm_simulator::operate() {
+	frame command_frame;
+
+	while (this->simulator_is_working) {
+		if (this->extract_command(command_frame)) {
+			++this->command_count;
+			std::this_thread::sleep_for(this->simulator_settings.ack_latency);
+			this->send(frame(1, ack));
+			this->send_response(this->execute_command(command_frame));
+		} else {
+			this->receive(std::chrono::milliseconds(50));
+		}
+	}
+}
+
+bool lcdm_simulator::extract_command(frame& command_frame) {
+	for (;;) {
+		// skip data before a command frame
+		frame::iterator frame_begin = std::find(this->received_data.begin(), this->received_data.end(), eot);
+		this->received_data.erase(this->received_data.begin(), frame_begin);
+
+		// EOT, ID, STX, command code
+		if (this->received_data.size() < 4) {
+			return false;
+		}
+
+		const int command_data_size = get_command_data_size(this->received_data[3]);
+
+		if ((this->received_data[1] != id) || (this->received_data[2] != stx) || (command_data_size < 0)) {
+			this->received_data.erase(this->received_data.begin());
+			continue;
+		}
+
+		const std::size_t frame_size = (std::size_t)command_data_size + 6;
+
+		if (this->received_data.size() < frame_size) {
+			return false;
+		}
+
+		if (this->received_data[frame_size - 2] != etx) {
+			this->received_data.erase(this->received_data.begin());
+			continue;
+		}
+
+		std::uint8_t bcc = 0;
+		for (std::size_t i = 0; i < frame_size - 1; ++i) {
+			bcc ^= this->received_data[i];
+		}
+
+		command_frame.assign(this->received_data.begin(), this->received_data.begin() + frame_size);
+		this->received_data.erase(this->received_data.begin(), this->received_data.begin() + frame_size);
+
+		if (bcc == command_frame.back()) {
+			return true;
+		}
+
+		// the host repeats the command after NAK
+		this->send(frame(1, nak));
+	}
+}
+
+lcdm_simulator::frame lcdm_simulator::execute_command(const frame& command_frame) {
+	const std::uint8_t code = command_frame[3];
+	std::uint32_t picked_bills = 0;
+	frame result_data(1, code);
+
+	// reads tens and units of the requested bills
+	auto read_bills_count = [&command_frame](std::size_t offset) {
+		return ((std::uint32_t)(command_frame[offset] - '0') * 10) + (std::uint32_t)(command_frame[offset + 1] - '0');
+	};
+	// appends tens and units of a bills count
+	auto write_bills_count = [&result_data](std::uint32_t bills_count) {
+		result_data.push_back((std::uint8_t)('0' + ((bills_count / 10) % 10)));
+		result_data.push_back((std::uint8_t)('0' + (bills_count % 10)));
+	};
+
+	switch (code) {
+		case purge_code:
+			// the bill path is cleared
+			this->jammed = false;
+			this->last_error_code = good_code;
+			result_data.push_back(good_code);
+			break;
+		case upper_dispense_code:
+		case lower_dispense_code:
+		case upper_test_dispense_code:
+		case lower_test_dispense_code: {
+			const bool test = ((code == upper_test_dispense_code) || (code == lower_test_dispense_code));
+			const cassette source = ((code == upper_dispense_code) || (code == upper_test_dispense_code)) ? cassette::upper : cassette::lower;
+			cassette_result result = this->dispense_bills(source, read_bills_count(4), test, picked_bills);
+
+			// bills passed the check sensor, bills passed the exit sensor,
+			// error code, status, rejected bills
+			write_bills_count(result.dispensed_bills + result.rejected_bills);
+			write_bills_count(result.dispensed_bills);
+			result_data.push_back(result.error_code);
+			result_data.push_back('0');
+			write_bills_count(result.rejected_bills);
+			this->last_error_code = result.error_code;
+			break;
+		}
+		case up_low_dispense_code: {
+			cassette_result upper_result = this->dispense_bills(cassette::upper, read_bills_count(4), false, picked_bills);
+			cassette_result lower_result = { 0, 0, upper_result.error_code };
+
+			if (upper_result.error_code == good_code) {
+				lower_result = this->dispense_bills(cassette::lower, read_bills_count(6), false, picked_bills);
+			}
+
+			write_bills_count(upper_result.dispensed_bills + upper_result.rejected_bills);
+			write_bills_count(upper_result.dispensed_bills);
+			write_bills_count(lower_result.dispensed_bills + lower_result.rejected_bills);
+			write_bills_count(lower_result.dispensed_bills);
+			result_data.push_back(lower_result.error_code);
+			result_data.push_back('0');
+			result_data.push_back('0');
+			write_bills_count(upper_result.rejected_bills);
+			write_bills_count(lower_result.rejected_bills);
+			this->last_error_code = lower_result.error_code;
+			break;
+		}
+		case multi_dispense_code: {
+			// the cassettes are dispensed from the top
+			// until the first error
+			cassette_result results[4] = {};
+			std::uint8_t error_code = good_code;
+
+			for (int i = 0; i < 4; ++i) {
+				if (error_code == good_code) {
+					results[i] = this->dispense_bills((cassette)i, read_bills_count(4 + (i * 2)), false, picked_bills);
+					error_code = results[i].error_code;
+				}
+			}
+
+			for (const cassette_result& result : results) {
+				write_bills_count(result.dispensed_bills + result.rejected_bills);
+				write_bills_count(result.dispensed_bills);
+			}
+			result_data.push_back(error_code);
+			result_data.push_back('0');
+			result_data.push_back('0');
+			for (const cassette_result& result : results) {
+				write_bills_count(result.rejected_bills);
+			}
+			this->last_error_code = error_code;
+			break;
+		}
+		case status_code: {
+			// reserved, last error code,
+			// sensor 0 (bit 4: bill in the exit path),
+			// sensor 1 (bits 0-1: upper/lower cassette near end,
+			// bits 2-3: upper/lower cassette present)
+			const std::uint8_t sensor_0 = this->jammed ? 0x10 : 0x00;
+			const std::uint8_t sensor_1 = (std::uint8_t)(0x0c
+				| ((this->cassette_bills[(int)cassette::upper] < near_end_bills) ? 0x01 : 0x00)
+				| ((this->cassette_bills[(int)cassette::lower] < near_end_bills) ? 0x02 : 0x00));
+			result_data.push_back('0');
+			result_data.push_back(this->last_error_code);
+			result_data.push_back(sensor_0);
+			result_data.push_back(sensor_1);
+			break;
+		}
+		case rom_version_code:
+			result_data.push_back('1');
+			result_data.push_back('0');
+			result_data.push_back('3');
+			break;
+	}
+
+	std::this_thread::sleep_for(this->simulator_settings.response_latency
+		+ (this->simulator_settings.bill_latency * picked_bills));
+	return result_data;
+}
+
+lcdm_simulator::cassette_result lcdm_simulator::dispense_bills(cassette source, std::uint32_t requested_bills, bool test, std::uint32_t& picked_bills) {
+	cassette_result result = { 0, 0, good_code };
+	std::uint32_t& cassette_bills = this->cassette_bills[(int)source];
+	std::bernoulli_distribution reject_distribution(this->simulator_settings.reject_rate);
+	std::bernoulli_distribution jam_distribution(this->simulator_settings.jam_rate);
+
+	if (this->jammed) {
+		result.error_code = jam_code;
+		return result;
+	}
+
+	// the command jams after a random number of bills
+	std::uint32_t bills_before_jam = std::min(requested_bills, max_dispensable_bills) + 1;
+	if ((requested_bills > 0) && jam_distribution(this->random_engine)) {
+		bills_before_jam = std::uniform_int_distribution<std::uint32_t>(0, requested_bills - 1)(this->random_engine);
+	}
+
+	// bills delivered to the exit or,
+	// for a test dispense, to the reject tray
+	std::uint32_t delivered_bills = 0;
+
+	while (delivered_bills < std::min(requested_bills, max_dispensable_bills)) {
+		if (delivered_bills == bills_before_jam) {
+			this->jammed = true;
+			result.error_code = jam_code;
+			break;
+		} else if (cassette_bills == 0) {
+			result.error_code = bill_end_code;
+			break;
+		} else if ((!test) && (result.rejected_bills >= max_rejected_bills)) {
+			result.error_code = over_reject_code;
+			break;
+		}
+
+		--cassette_bills;
+		++picked_bills;
+
+		if (test) {
+			++result.rejected_bills;
+			++delivered_bills;
+		} else if (reject_distribution(this->random_engine)) {
+			++result.rejected_bills;
+		} else {
+			++result.dispensed_bills;
+			++delivered_bills;
+		}
+	}
+
+	return result;
+}
+
+void lcdm_simulator::send_response(const frame& result_data) {
+	frame response_frame;
+	response_frame.push_back(soh);
+	response_frame.push_back(id);
+	response_frame.push_back(stx);
+	response_frame.insert(response_frame.end(), result_data.begin(), result_data.end());
+	response_frame.push_back(etx);
+
+	std::uint8_t bcc = 0;
+	for (std::size_t i = 0; i < response_frame.size(); ++i) {
+		bcc ^= response_frame[i];
+	}
+	response_frame.push_back(bcc);
+
+	for (int try_count = max_try_count; try_count > 0; --try_count) {
+		this->send(response_frame);
+
+		// wait for ACK or NAK, a new command
+		// means that the host gave up on this response
+		std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + host_acknowledge_timeout;
+		for (;;) {
+			frame::iterator answer = std::find_if(this->received_data.begin(), this->received_data.end(), [](std::uint8_t value) {
+				return ((value == ack) || (value == nak) || (value == eot));
+			});
+
+			if (answer != this->received_data.end()) {
+				const std::uint8_t answer_value = *answer;
+				this->received_data.erase(this->received_data.begin(), (answer_value == eot) ? answer : answer + 1);
+
+				if (answer_value == nak) {
+					break;
+				}
+				return;
+			}
+
+			const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+			if ((now >= deadline) || !this->simulator_is_working) {
+				return;
+			}
+			this->receive(std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now) + std::chrono::milliseconds(1));
+		}
+	}
+}
+
+void lcdm_simulator::send(const frame& data) {
+	std::bernoulli_distribution corruption_distribution(this->simulator_settings.corruption_rate);
+	std::bernoulli_distribution drop_distribution(this->simulator_settings.drop_rate);
+	frame sent_data;
+	sent_data.reserve(data.size());
+
+	for (std::size_t i = 0; i < data.size(); ++i) {
+		if (drop_distribution(this->random_engine)) {
+			continue;
+		}
+
+		std::uint8_t value = data[i];
+		if (corruption_distribution(this->random_engine)) {
+			value ^= (std::uint8_t)(1 << std::uniform_int_distribution<int>(0, 7)(this->random_engine));
+		}
+		sent_data.push_back(value);
+	}
+
+	if (this->pipe_is_used) {
+		this->send_to_pipe(sent_data);
+		return;
+	}
+
+	std::size_t written_size = 0;
+	while (written_size < sent_data.size()) {
+		const ssize_t result = ::write(this->master_descriptor, sent_data.data() + written_size, sent_data.size() - written_size);
+		if (result <= 0) {
+			return;
+		}
+		written_size += (std::size_t)result;
+	}
+}
+
+bool lcdm_simulator::receive(std::chrono::milliseconds timeout) {
+	if (this->pipe_is_used) {
+		return this->receive_from_pipe(timeout);
+	}
+
+	pollfd master_poll = { this->master_descriptor, POLLIN, 0 };
+
+	if ((poll(&master_poll, 1, (int)timeout.count()) <= 0) || !(master_poll.revents & POLLIN)) {
+		return false;
+	}
+
+	std::uint8_t data[256];
+	const ssize_t result = ::read(this->master_descriptor, data, sizeof(data));
+
+	if (result <= 0) {
+		return false;
+	}
+
+	this->received_data.insert(this->received_data.end(), data, data + result);
+	return true;
+}
+
+void lcdm_simulator::send_to_pipe(const frame& data) {
+	const std::shared_ptr<pipe_transport> current_end = this->get_device_end();
+
+	if (!current_end) {
+		// the data is lost like on a line without a host
+		return;
+	}
+
+	bool write_is_completed = false;
+	const lcdm_transport::write_buffers buffers = { { boost::asio::buffer(data), boost::asio::const_buffer() } };
+	current_end->async_write(buffers, [&write_is_completed](const boost::system::error_code&, std::size_t) {
+		write_is_completed = true;
+	});
+
+	// the pipe holds a few frames,
+	// so the write waits only for a host that does not read
+	while ((!write_is_completed) && this->simulator_is_working) {
+		this->pipe_io_service.run_one_for(std::chrono::milliseconds(50));
+	}
+
+	if (!write_is_completed) {
+		current_end->cancel();
+		while (!write_is_completed) {
+			this->pipe_io_service.run_one();
+		}
+	}
+}
+
+bool lcdm_simulator::receive_from_pipe(std::chrono::milliseconds timeout) {
+	const std::shared_ptr<pipe_transport> current_end = this->get_device_end();
+
+	if (!current_end) {
+		std::this_thread::sleep_for(std::min(timeout, std::chrono::milliseconds(1)));
+		return false;
+	}
+
+	std::uint8_t data[256];
+	bool read_is_completed = false;
+	boost::system::error_code read_error;
+	std::size_t read_size = 0;
+
+	current_end->async_read_some(boost::asio::buffer(data),
+		[&read_is_completed, &read_error, &read_size](const boost::system::error_code& error, std::size_t bytes_transferred) {
+			read_is_completed = true;
+			read_error = error;
+			read_size = bytes_transferred;
+		});
+
+	this->pipe_io_service.run_one_for(timeout);
+
+	if (!read_is_completed) {
+		current_end->cancel();
+		while (!read_is_completed) {
+			this->pipe_io_service.run_one();
+		}
+	}
+
+	if (read_error == boost::asio::error::eof) {
+		// the host has closed its end,
+		// the simulator waits for a new pipe
+		std::lock_guard<std::mutex> pipe_lock(this->pipe_mutex);
+		if (this->device_end == current_end) {
+			this->device_end.reset();
+		}
+	}
+
+	if (read_error || (read_size == 0)) {
+		return false;
+	}
+
+	this->received_data.insert(this->received_data.end(), data, data + read_size);
+	return true;
+}
+
+std::shared_ptr<pipe_transport> lcdm_simulator::get_device_end() {
+	std::lock_guard<std::mutex> pipe_lock(this->pipe_mutex);
+	return this->device_end;
+}
+
+int lcdm_simulator::get_command_data_size(std::uint8_t code) const {
+	switch (code) {
+		case purge_code:
+		case status_code:
+		case rom_version_code:
+			return 0;
+		case upper_dispense_code:
+		case lower_dispense_code:
+		case upper_test_dispense_code:
+		case lower_test_dispense_code:
+			return 2;
+		case up_low_dispense_code:
+			return 4;
+		case multi_dispense_code:
+			return (this->simulator_settings.cassette_count == 4) ? 8 : -1;
+		default:
+			return -1;
+	}
+}
@@ -0,0 +1,153 @@
+#ifndef LCDM_SIMULATOR_H
+#define LCDM_SIMULATOR_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <boost/asio.hpp>
+#include "lcdm_transport.h"
+
+namespace puloon {
+
+	// simulator of an LCDM dispenser
+	// behind a pseudo-terminal;
+	// the driver opens the slave side of the pseudo-terminal
+	// as a serial port and runs unmodified against it,
+	// or talks to the simulator through an in-process pipe
+	class lcdm_simulator {
+		public:
+			// serves the host over an in-process pipe
+			// in place of a pseudo-terminal
+			struct in_process_pipe {
+			};
+
+			struct settings {
+				settings();
+
+				// delay between a received command and ACK
+				std::chrono::microseconds ack_latency;
+				// delay between ACK and the response frame
+				std::chrono::microseconds response_latency;
+				// additional delay of the response for every picked bill
+				std::chrono::microseconds bill_latency;
+				// probability of a rejected bill for every picked bill
+				double reject_rate;
+				// probability of a jam for every dispense command
+				double jam_rate;
+				// probability of a corrupted byte in data sent to the host
+				double corruption_rate;
+				// probability of a dropped byte in data sent to the host
+				double drop_rate;
+				// 2 for LCDM-2000,
+				// 4 for LCDM-4000 that answers the multi dispense
+				std::uint32_t cassette_count;
+				// initial number of bills in the cassettes
+				std::uint32_t upper_cassette_bills;
+				std::uint32_t lower_cassette_bills;
+				std::uint32_t third_cassette_bills;
+				std::uint32_t fourth_cassette_bills;
+				// seed of the fault injection
+				std::uint32_t seed;
+			};
+
+		public:
+			// opens a pseudo-terminal and starts
+			// serving the host on a simulator thread
+			lcdm_simulator(const settings& simulator_settings = settings());
+			// waits for the host to create its end of a pipe
+			explicit lcdm_simulator(in_process_pipe, const settings& simulator_settings = settings());
+			~lcdm_simulator();
+
+			lcdm_simulator(const lcdm_simulator&) = delete;
+			lcdm_simulator& operator=(const lcdm_simulator&) = delete;
+
+			// name of the serial port for the driver,
+			// empty if the simulator serves a pipe
+			const std::string& get_port_name() const;
+			// creates the transport of the driver on its io_service:
+			// the serial port of the pseudo-terminal,
+			// or the host end of a new pipe that replaces the previous one
+			std::unique_ptr<lcdm_transport> create_transport(boost::asio::io_service& io_service);
+			// number of valid command frames received from the host
+			std::uint64_t get_command_count() const;
+
+		private:
+			typedef std::vector<std::uint8_t> frame;
+
+			enum class cassette {
+				upper = 0,
+				lower = 1,
+				third = 2,
+				fourth = 3
+			};
+
+			struct cassette_result {
+				std::uint32_t dispensed_bills;
+				std::uint32_t rejected_bills;
+				std::uint8_t error_code;
+			};
+
+		private:
+			// main cycle that reads commands from the host
+			// and answers them until the simulator is destroyed
+			void operate();
+			// extracts the next command frame from received data,
+			// returns false if more data is needed
+			bool extract_command(frame& command_frame);
+			// performs a command and returns the result data
+			frame execute_command(const frame& command_frame);
+			cassette_result dispense_bills(cassette source, std::uint32_t requested_bills, bool test, std::uint32_t& picked_bills);
+			// sends a response frame and repeats it
+			// after NAK of the host
+			void send_response(const frame& result_data);
+			// writes data to the host
+			// with injected corruption and drops
+			void send(const frame& data);
+			// reads data from the host
+			// until the timeout expires
+			bool receive(std::chrono::milliseconds timeout);
+			// pipe variants of the above,
+			// run the handlers of the device end on the simulator thread
+			void send_to_pipe(const frame& data);
+			bool receive_from_pipe(std::chrono::milliseconds timeout);
+			// device end of the current pipe,
+			// null until the host creates its end
+			std::shared_ptr<pipe_transport> get_device_end();
+			// returns the size of the command data
+			// or -1 if the command is unknown to the device model
+			int get_command_data_size(std::uint8_t code) const;
+
+		private:
+			settings simulator_settings;
+			int master_descriptor;
+			// the slave side is kept open,
+			// so the pseudo-terminal survives reopening by the driver
+			int slave_descriptor;
+			std::string port_name;
+			// set if the host is served over a pipe
+			bool pipe_is_used;
+			boost::asio::io_service pipe_io_service;
+			// handlers of the device end are awaited one at a time
+			boost::asio::io_service::work pipe_io_service_work;
+			// guards the replacement of the device end
+			std::mutex pipe_mutex;
+			std::shared_ptr<pipe_transport> device_end;
+			frame received_data;
+			std::uint32_t cassette_bills[4];
+			std::uint8_t last_error_code;
+			bool jammed;
+			std::mt19937 random_engine;
+			std::atomic<std::uint64_t> command_count;
+			std::atomic<bool> simulator_is_working;
+			std::thread simulator_thread;
+	};
+
+}
+
+#endif // LCDM_SIMULATOR_H
@@ -0,0 +1,113 @@
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <unistd.h>
+#include "lcdm_simulator.h"
+
+using namespace puloon;
+
+static volatile std::sig_atomic_t simulator_is_stopped = 0;
+
+static void stop_simulator(int) {
+	simulator_is_stopped = 1;
+}
+
+static void print_usage(const char* program_name) {
+	std::cerr << "usage: " << program_name << " [options]" << std::endl
+		<< "  --link PATH                 create a symbolic link to the serial port" << std::endl
+		<< "  --ack-latency-us N          delay before ACK" << std::endl
+		<< "  --response-latency-us N     delay before the response frame" << std::endl
+		<< "  --bill-latency-us N         additional response delay for every picked bill" << std::endl
+		<< "  --reject-rate P             probability of a rejected bill" << std::endl
+		<< "  --jam-rate P                probability of a jam in a dispense command" << std::endl
+		<< "  --corruption-rate P         probability of a corrupted byte" << std::endl
+		<< "  --drop-rate P               probability of a dropped byte" << std::endl
+		<< "  --cassettes N               2 (LCDM-2000) or 4 (LCDM-4000, experimental)" << std::endl
+		<< "  --upper-bills N             bills in the upper cassette" << std::endl
+		<< "  --lower-bills N             bills in the lower cassette" << std::endl
+		<< "  --third-bills N             bills in the third cassette" << std::endl
+		<< "  --fourth-bills N            bills in the fourth cassette" << std::endl
+		<< "  --seed N                    seed of the fault injection" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+	lcdm_simulator::settings simulator_settings;
+	const char* link_path = nullptr;
+
+	for (int i = 1; i < argc; ++i) {
+		const char* option = argv[i];
+		const char* value = (i + 1 < argc) ? argv[i + 1] : nullptr;
+
+		if (value == nullptr) {
+			print_usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+
+		if (std::strcmp(option, "--link") == 0) {
+			link_path = value;
+		} else if (std::strcmp(option, "--ack-latency-us") == 0) {
+			simulator_settings.ack_latency = std::chrono::microseconds(std::atol(value));
+		} else if (std::strcmp(option, "--response-latency-us") == 0) {
+			simulator_settings.response_latency = std::chrono::microseconds(std::atol(value));
+		} else if (std::strcmp(option, "--bill-latency-us") == 0) {
+			simulator_settings.bill_latency = std::chrono::microseconds(std::atol(value));
+		} else if (std::strcmp(option, "--reject-rate") == 0) {
+			simulator_settings.reject_rate = std::atof(value);
+		} else if (std::strcmp(option, "--jam-rate") == 0) {
+			simulator_settings.jam_rate = std::atof(value);
+		} else if (std::strcmp(option, "--corruption-rate") == 0) {
+			simulator_settings.corruption_rate = std::atof(value);
+		} else if (std::strcmp(option, "--drop-rate") == 0) {
+			simulator_settings.drop_rate = std::atof(value);
+		} else if (std::strcmp(option, "--cassettes") == 0) {
+			simulator_settings.cassette_count = (std::uint32_t)std::atol(value);
+		} else if (std::strcmp(option, "--upper-bills") == 0) {
+			simulator_settings.upper_cassette_bills = (std::uint32_t)std::atol(value);
+		} else if (std::strcmp(option, "--lower-bills") == 0) {
+			simulator_settings.lower_cassette_bills = (std::uint32_t)std::atol(value);
+		} else if (std::strcmp(option, "--third-bills") == 0) {
+			simulator_settings.third_cassette_bills = (std::uint32_t)std::atol(value);
+		} else if (std::strcmp(option, "--fourth-bills") == 0) {
+			simulator_settings.fourth_cassette_bills = (std::uint32_t)std::atol(value);
+		} else if (std::strcmp(option, "--seed") == 0) {
+			simulator_settings.seed = (std::uint32_t)std::atol(value);
+		} else {
+			print_usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+
+		++i;
+	}
+
+	std::signal(SIGINT, stop_simulator);
+	std::signal(SIGTERM, stop_simulator);
+
+	try {
+		lcdm_simulator simulator(simulator_settings);
+
+		if (link_path != nullptr) {
+			::unlink(link_path);
+			if (::symlink(simulator.get_port_name().c_str(), link_path) != 0) {
+				std::cerr << "unable to create link " << link_path << std::endl;
+				return EXIT_FAILURE;
+			}
+		}
+
+		std::cout << simulator.get_port_name() << std::endl;
+
+		while (!simulator_is_stopped) {
+			::pause();
+		}
+
+		if (link_path != nullptr) {
+			::unlink(link_path);
+		}
+		std::cerr << simulator.get_command_count() << " commands served" << std::endl;
+	} catch (const std::exception& error) {
+		std::cerr << error.what() << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
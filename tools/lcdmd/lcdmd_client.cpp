@@ -0,0 +1,316 @@
+#include "lcdmd_client.h"
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "lcdmd_protocol.h"
+
+using namespace puloon;
+
+// creates a handler that passes
+// the result of an operation to a promise
+template <typename Result>
+static std::function<void(std::exception_ptr, Result)> make_promise_handler(const std::shared_ptr<std::promise<Result>>& result) {
+	return [result](std::exception_ptr error, Result value) {
+		if (error) {
+			result->set_exception(error);
+		} else {
+			result->set_value(value);
+		}
+	};
+}
+
+// invokes the handler of a purge or of a dispense
+static void complete_request(const lcdm::purge_handler& purge_handler, const lcdm::dispense_handler& dispense_handler, std::exception_ptr error, const lcdm::dispense_result& result) {
+	if (purge_handler) {
+		purge_handler(error, result.status);
+	} else if (dispense_handler) {
+		dispense_handler(error, result);
+	}
+}
+
+static lcdm::dispense_result make_status_result(lcdm::operation_status status) {
+	lcdm::dispense_result result;
+	result.status = status;
+	return result;
+}
+
+static int connect_socket(const std::string& socket_path) {
+	sockaddr_un address;
+	std::memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+
+	if (socket_path.size() >= sizeof(address.sun_path)) {
+		throw std::runtime_error("unable to connect to lcdmd");
+	}
+	std::memcpy(address.sun_path, socket_path.c_str(), socket_path.size());
+
+	const int socket_descriptor = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (socket_descriptor < 0) {
+		throw std::runtime_error("unable to connect to lcdmd");
+	}
+
+	if (::connect(socket_descriptor, (const sockaddr*)&address, sizeof(address)) != 0) {
+		::close(socket_descriptor);
+		throw std::runtime_error("unable to connect to lcdmd");
+	}
+
+	return socket_descriptor;
+}
+
+// reads exactly the size of the data,
+// returns false if the connection ends first
+static bool read_data(int socket_descriptor, void* data, std::size_t size) {
+	std::size_t received_size = 0;
+
+	while (received_size < size) {
+		const ssize_t received = ::recv(socket_descriptor, (char*)data + received_size, size - received_size, 0);
+
+		if ((received < 0) && (errno == EINTR)) {
+			continue;
+		} else if (received <= 0) {
+			return false;
+		}
+
+		received_size += (std::size_t)received;
+	}
+
+	return true;
+}
+
+lcdmd_client::lcdmd_client(const std::string& socket_path) :
+	socket_descriptor(connect_socket(socket_path)),
+	segment_object(),
+	segment_region(),
+	segment(nullptr),
+	device_count(0),
+	request_mutex(),
+	pending_requests(lcdmd::ring_capacity),
+	free_requests(),
+	connected(true),
+	result_thread() {
+	try {
+		lcdmd::hello_message hello;
+
+		if ((!read_data(this->socket_descriptor, &hello, sizeof(hello)))
+			|| (std::memcmp(hello.magic, lcdmd::hello_magic, sizeof(hello.magic)) != 0)
+			|| (hello.version != lcdmd::protocol_version)
+			|| (hello.segment_size != sizeof(lcdmd::shared_segment))) {
+			throw std::runtime_error("unable to connect to lcdmd");
+		}
+
+		hello.segment_name[sizeof(hello.segment_name) - 1] = '\0';
+		this->segment_object = boost::interprocess::shared_memory_object(boost::interprocess::open_only, hello.segment_name, boost::interprocess::read_write);
+		this->segment_region = boost::interprocess::mapped_region(this->segment_object, boost::interprocess::read_write);
+		this->segment = (lcdmd::shared_segment*)this->segment_region.get_address();
+		this->device_count = hello.device_count;
+
+		// entries are taken from the back
+		this->free_requests.reserve(lcdmd::ring_capacity);
+		for (std::size_t i = lcdmd::ring_capacity; i > 0; --i) {
+			this->free_requests.push_back((std::uint32_t)(i - 1));
+		}
+
+		// the first doorbell tells the daemon
+		// that the segment is mapped
+		this->write_doorbell();
+		this->result_thread = std::thread(&lcdmd_client::operate, this);
+	} catch (std::exception) {
+		::close(this->socket_descriptor);
+		throw std::runtime_error("unable to connect to lcdmd");
+	}
+}
+
+lcdmd_client::~lcdmd_client() {
+	// the result thread sees the end of the connection
+	::shutdown(this->socket_descriptor, SHUT_RDWR);
+	this->result_thread.join();
+	::close(this->socket_descriptor);
+}
+
+std::size_t lcdmd_client::get_device_count() const {
+	return this->device_count;
+}
+
+std::future<lcdm::operation_status> lcdmd_client::purge(std::size_t device_index) {
+	std::shared_ptr<std::promise<lcdm::operation_status>> result = std::make_shared<std::promise<lcdm::operation_status>>();
+	std::future<lcdm::operation_status> future_result = result->get_future();
+	this->purge(device_index, make_promise_handler(result));
+	return future_result;
+}
+
+std::future<lcdm::dispense_result> lcdmd_client::dispense(std::size_t device_index, const lcdm::bill_counts& requested_bills) {
+	std::shared_ptr<std::promise<lcdm::dispense_result>> result = std::make_shared<std::promise<lcdm::dispense_result>>();
+	std::future<lcdm::dispense_result> future_result = result->get_future();
+	this->dispense(device_index, requested_bills, make_promise_handler(result));
+	return future_result;
+}
+
+void lcdmd_client::purge(std::size_t device_index, lcdm::purge_handler handler) {
+	this->submit(device_index, nullptr, handler, lcdm::dispense_handler());
+}
+
+void lcdmd_client::dispense(std::size_t device_index, const lcdm::bill_counts& requested_bills, lcdm::dispense_handler handler) {
+	this->submit(device_index, &requested_bills, lcdm::purge_handler(), handler);
+}
+
+void lcdmd_client::operate() {
+	std::array<char, 64> doorbell_buffer;
+
+	for (;;) {
+		const ssize_t received = ::recv(this->socket_descriptor, doorbell_buffer.data(), doorbell_buffer.size(), 0);
+
+		if ((received < 0) && (errno == EINTR)) {
+			continue;
+		} else if (received <= 0) {
+			break;
+		}
+
+		// results pushed after the flag is cleared ring again
+		this->segment->result_signalled.store(false);
+		this->drain_results();
+	}
+
+	// results pushed before the daemon was gone
+	this->drain_results();
+	this->fail_requests();
+}
+
+void lcdmd_client::write_doorbell() {
+	// a failed write ends the connection at the next read
+	::send(this->socket_descriptor, &lcdmd::doorbell, 1, MSG_NOSIGNAL);
+}
+
+void lcdmd_client::submit(std::size_t device_index, const lcdm::bill_counts* requested_bills, lcdm::purge_handler purge_handler, lcdm::dispense_handler dispense_handler) {
+	if (device_index >= this->device_count) {
+		complete_request(purge_handler, dispense_handler, std::make_exception_ptr(std::runtime_error("invalid request")),
+			make_status_result(lcdm::operation_status::cancelled));
+		return;
+	}
+
+	lcdmd::request_slot request;
+	std::memset(&request, 0, sizeof(request));
+	request.device_index = (std::uint32_t)device_index;
+	request.type = (requested_bills != nullptr) ? lcdmd::request_type::dispense : lcdmd::request_type::purge;
+
+	if (requested_bills != nullptr) {
+		request.cassette_count = (std::uint8_t)requested_bills->size();
+		for (std::size_t i = 0; i < request.bills.size(); ++i) {
+			request.bills[i] = (*requested_bills)[(lcdm::cassette_number)i];
+		}
+	}
+
+	bool request_is_queued = false;
+	lcdm::operation_status failure_status = lcdm::operation_status::queue_full;
+
+	{
+		std::lock_guard<std::mutex> request_lock(this->request_mutex);
+
+		if (!this->connected) {
+			failure_status = lcdm::operation_status::connection_error;
+		} else if (!this->free_requests.empty()) {
+			const std::uint32_t index = this->free_requests.back();
+			pending_request& entry = this->pending_requests[index];
+
+			++entry.generation;
+			request.request_id = ((std::uint64_t)entry.generation << 32) | index;
+			// the table has an entry for every slot of the ring,
+			// so the ring has room for a request with an entry
+			request_is_queued = this->segment->requests.try_push(request);
+
+			if (request_is_queued) {
+				this->free_requests.pop_back();
+				entry.purge_handler = std::move(purge_handler);
+				entry.dispense_handler = std::move(dispense_handler);
+				entry.is_used = true;
+			}
+		}
+	}
+
+	if (!request_is_queued) {
+		complete_request(purge_handler, dispense_handler, nullptr, make_status_result(failure_status));
+		return;
+	}
+
+	// a single doorbell is written
+	// until the daemon drains the ring
+	if (!this->segment->request_signalled.exchange(true)) {
+		this->write_doorbell();
+	}
+}
+
+void lcdmd_client::drain_results() {
+	lcdmd::result_slot result;
+
+	while (this->segment->results.try_pop(result)) {
+		const std::uint32_t index = (std::uint32_t)(result.request_id & 0xffffffff);
+		lcdm::purge_handler purge_handler;
+		lcdm::dispense_handler dispense_handler;
+
+		{
+			std::lock_guard<std::mutex> request_lock(this->request_mutex);
+
+			if ((index >= this->pending_requests.size())
+				|| (!this->pending_requests[index].is_used)
+				|| (this->pending_requests[index].generation != (std::uint32_t)(result.request_id >> 32))) {
+				// the operation has already been completed
+				continue;
+			}
+
+			pending_request& entry = this->pending_requests[index];
+			purge_handler = std::move(entry.purge_handler);
+			dispense_handler = std::move(entry.dispense_handler);
+			entry.purge_handler = lcdm::purge_handler();
+			entry.dispense_handler = lcdm::dispense_handler();
+			entry.is_used = false;
+			this->free_requests.push_back(index);
+		}
+
+		lcdm::dispense_result dispense_result = make_status_result(result.status);
+		dispense_result.dispensed_bills = lcdm::bill_counts(std::min<std::size_t>(result.cassette_count, lcdm::bill_counts::capacity));
+		dispense_result.rejected_bills = lcdm::bill_counts(dispense_result.dispensed_bills.size());
+		for (std::size_t i = 0; i < dispense_result.dispensed_bills.size(); ++i) {
+			dispense_result.dispensed_bills[(lcdm::cassette_number)i] = result.dispensed_bills[i];
+			dispense_result.rejected_bills[(lcdm::cassette_number)i] = result.rejected_bills[i];
+		}
+
+		std::exception_ptr error;
+		if (result.error == lcdmd::result_error::invalid_request) {
+			error = std::make_exception_ptr(std::runtime_error("invalid request"));
+		} else if (result.error != lcdmd::result_error::none) {
+			error = std::make_exception_ptr(std::runtime_error("unexpected device result"));
+		}
+
+		complete_request(purge_handler, dispense_handler, error, dispense_result);
+	}
+}
+
+void lcdmd_client::fail_requests() {
+	std::vector<pending_request> failed_requests;
+
+	{
+		std::lock_guard<std::mutex> request_lock(this->request_mutex);
+		this->connected = false;
+
+		for (std::size_t i = 0; i < this->pending_requests.size(); ++i) {
+			pending_request& entry = this->pending_requests[i];
+
+			if (entry.is_used) {
+				failed_requests.push_back(entry);
+				entry.purge_handler = lcdm::purge_handler();
+				entry.dispense_handler = lcdm::dispense_handler();
+				entry.is_used = false;
+				this->free_requests.push_back((std::uint32_t)i);
+			}
+		}
+	}
+
+	for (const pending_request& failed_request : failed_requests) {
+		complete_request(failed_request.purge_handler, failed_request.dispense_handler, nullptr,
+			make_status_result(lcdm::operation_status::connection_error));
+	}
+}
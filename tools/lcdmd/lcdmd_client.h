@@ -0,0 +1,107 @@
+#ifndef LCDMD_CLIENT_H
+#define LCDMD_CLIENT_H
+
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/interprocess/shared_memory_object.hpp>
+#include "lcdm.h"
+
+namespace puloon {
+
+	namespace lcdmd {
+		struct shared_segment;
+	}
+
+	// submits operations to the devices of an lcdmd daemon
+	// through the shared memory rings of a connection;
+	// a submission copies the request into the ring
+	// and wakes the daemon only if it is not already woken,
+	// results are delivered on a thread of the client
+	class lcdmd_client {
+		public:
+			// connects to the socket of the daemon
+			// and maps the segment of the connection;
+			// throws std::runtime_error if the daemon cannot be reached
+			explicit lcdmd_client(const std::string& socket_path);
+			// disconnects, operations in progress are completed
+			// with operation_status::connection_error
+			~lcdmd_client();
+
+			lcdmd_client(const lcdmd_client&) = delete;
+			lcdmd_client& operator=(const lcdmd_client&) = delete;
+
+			// number of devices served by the daemon,
+			// a device is addressed by its index
+			std::size_t get_device_count() const;
+
+			// operations complete with operation_status::queue_full
+			// if the client has too many of them in progress,
+			// and with operation_status::connection_error
+			// if the daemon is gone; the exception is set
+			// if the request is invalid or the device returns
+			// an unexpected result
+			std::future<lcdm::operation_status> purge(std::size_t device_index);
+			std::future<lcdm::dispense_result> dispense(std::size_t device_index, const lcdm::bill_counts& requested_bills);
+			// the handlers are invoked on the thread of the client,
+			// or on the calling thread if the operation is not submitted
+			void purge(std::size_t device_index, lcdm::purge_handler handler);
+			void dispense(std::size_t device_index, const lcdm::bill_counts& requested_bills, lcdm::dispense_handler handler);
+
+		private:
+			// operation waiting for its result,
+			// the index in the table is a part of the request id
+			struct pending_request {
+				pending_request() :
+					purge_handler(),
+					dispense_handler(),
+					generation(0),
+					is_used(false) {
+				}
+
+				lcdm::purge_handler purge_handler;
+				lcdm::dispense_handler dispense_handler;
+				// changes with every use of the entry,
+				// so a late result does not complete the next request
+				std::uint32_t generation;
+				bool is_used;
+			};
+
+		private:
+			// waits for doorbells of the daemon
+			// and completes the operations of the results
+			void operate();
+			// writes a doorbell to the daemon
+			void write_doorbell();
+			// pushes a request into the ring and wakes the daemon,
+			// completes the handler if the request cannot be queued
+			void submit(std::size_t device_index, const lcdm::bill_counts* requested_bills, lcdm::purge_handler purge_handler, lcdm::dispense_handler dispense_handler);
+			// completes the operations of the results in the ring
+			void drain_results();
+			// completes every operation in progress
+			// with operation_status::connection_error
+			void fail_requests();
+
+		private:
+			int socket_descriptor;
+			boost::interprocess::shared_memory_object segment_object;
+			boost::interprocess::mapped_region segment_region;
+			lcdmd::shared_segment* segment;
+			std::size_t device_count;
+			// guards the request ring and the table
+			std::mutex request_mutex;
+			std::vector<pending_request> pending_requests;
+			// indices of the free entries of the table
+			std::vector<std::uint32_t> free_requests;
+			bool connected;
+			std::thread result_thread;
+	};
+
+}
+
+#endif // LCDMD_CLIENT_H
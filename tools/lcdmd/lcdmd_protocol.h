@@ -0,0 +1,163 @@
+#ifndef LCDMD_PROTOCOL_H
+#define LCDMD_PROTOCOL_H
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include "lcdm.h"
+
+namespace puloon {
+
+	// protocol between the lcdmd daemon and its clients:
+	// a client connects to the unix-domain socket of the daemon
+	// and receives a hello with the name of a shared memory segment
+	// created for the connection; requests and results flow
+	// through two rings in the segment, and the socket only carries
+	// single-byte doorbells that wake the other side
+	namespace lcdmd {
+
+		enum class request_type : std::uint8_t {
+			purge = 1,
+			dispense = 2
+		};
+
+		enum class result_error : std::uint8_t {
+			none = 0,
+			// the device index or the bills are invalid,
+			// or the client has too many requests in progress
+			invalid_request = 1,
+			// the device returned an unexpected result
+			unexpected_result = 2
+		};
+
+		struct request_slot {
+			// chosen by the client and returned in the result
+			std::uint64_t request_id;
+			// index of the device in the order of the daemon options
+			std::uint32_t device_index;
+			request_type type;
+			std::uint8_t cassette_count;
+			std::uint8_t reserved[2];
+			// bills of a dispense, indexed by cassette
+			std::array<std::uint32_t, lcdm::bill_counts::capacity> bills;
+		};
+
+		struct result_slot {
+			std::uint64_t request_id;
+			lcdm::operation_status status;
+			result_error error;
+			std::uint8_t cassette_count;
+			std::uint8_t reserved[5];
+			std::array<std::uint32_t, lcdm::bill_counts::capacity> dispensed_bills;
+			std::array<std::uint32_t, lcdm::bill_counts::capacity> rejected_bills;
+		};
+
+		// single-producer single-consumer ring in shared memory,
+		// the counters are free-running and the capacity is a power of two;
+		// the atomics are lock-free and therefore address-free
+		template <typename Slot, std::size_t Capacity>
+		class shared_ring {
+			public:
+				static_assert((Capacity & (Capacity - 1)) == 0, "capacity is a power of two");
+				static_assert(std::is_trivially_copyable<Slot>::value, "slots are copied between processes");
+
+				shared_ring() :
+					head(0),
+					tail(0),
+					slots() {
+				}
+
+				// returns false if the ring is full
+				bool try_push(const Slot& slot) {
+					const std::uint64_t current_tail = this->tail.load(std::memory_order_relaxed);
+
+					if (current_tail - this->head.load(std::memory_order_acquire) >= Capacity) {
+						return false;
+					}
+
+					this->slots[current_tail & (Capacity - 1)] = slot;
+					this->tail.store(current_tail + 1, std::memory_order_release);
+					return true;
+				}
+
+				// returns the slots pushed and not yet popped,
+				// the other side may change them at any time
+				std::size_t get_size() const {
+					const std::uint64_t current_head = this->head.load(std::memory_order_acquire);
+					return (std::size_t)(this->tail.load(std::memory_order_acquire) - current_head);
+				}
+
+				// returns false if the ring is empty
+				bool try_pop(Slot& slot) {
+					const std::uint64_t current_head = this->head.load(std::memory_order_relaxed);
+
+					if (current_head == this->tail.load(std::memory_order_acquire)) {
+						return false;
+					}
+
+					slot = this->slots[current_head & (Capacity - 1)];
+					this->head.store(current_head + 1, std::memory_order_release);
+					return true;
+				}
+
+			private:
+				// the counters of the consumer and the producer
+				// are kept on separate cache lines
+				alignas(64) std::atomic<std::uint64_t> head;
+				alignas(64) std::atomic<std::uint64_t> tail;
+				alignas(64) std::array<Slot, Capacity> slots;
+		};
+
+		// requests a client may have in progress
+		// together with the results it has not taken,
+		// so a result always finds room in its ring;
+		// the daemon rejects a request beyond the limit
+		// with result_error::invalid_request
+		const std::size_t ring_capacity = 256;
+
+		// contents of the shared memory segment of a connection
+		struct shared_segment {
+			shared_segment() :
+				request_signalled(false),
+				result_signalled(false),
+				requests(),
+				results() {
+			}
+
+			// set by the side that wrote a doorbell
+			// until the other side starts draining the ring,
+			// a producer writes a doorbell only if the flag was clear
+			alignas(64) std::atomic<bool> request_signalled;
+			alignas(64) std::atomic<bool> result_signalled;
+			shared_ring<request_slot, ring_capacity> requests;
+			shared_ring<result_slot, ring_capacity> results;
+		};
+
+		static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "counters in shared memory are lock-free");
+		static_assert(ATOMIC_BOOL_LOCK_FREE == 2, "flags in shared memory are lock-free");
+
+		// first message of the daemon on a new connection
+		struct hello_message {
+			char magic[6];
+			std::uint8_t version;
+			std::uint8_t reserved;
+			// size of the shared segment, a mismatch means
+			// the client was built for another layout
+			std::uint32_t segment_size;
+			std::uint32_t device_count;
+			// name of the shared memory object, zero-terminated
+			char segment_name[52];
+		};
+
+		const char hello_magic[6] = { 'L', 'C', 'D', 'M', 'D', '\0' };
+		const std::uint8_t protocol_version = 1;
+		// byte written to the socket to wake the other side
+		const std::uint8_t doorbell = 0x07;
+
+	}
+
+}
+
+#endif // LCDMD_PROTOCOL_H
@@ -0,0 +1,321 @@
+#include "lcdmd_server.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/interprocess/shared_memory_object.hpp>
+#include "lcdmd_protocol.h"
+
+using namespace puloon;
+
+// the socket is shared with the group of the daemon
+const mode_t socket_access_mode = 0660;
+// a segment is private to the user of its client
+const mode_t segment_access_mode = 0600;
+
+// gives a segment to the user of the client on the other end of the socket,
+// a daemon that may not change the owner keeps the segment
+static void give_segment_to_peer(boost::interprocess::shared_memory_object& segment_object, boost::asio::local::stream_protocol::socket& socket) {
+#if defined(SO_PEERCRED)
+	ucred peer_credentials;
+	socklen_t credentials_size = sizeof(peer_credentials);
+
+	if (::getsockopt(socket.native_handle(), SOL_SOCKET, SO_PEERCRED, &peer_credentials, &credentials_size) == 0) {
+		(void)::fchown(segment_object.get_mapping_handle().handle, peer_credentials.uid, (gid_t)-1);
+	}
+#else
+	(void)segment_object;
+	(void)socket;
+#endif
+}
+
+static void copy_result_counts(const lcdm::bill_counts& counts, std::array<std::uint32_t, lcdm::bill_counts::capacity>& slot_counts) {
+	for (std::size_t i = 0; i < slot_counts.size(); ++i) {
+		slot_counts[i] = counts[(lcdm::cassette_number)i];
+	}
+}
+
+static lcdmd::result_slot make_result(std::uint64_t request_id, lcdmd::result_error error, lcdm::operation_status status) {
+	lcdmd::result_slot result;
+
+	std::memset(&result, 0, sizeof(result));
+	result.request_id = request_id;
+	result.status = status;
+	result.error = error;
+
+	return result;
+}
+
+static lcdmd::result_slot make_dispense_result(std::uint64_t request_id, std::exception_ptr error, const lcdm::dispense_result& dispense_result) {
+	lcdmd::result_slot result = make_result(request_id,
+		error ? lcdmd::result_error::unexpected_result : lcdmd::result_error::none, dispense_result.status);
+
+	result.cassette_count = (std::uint8_t)std::max(dispense_result.dispensed_bills.size(), dispense_result.rejected_bills.size());
+	copy_result_counts(dispense_result.dispensed_bills, result.dispensed_bills);
+	copy_result_counts(dispense_result.rejected_bills, result.rejected_bills);
+
+	return result;
+}
+
+class lcdmd_server::session : public std::enable_shared_from_this<session> {
+	public:
+		// creates the shared segment of the connection
+		session(boost::asio::io_service& io_service, boost::asio::local::stream_protocol::socket socket, const std::vector<lcdm*>& devices, const std::string& segment_name);
+		// removes the segment if the client has not attached to it
+		~session();
+
+		session(const session&) = delete;
+		session& operator=(const session&) = delete;
+
+		// sends the hello and starts waiting for doorbells
+		void start();
+
+	private:
+		void read_doorbell();
+		// drains the request ring,
+		// the first doorbell confirms that the client has mapped the segment
+		void handle_doorbell(const boost::system::error_code& error);
+		void submit(const lcdmd::request_slot& request);
+		// pushes a result and wakes the client,
+		// can be called from any thread
+		void complete(const lcdmd::result_slot& result);
+		// completes a request submitted to a device
+		void complete_request(const lcdmd::result_slot& result);
+		void write_doorbell();
+
+	private:
+		boost::asio::io_service& io_service;
+		boost::asio::local::stream_protocol::socket socket;
+		std::vector<lcdm*> devices;
+		std::string segment_name;
+		boost::interprocess::shared_memory_object segment_object;
+		boost::interprocess::mapped_region segment_region;
+		lcdmd::shared_segment* segment;
+		// the only name of the segment is removed
+		// as soon as the client has mapped it
+		bool segment_is_named;
+		// devices complete requests on their handler threads
+		std::mutex result_mutex;
+		// requests submitted to the devices without a result in the ring
+		std::atomic<std::size_t> requests_in_progress;
+		lcdmd::hello_message hello;
+		std::array<char, 64> doorbell_buffer;
+};
+
+lcdmd_server::session::session(boost::asio::io_service& io_service, boost::asio::local::stream_protocol::socket socket, const std::vector<lcdm*>& devices, const std::string& segment_name) :
+	io_service(io_service),
+	socket(std::move(socket)),
+	devices(devices),
+	segment_name(segment_name),
+	segment_object(boost::interprocess::create_only, segment_name.c_str(), boost::interprocess::read_write, boost::interprocess::permissions(segment_access_mode)),
+	segment_region(),
+	segment(nullptr),
+	segment_is_named(true),
+	result_mutex(),
+	requests_in_progress(0),
+	hello(),
+	doorbell_buffer() {
+	try {
+		give_segment_to_peer(this->segment_object, this->socket);
+		this->segment_object.truncate(sizeof(lcdmd::shared_segment));
+		this->segment_region = boost::interprocess::mapped_region(this->segment_object, boost::interprocess::read_write);
+	} catch (boost::interprocess::interprocess_exception) {
+		boost::interprocess::shared_memory_object::remove(this->segment_name.c_str());
+		throw;
+	}
+
+	this->segment = new (this->segment_region.get_address()) lcdmd::shared_segment();
+}
+
+lcdmd_server::session::~session() {
+	if (this->segment_is_named) {
+		boost::interprocess::shared_memory_object::remove(this->segment_name.c_str());
+	}
+}
+
+void lcdmd_server::session::start() {
+	std::shared_ptr<session> self = this->shared_from_this();
+
+	std::memcpy(this->hello.magic, lcdmd::hello_magic, sizeof(this->hello.magic));
+	this->hello.version = lcdmd::protocol_version;
+	this->hello.segment_size = sizeof(lcdmd::shared_segment);
+	this->hello.device_count = (std::uint32_t)this->devices.size();
+	std::strncpy(this->hello.segment_name, this->segment_name.c_str(), sizeof(this->hello.segment_name) - 1);
+
+	boost::asio::async_write(this->socket, boost::asio::buffer(&this->hello, sizeof(this->hello)),
+		[self](const boost::system::error_code& error, std::size_t) {
+			if (!error) {
+				self->read_doorbell();
+			}
+		});
+}
+
+void lcdmd_server::session::read_doorbell() {
+	std::shared_ptr<session> self = this->shared_from_this();
+
+	this->socket.async_read_some(boost::asio::buffer(this->doorbell_buffer),
+		[self](const boost::system::error_code& error, std::size_t) {
+			self->handle_doorbell(error);
+		});
+}
+
+void lcdmd_server::session::handle_doorbell(const boost::system::error_code& error) {
+	if (error) {
+		// the client is gone, the session ends
+		// with the last request in progress
+		boost::system::error_code ignored_error;
+		this->socket.close(ignored_error);
+		return;
+	}
+
+	if (this->segment_is_named) {
+		boost::interprocess::shared_memory_object::remove(this->segment_name.c_str());
+		this->segment_is_named = false;
+	}
+
+	// requests pushed after the flag is cleared ring again
+	this->segment->request_signalled.store(false);
+
+	lcdmd::request_slot request;
+	while (this->segment->requests.try_pop(request)) {
+		this->submit(request);
+	}
+
+	this->read_doorbell();
+}
+
+void lcdmd_server::session::submit(const lcdmd::request_slot& request) {
+	std::shared_ptr<session> self = this->shared_from_this();
+	const std::uint64_t request_id = request.request_id;
+
+	if ((request.device_index >= this->devices.size()) || (request.cassette_count > lcdm::bill_counts::capacity)) {
+		this->complete(make_result(request_id, lcdmd::result_error::invalid_request, lcdm::operation_status::cancelled));
+		return;
+	}
+
+	// every request in progress has room for its result;
+	// only this thread adds requests, results are pushed
+	// before their requests stop counting
+	if (this->requests_in_progress.load() + this->segment->results.get_size() >= lcdmd::ring_capacity) {
+		this->complete(make_result(request_id, lcdmd::result_error::invalid_request, lcdm::operation_status::cancelled));
+		return;
+	}
+
+	lcdm& device = *this->devices[request.device_index];
+	++this->requests_in_progress;
+
+	try {
+		if (request.type == lcdmd::request_type::purge) {
+			device.purge([self, request_id](std::exception_ptr error, lcdm::operation_status status) {
+				self->complete_request(make_result(request_id,
+					error ? lcdmd::result_error::unexpected_result : lcdmd::result_error::none, status));
+			});
+		} else if (request.type == lcdmd::request_type::dispense) {
+			lcdm::bill_counts requested_bills(request.cassette_count);
+			for (std::size_t i = 0; i < requested_bills.size(); ++i) {
+				requested_bills[(lcdm::cassette_number)i] = request.bills[i];
+			}
+
+			device.dispense(requested_bills, [self, request_id](std::exception_ptr error, lcdm::dispense_result result) {
+				self->complete_request(make_dispense_result(request_id, error, result));
+			});
+		} else {
+			this->complete_request(make_result(request_id, lcdmd::result_error::invalid_request, lcdm::operation_status::cancelled));
+		}
+	} catch (std::exception) {
+		// the device refused the bills
+		this->complete_request(make_result(request_id, lcdmd::result_error::invalid_request, lcdm::operation_status::cancelled));
+	}
+}
+
+void lcdmd_server::session::complete_request(const lcdmd::result_slot& result) {
+	this->complete(result);
+	--this->requests_in_progress;
+}
+
+void lcdmd_server::session::complete(const lcdmd::result_slot& result) {
+	{
+		std::lock_guard<std::mutex> result_lock(this->result_mutex);
+		// the ring only overflows with the rejections
+		// of a client that does not take its results,
+		// they are dropped
+		this->segment->results.try_push(result);
+	}
+
+	if (!this->segment->result_signalled.exchange(true)) {
+		std::shared_ptr<session> self = this->shared_from_this();
+
+		boost::asio::post(this->io_service, [self]() {
+			self->write_doorbell();
+		});
+	}
+}
+
+void lcdmd_server::session::write_doorbell() {
+	std::shared_ptr<session> self = this->shared_from_this();
+
+	boost::asio::async_write(this->socket, boost::asio::buffer(&lcdmd::doorbell, 1),
+		[self](const boost::system::error_code&, std::size_t) {
+			// a failed write ends the session at the next read
+		});
+}
+
+lcdmd_server::lcdmd_server(boost::asio::io_service& io_service, const std::string& socket_path, const std::vector<lcdm*>& devices) :
+	io_service(io_service),
+	socket_path(socket_path),
+	devices(devices),
+	acceptor(io_service),
+	accepted_socket(io_service),
+	session_count(0) {
+	// a socket left by a daemon that was killed
+	::unlink(socket_path.c_str());
+
+	const boost::asio::local::stream_protocol::endpoint endpoint(socket_path);
+	this->acceptor.open(endpoint.protocol());
+	this->acceptor.bind(endpoint);
+	::chmod(socket_path.c_str(), socket_access_mode);
+	this->acceptor.listen();
+
+	this->accept();
+}
+
+lcdmd_server::~lcdmd_server() {
+	boost::system::error_code ignored_error;
+	this->acceptor.close(ignored_error);
+	::unlink(this->socket_path.c_str());
+}
+
+void lcdmd_server::accept() {
+	this->acceptor.async_accept(this->accepted_socket, [this](const boost::system::error_code& error) {
+		this->handle_accept(error);
+	});
+}
+
+void lcdmd_server::handle_accept(const boost::system::error_code& error) {
+	if (error == boost::asio::error::operation_aborted) {
+		return;
+	}
+
+	if (!error) {
+		const std::string segment_name = "lcdmd-" + std::to_string(::getpid()) + "-" + std::to_string(++this->session_count);
+
+		try {
+			std::make_shared<session>(this->io_service, std::move(this->accepted_socket), this->devices, segment_name)->start();
+		} catch (std::exception) {
+			// the connection is refused
+			// if its segment cannot be created
+		}
+
+		this->accepted_socket = boost::asio::local::stream_protocol::socket(this->io_service);
+	}
+
+	this->accept();
+}
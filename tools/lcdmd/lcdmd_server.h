@@ -0,0 +1,51 @@
+#ifndef LCDMD_SERVER_H
+#define LCDMD_SERVER_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include <boost/asio.hpp>
+#include "lcdm.h"
+
+namespace puloon {
+
+	// serves local clients of the devices
+	// over a unix-domain socket, every connection gets
+	// a shared memory segment with its request and result rings
+	// that only the user of the client can open;
+	// requests are submitted to the devices from the io_service
+	// of the server, results are written to the rings
+	// by the handler threads of the devices
+	class lcdmd_server {
+		public:
+			// listens on the socket path, replacing a stale socket;
+			// the devices must outlive the server
+			lcdmd_server(boost::asio::io_service& io_service, const std::string& socket_path, const std::vector<lcdm*>& devices);
+			// stops accepting and removes the socket,
+			// connections end with the io_service
+			~lcdmd_server();
+
+			lcdmd_server(const lcdmd_server&) = delete;
+			lcdmd_server& operator=(const lcdmd_server&) = delete;
+
+		private:
+			class session;
+
+		private:
+			void accept();
+			void handle_accept(const boost::system::error_code& error);
+
+		private:
+			boost::asio::io_service& io_service;
+			std::string socket_path;
+			std::vector<lcdm*> devices;
+			boost::asio::local::stream_protocol::acceptor acceptor;
+			boost::asio::local::stream_protocol::socket accepted_socket;
+			// makes the names of the shared memory segments unique
+			std::uint64_t session_count;
+	};
+
+}
+
+#endif // LCDMD_SERVER_H
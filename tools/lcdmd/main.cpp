@@ -0,0 +1,136 @@
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include <boost/asio.hpp>
+#include "lcdm_controller.h"
+#include "lcdmd_server.h"
+
+using namespace puloon;
+
+// socket of the daemon if none is given
+const char default_socket_path[] = "/run/lcdmd.sock";
+
+struct device_option {
+	std::string port_name;
+	lcdm::device_model model;
+	// the port is the HOST:PORT of a serial-to-Ethernet bridge
+	bool is_bridge;
+};
+
+// creates the device of an option
+static lcdm& add_device(lcdm_controller& controller, const device_option& current_option) {
+	if (!current_option.is_bridge) {
+		return controller.add_device(current_option.port_name, lcdm::timeouts(), current_option.model);
+	}
+
+	const std::size_t separator = current_option.port_name.rfind(':');
+	const std::string host = current_option.port_name.substr(0, separator);
+	const std::string service = current_option.port_name.substr(separator + 1);
+
+	return controller.add_device([host, service](boost::asio::io_service& io_service) {
+		return std::unique_ptr<lcdm_transport>(new tcp_transport(io_service, host, service));
+	}, lcdm::timeouts(), current_option.model);
+}
+
+static void print_usage(const char* program_name) {
+	std::cerr << "usage: " << program_name << " [options] --device PORT..." << std::endl
+		<< "  --socket PATH               unix-domain socket of the clients" << std::endl
+		<< "  --device PORT               serve an LCDM-2000 on the serial port" << std::endl
+		<< "  --lcdm-4000 PORT            serve an LCDM-4000 on the serial port (experimental)" << std::endl
+		<< "  --tcp HOST:PORT             serve an LCDM-2000 behind a raw TCP serial bridge" << std::endl
+		<< "  --threads N                 handler threads of the devices" << std::endl
+		<< "  --status-poll-ms N          request the status of an idle device" << std::endl
+		<< "  --coalesce                  merge queued single cassette dispenses" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+	std::string socket_path = default_socket_path;
+	std::vector<device_option> device_options;
+	std::size_t thread_count = 1;
+	long status_poll_interval_ms = 0;
+	bool dispense_coalescing_enabled = false;
+
+	for (int i = 1; i < argc; ++i) {
+		const char* option = argv[i];
+
+		if (std::strcmp(option, "--coalesce") == 0) {
+			dispense_coalescing_enabled = true;
+			continue;
+		}
+
+		const char* value = (i + 1 < argc) ? argv[i + 1] : nullptr;
+
+		if (value == nullptr) {
+			print_usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+
+		if (std::strcmp(option, "--socket") == 0) {
+			socket_path = value;
+		} else if (std::strcmp(option, "--device") == 0) {
+			device_options.push_back({ value, lcdm::device_model::lcdm_2000, false });
+		} else if (std::strcmp(option, "--lcdm-4000") == 0) {
+			device_options.push_back({ value, lcdm::device_model::lcdm_4000, false });
+		} else if ((std::strcmp(option, "--tcp") == 0) && (std::strchr(value, ':') != nullptr)) {
+			device_options.push_back({ value, lcdm::device_model::lcdm_2000, true });
+		} else if (std::strcmp(option, "--threads") == 0) {
+			thread_count = (std::size_t)std::atol(value);
+		} else if (std::strcmp(option, "--status-poll-ms") == 0) {
+			status_poll_interval_ms = std::atol(value);
+		} else {
+			print_usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+
+		++i;
+	}
+
+	if (device_options.empty()) {
+		print_usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	try {
+		boost::asio::io_service io_service;
+		// the devices outlive the connections of the server
+		lcdm_controller controller(thread_count);
+		controller.set_error_handler([](std::exception_ptr error) {
+			try {
+				std::rethrow_exception(error);
+			} catch (const std::exception& handler_error) {
+				std::cerr << "handler error: " << handler_error.what() << std::endl;
+			} catch (...) {
+				std::cerr << "handler error" << std::endl;
+			}
+		});
+		std::vector<lcdm*> devices;
+
+		for (const device_option& current_option : device_options) {
+			lcdm& device = add_device(controller, current_option);
+			device.set_dispense_coalescing(dispense_coalescing_enabled);
+			if (status_poll_interval_ms > 0) {
+				device.start_status_polling(std::chrono::milliseconds(status_poll_interval_ms));
+			}
+			devices.push_back(&device);
+		}
+
+		lcdmd_server server(io_service, socket_path, devices);
+
+		boost::asio::signal_set stop_signals(io_service, SIGINT, SIGTERM);
+		stop_signals.async_wait([&io_service](const boost::system::error_code&, int) {
+			io_service.stop();
+		});
+
+		std::cout << socket_path << std::endl;
+		io_service.run();
+	} catch (const std::exception& error) {
+		std::cerr << error.what() << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}